@@ -0,0 +1,556 @@
+// SPDX-License-Identifier: BSL-1.0
+
+/*
+USAGE
+  h1sp_bench [--max-size BYTES] [--min-time SECONDS] [--filter TEXT]
+             [--threads N] [--json FILE] [--dir DIR] [--budget NS]
+    Times the cipher, hashing and archive routines on synthetic data of
+    1 KiB up to BYTES (default 1 GiB) bytes, in steps of 16x.
+
+  OPTIONS
+     --max-size BYTES the largest input to time. Defaults to 1073741824.
+     --min-time SECONDS the least time each measurement is repeated for.
+        Defaults to 0.25.
+     --filter TEXT only runs the benchmarks whose name contains TEXT.
+     --threads N the thread count used by the threaded cipher benchmarks.
+        0 uses one thread per hardware thread. Defaults to 0.
+     --json FILE also writes the results to FILE as JSON.
+     --dir DIR the directory for the temporary archive files. Defaults to
+        the system temporary directory.
+     --budget NS fails the run if loading any hostile archive (tiny or
+        oversized members, cut-off headers or trailers) takes more than NS
+        nanoseconds per byte. The hostile loads always fail the run if they
+        accept or reject an archive unlike a plain reference check.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+    #define H1SP_BENCH_HAS_TSC 1
+#else
+    #define H1SP_BENCH_HAS_TSC 0
+#endif
+
+#include <h1sp/archive.hpp>
+#include <h1sp/core.hpp>
+#include <h1sp/crypt.hpp>
+
+#include "archive_oracle.hpp"
+
+namespace
+{
+    namespace sp = shader_packager;
+
+    struct bench_options
+    {
+        std::size_t      max_size = std::size_t{1} << 30;
+        double           min_time = 0.25;
+        std::string_view filter;
+        std::size_t      threads  = 0;
+        const char*      json     = nullptr;
+        double           budget   = 0.0;
+        std::filesystem::path dir = std::filesystem::temp_directory_path();
+    };
+
+    struct bench_result
+    {
+        std::string   name;       ///< The benchmark name.
+        std::size_t   size;       ///< Bytes processed per iteration.
+        std::size_t   iterations; ///< Number of timed iterations.
+        double        seconds;    ///< The fastest iteration, in seconds.
+        std::uint64_t cycles;     ///< Timestamp counter ticks of the fastest
+                                  ///< iteration, or 0 if unavailable.
+    };
+
+    std::uint64_t read_cycle_counter() noexcept
+    {
+    #if H1SP_BENCH_HAS_TSC
+        return __rdtsc();
+    #else
+        return 0;
+    #endif
+    }
+
+    /**
+     * \brief Times \a f repeatedly until at least \a min_time seconds (and
+     *        at least 3 iterations) have elapsed, keeping the fastest run.
+     *
+     * \a setup is run before each iteration and is not timed.
+     */
+    template<typename Setup, typename F>
+    bench_result measure(
+        std::string name,
+        std::size_t size,
+        double      min_time,
+        Setup&&     setup,
+        F&&         f)
+    {
+        using clock = std::chrono::steady_clock;
+
+        bench_result result{std::move(name), size, 0, 0.0, 0};
+        double total = 0.0;
+        while (result.iterations < 3 || total < min_time)
+        {
+            setup();
+
+            const auto          start        = clock::now();
+            const std::uint64_t start_cycles = read_cycle_counter();
+            f();
+            const std::uint64_t end_cycles   = read_cycle_counter();
+            const auto          end          = clock::now();
+
+            const double seconds = std::chrono::duration<double>(end - start).count();
+            if (result.iterations == 0 || seconds < result.seconds)
+            {
+                result.seconds = seconds;
+                result.cycles  = end_cycles - start_cycles;
+            }
+            total += seconds;
+            ++result.iterations;
+        }
+
+        return result;
+    }
+
+    template<typename F>
+    bench_result measure(std::string name, std::size_t size, double min_time, F&& f)
+    {
+        return measure(std::move(name), size, min_time, [] { }, std::forward<F>(f));
+    }
+
+    double megabytes_per_second(const bench_result& r) noexcept
+    {
+        return r.seconds > 0.0 ? static_cast<double>(r.size) / r.seconds / 1.0e6 : 0.0;
+    }
+
+    double cycles_per_byte(const bench_result& r) noexcept
+    {
+        return r.size > 0 ? static_cast<double>(r.cycles) / static_cast<double>(r.size) : 0.0;
+    }
+
+    void print_result(const bench_result& r)
+    {
+        std::printf("%-36s %12zu B %10.1f MB/s",
+            r.name.c_str(), r.size, megabytes_per_second(r));
+        if (H1SP_BENCH_HAS_TSC)
+            std::printf(" %8.2f cycles/B", cycles_per_byte(r));
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    bool write_json(const char* file, const bench_options& opts, std::span<const bench_result> results)
+    {
+        std::FILE* fp = std::fopen(file, "w");
+        if (fp == nullptr)
+            return false;
+
+        std::fprintf(fp, "{\n  \"simd_isa\": \"%s\",\n  \"threads\": %zu,\n"
+                         "  \"cycle_counter\": %s,\n  \"benchmarks\": [",
+            sp::simd_isa_name(sp::detect_simd_isa()),
+            opts.threads,
+            H1SP_BENCH_HAS_TSC ? "\"tsc\"" : "null");
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const auto& r = results[i];
+            std::fprintf(fp, "%s\n    {\"name\": \"%s\", \"size\": %zu, \"iterations\": %zu, "
+                             "\"seconds\": %.9g, \"mb_per_s\": %.6g, ",
+                i == 0 ? "" : ",", r.name.c_str(), r.size, r.iterations,
+                r.seconds, megabytes_per_second(r));
+            if (H1SP_BENCH_HAS_TSC)
+                std::fprintf(fp, "\"cycles_per_byte\": %.6g}", cycles_per_byte(r));
+            else
+                std::fprintf(fp, "\"cycles_per_byte\": null}");
+        }
+        std::fprintf(fp, "\n  ]\n}\n");
+
+        const bool ok = std::ferror(fp) == 0;
+        return std::fclose(fp) == 0 && ok;
+    }
+
+    sp::byte_buffer make_random_buffer(std::size_t size, std::mt19937_64& rng)
+    {
+        sp::byte_buffer buf {
+            .buffer = std::make_unique<std::byte[]>(size),
+            .nbytes = size
+        };
+        for (std::size_t i = 0; i < size; i += sizeof(std::uint64_t))
+        {
+            const std::uint64_t v = rng();
+            std::memcpy(buf.buffer.get() + i, &v, std::min(sizeof(v), size - i));
+        }
+        return buf;
+    }
+
+    /**
+     * \brief Splits \a size bytes into members of a few KiB each, the way
+     *        the shipped archives are, accounting for the size headers and
+     *        the MD5 trailer.
+     */
+    std::vector<sp::byte_buffer> make_members(std::size_t size, std::mt19937_64& rng)
+    {
+        constexpr std::size_t overhead = sizeof(std::uint32_t);
+        constexpr std::size_t trailer  = 33;
+
+        std::vector<sp::byte_buffer> members;
+        std::size_t remaining = size > trailer + overhead ? size - trailer : overhead + 1;
+        std::uniform_int_distribution<std::size_t> member_size{512, 16 * 1024};
+        while (remaining > overhead)
+        {
+            const std::size_t n = std::min(member_size(rng), remaining - overhead);
+            members.push_back(make_random_buffer(n, rng));
+            remaining -= n + overhead;
+        }
+        return members;
+    }
+
+    void run_cipher_benchmarks(
+        const bench_options&       opts,
+        std::size_t                size,
+        std::vector<bench_result>& results,
+        std::mt19937_64&           rng)
+    {
+        auto buf = make_random_buffer(size, rng);
+        const auto range = buf.range();
+
+        auto run = [&] (std::string name, auto&& f) {
+            if (name.find(opts.filter) == std::string::npos)
+                return;
+            results.push_back(measure(std::move(name), size, opts.min_time, f));
+            print_result(results.back());
+        };
+
+        run("tea.encrypt_chunk", [&] {
+            for (std::size_t i = 0; i + sp::tea::chunk_size <= size; i += sp::tea::chunk_size)
+                sp::h1_tea.encrypt_chunk(range.data() + i);
+        });
+        run("tea.decrypt_chunk", [&] {
+            for (std::size_t i = 0; i + sp::tea::chunk_size <= size; i += sp::tea::chunk_size)
+                sp::h1_tea.decrypt_chunk(range.data() + i);
+        });
+
+        run("static_tea.encrypt_chunk", [&] {
+            for (std::size_t i = 0; i + sp::tea::chunk_size <= size; i += sp::tea::chunk_size)
+                sp::h1_static_tea.encrypt_chunk(range.data() + i);
+        });
+        run("static_tea.decrypt_chunk", [&] {
+            for (std::size_t i = 0; i + sp::tea::chunk_size <= size; i += sp::tea::chunk_size)
+                sp::h1_static_tea.decrypt_chunk(range.data() + i);
+        });
+
+        run("encrypt_buffer.scalar", [&] { sp::encrypt_buffer(sp::h1_tea, range); });
+        run("decrypt_buffer.scalar", [&] { sp::decrypt_buffer(sp::h1_tea, range); });
+        run("encrypt_buffer.static", [&] { sp::encrypt_buffer(sp::h1_static_tea, range); });
+        run("decrypt_buffer.static", [&] { sp::decrypt_buffer(sp::h1_static_tea, range); });
+
+        for (const auto isa : {sp::simd_isa::sse2, sp::simd_isa::avx2,
+                               sp::simd_isa::avx512, sp::simd_isa::neon})
+        {
+            if (!sp::is_simd_isa_supported(isa))
+                continue;
+
+            const sp::simd_tea scheme{.scalar = sp::h1_tea, .isa = isa};
+            const std::string  suffix = sp::simd_isa_name(isa);
+            run("encrypt_buffer." + suffix, [&] { sp::encrypt_buffer(scheme, range); });
+            run("decrypt_buffer." + suffix, [&] { sp::decrypt_buffer(scheme, range); });
+        }
+
+        run("encrypt_buffer.threaded", [&] {
+            sp::encrypt_buffer(sp::h1_static_tea, range, opts.threads);
+        });
+        run("decrypt_buffer.threaded", [&] {
+            sp::decrypt_buffer(sp::h1_static_tea, range, opts.threads);
+        });
+
+        run("compute_md5_digest", [&] { (void)sp::compute_md5_digest(range); });
+
+        // the same bytes, as one stream per MD5 lane
+        {
+            const std::size_t lanes = sp::md5_lane_count();
+            std::vector<std::span<const std::byte>> streams;
+            for (std::size_t i = 0; i < lanes; ++i)
+                streams.push_back(range.subspan(i * size / lanes, size / lanes));
+            std::vector<std::array<char, 33>> digests(lanes);
+            run("compute_md5_digests", [&] { sp::compute_md5_digests(streams, digests); });
+        }
+    }
+
+    void run_archive_benchmarks(
+        const bench_options&       opts,
+        std::size_t                size,
+        std::vector<bench_result>& results,
+        std::mt19937_64&           rng)
+    {
+        auto wanted = [&] (std::string_view name) {
+            return name.find(opts.filter) != std::string_view::npos;
+        };
+        if (!wanted("archive_enumerator") && !wanted("archive.flush_to_file") &&
+            !wanted("archive.read_from_file"))
+            return;
+
+        const auto file = (opts.dir / ("h1sp_bench_" + std::to_string(size) + ".bin")).string();
+
+        // flushing empties an archive, so each flush reloads the members
+        const auto  members = make_members(size, rng);
+        sp::archive source;
+        source.load_members_from(members);
+
+        // the archive needs to exist for the read and enumeration benchmarks
+        if (source.flush_to_file(file.c_str()) != sp::archive::write_error::success)
+        {
+            std::fprintf(stderr, "could not write %s\n", file.c_str());
+            return;
+        }
+        const std::size_t archive_size = std::filesystem::file_size(file);
+
+        if (wanted("archive.flush_to_file"))
+        {
+            results.push_back(measure("archive.flush_to_file", archive_size, opts.min_time,
+                [&] { source.load_members_from(members); },
+                [&] { (void)source.flush_to_file(file.c_str()); }));
+            print_result(results.back());
+        }
+
+        sp::archive loaded;
+        if (wanted("archive.read_from_file"))
+        {
+            results.push_back(measure("archive.read_from_file", archive_size, opts.min_time,
+                [&] { loaded = sp::archive{}; },
+                [&] { (void)loaded.read_from_file(file.c_str()); }));
+            print_result(results.back());
+        }
+
+        if (wanted("archive_enumerator"))
+        {
+            if (!loaded.member_count())
+                (void)loaded.read_from_file(file.c_str());
+
+            std::size_t sink = 0;
+            results.push_back(measure("archive_enumerator", archive_size, opts.min_time, [&] {
+                for (auto e = loaded.enumerate(); e; e.advance())
+                    sink += e.data().size();
+            }));
+            print_result(results.back());
+            if (sink == 0)
+                std::fprintf(stderr, "archive_enumerator found no members\n");
+        }
+
+        std::error_code ec;
+        std::filesystem::remove(file, ec);
+    }
+
+    /**
+     * \brief The kinds of hostile archive that #make_hostile_archive makes.
+     */
+    enum class hostile_kind
+    {
+        tiny_members,      ///< Nothing but empty members.
+        huge_prefix,       ///< A first size header far past the end.
+        unaligned_tail,    ///< Empty members, then a cut-off header.
+        truncated_trailer  ///< Empty members, with the trailer cut short.
+    };
+
+    /**
+     * \brief Makes an encrypted archive of \a size bytes that validation 
+     *        has to walk in its worst way.
+     */
+    sp::byte_buffer make_hostile_archive(
+        hostile_kind     kind, 
+        std::size_t      size, 
+        std::mt19937_64& rng)
+    {
+        constexpr std::size_t trailer = 33;
+
+        // the truncated archive is a valid one of a few more bytes, cut
+        const std::size_t cut   = kind == hostile_kind::truncated_trailer ? 5 : 0;
+        const std::size_t total = std::max(size, trailer + sizeof(std::uint32_t)) + cut;
+
+        std::size_t data_size = total - trailer;
+        if (kind != hostile_kind::unaligned_tail)
+            data_size -= data_size % sizeof(std::uint32_t);
+        else if (data_size % sizeof(std::uint32_t) == 0)
+            --data_size;
+
+        auto buf = kind == hostile_kind::huge_prefix 
+            ? make_random_buffer(data_size + trailer, rng)
+            : sp::byte_buffer {
+                  .buffer = std::make_unique<std::byte[]>(data_size + trailer),
+                  .nbytes = data_size + trailer
+              };
+        if (kind == hostile_kind::huge_prefix)
+            std::memset(buf.data(), 0xFF, sizeof(std::uint32_t));
+
+        const auto digest = sp::compute_md5_digest(buf.range().first(data_size));
+        std::memcpy(buf.data() + data_size, digest.c_str(), trailer);
+        sp::encrypt_buffer(sp::h1_static_tea, buf.range());
+
+        buf.nbytes -= cut;
+        return buf;
+    }
+
+    /**
+     * \brief Times loading hostile archives, checking each result against 
+     *        the reference reading of archive_oracle.hpp.
+     *
+     * \return \c false if a load disagreed with the oracle.
+     */
+    bool run_hostile_benchmarks(
+        const bench_options&       opts,
+        std::size_t                size,
+        std::vector<bench_result>& results,
+        std::mt19937_64&           rng)
+    {
+        constexpr std::pair<hostile_kind, const char*> kinds[] = {
+            {hostile_kind::tiny_members,      "hostile.tiny_members"},
+            {hostile_kind::huge_prefix,       "hostile.huge_prefix"},
+            {hostile_kind::unaligned_tail,    "hostile.unaligned_tail"},
+            {hostile_kind::truncated_trailer, "hostile.truncated_trailer"}
+        };
+
+        bool all_agreed = true;
+        for (const auto& [kind, name] : kinds)
+        {
+            if (std::string_view{name}.find(opts.filter) == std::string_view::npos)
+                continue;
+
+            const auto hostile  = make_hostile_archive(kind, size, rng);
+            const bool accepted = sp::testing::oracle_read(hostile.range()).has_value();
+
+            // Each load decrypts a fresh copy in place, then enumerates the 
+            // members, as archive::read_from_buffer does without its messages.
+            std::vector<std::byte> copy(hostile.nbytes);
+            bool agreed = true;
+            results.push_back(measure(name, hostile.nbytes, opts.min_time, 
+                [&] { std::memcpy(copy.data(), hostile.data(), hostile.nbytes); },
+                [&] {
+                    sp::archive_view view;
+                    bool valid = sp::decrypt_archive_in_place(copy, &view) == sp::core_error::success;
+                    if (valid)
+                    {
+                        auto e = view.enumerate();
+                        while (e)
+                            e.advance();
+                        valid = e.is_at_end();
+                    }
+                    agreed &= valid == accepted;
+                }));
+            print_result(results.back());
+            if (!agreed)
+                std::fprintf(stderr, "%s: read_from_buffer disagrees with the oracle\n", name);
+            all_agreed &= agreed;
+        }
+
+        return all_agreed;
+    }
+
+    bool parse_size(const char* arg, std::size_t& value)
+    {
+        const char* end = arg + std::strlen(arg);
+        const auto [ptr, ec] = std::from_chars(arg, end, value);
+        return ec == std::errc{} && ptr == end;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace std::literals::string_view_literals;
+
+    bench_options opts;
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (argv[i] == "--max-size"sv && has_value)
+        {
+            if (!parse_size(argv[++i], opts.max_size))
+            {
+                std::printf("invalid size %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (argv[i] == "--min-time"sv && has_value)
+        {
+            opts.min_time = std::strtod(argv[++i], nullptr);
+        } else if (argv[i] == "--filter"sv && has_value)
+        {
+            opts.filter = argv[++i];
+        } else if (argv[i] == "--threads"sv && has_value)
+        {
+            if (!parse_size(argv[++i], opts.threads))
+            {
+                std::printf("invalid thread count %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (argv[i] == "--json"sv && has_value)
+        {
+            opts.json = argv[++i];
+        } else if (argv[i] == "--dir"sv && has_value)
+        {
+            opts.dir = argv[++i];
+        } else if (argv[i] == "--budget"sv && has_value)
+        {
+            opts.budget = std::strtod(argv[++i], nullptr);
+        } else
+        {
+            std::printf("invalid use; see the comment at the top of bench/bench.cpp\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (opts.threads == 0)
+        opts.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::printf("simd isa: %s, threads: %zu\n",
+        sp::simd_isa_name(sp::detect_simd_isa()), opts.threads);
+
+    std::mt19937_64 rng{0x4831'5350}; // fixed, so runs are comparable
+    std::vector<bench_result> results;
+    bool correct = true;
+    for (std::size_t size = 1024; size <= opts.max_size; size *= 16)
+    {
+        run_cipher_benchmarks(opts, size, results, rng);
+        run_archive_benchmarks(opts, size, results, rng);
+        correct &= run_hostile_benchmarks(opts, size, results, rng);
+    }
+
+    // validation must stay linear however the archive is laid out
+    for (const auto& r : results)
+    {
+        const double ns_per_byte = r.seconds * 1.0e9 / static_cast<double>(r.size);
+        if (opts.budget > 0.0 && r.name.starts_with("hostile.") && ns_per_byte > opts.budget)
+        {
+            std::printf("%s took %.2f ns/B at %zu B, over the budget of %.2f ns/B\n",
+                r.name.c_str(), ns_per_byte, r.size, opts.budget);
+            correct = false;
+        }
+    }
+
+    if (opts.json != nullptr && !write_json(opts.json, opts, results))
+    {
+        std::printf("could not write %s\n", opts.json);
+        return EXIT_FAILURE;
+    }
+
+    return correct ? EXIT_SUCCESS : EXIT_FAILURE;
+}
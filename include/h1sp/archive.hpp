@@ -5,19 +5,28 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 
+#include <array>
 #include <concepts>
 #include <functional>
 #include <memory>
 #include <optional>
 #include <span>
+#include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
+#include <vector>
+
+#include <h1sp/crypt.hpp>
+#include <h1sp/mapped_file.hpp>
 
 /* HALO 1 SHADER ARCHIVE FILES:
  * These files are encrypted using the Tiny Encryption Algorithm
  * (https://en.wikipedia.org/wiki/Tiny_Encryption_Algorithm)
- * using the key 0x3FFFFFDD, 0x7FC3, 0xE5, 0x3FFFEF.
+ * using the key 0x3FFFFFDD, 0x7FC3, 0xE5, 0x3FFFEF (#h1_cipher); archives of
+ * other formats may use another key, given by their profile (see profile.hpp).
  *
  * When unencrypted, the last 33 octets compose the null-terminated MD5 digest 
  * in lowercase hex form, with 0s for padding. Halo uses the stored hash
@@ -50,6 +59,53 @@ namespace shader_packager
      */
     class archive_enumerator;
     
+    /**
+     * \brief Builds an archive file from members supplied one at a time, 
+     *        holding only a bounded window of the archive in memory.
+     */
+    class archive_writer;
+    
+    /**
+     * \brief Receives the encrypted bytes of an archive being written, in 
+     *        order and a window at a time, e.g. to write them to a pipe.
+     *
+     * \return \c true if the bytes were taken, or \c false to fail the write.
+     */
+    using archive_sink = std::function<bool(std::span<const std::byte> bytes)>;
+    
+    /**
+     * \brief Gets the number of bytes encrypted and passed to a sink at a 
+     *        time when writing an archive window by window.
+     *
+     * \param [in] threads The maximum number of threads used to encrypt 
+     *                     each window, or 0 for one per hardware thread.
+     */
+    std::size_t archive_window_size(std::size_t threads) noexcept;
+    
+    /**
+     * \brief Encrypts the plaintext \a pending of an archive being written 
+     *        front to back in place and passes it to \a sink a window of 
+     *        \a window_size bytes at a time, as #archive_writer does.
+     *
+     * \a pending starts at the first byte of the archive not yet passed on, 
+     * which lies on a chunk boundary, and \a window_size is a whole number of 
+     * chunks. Unless \a last, only as many whole windows as \a pending holds 
+     * are passed on, and \a pending must not reach into the trailer. If 
+     * \a last, \a pending runs to the end of the archive and is passed on 
+     * in full; its final window holds the trailer and the tailing chunk that 
+     * overlaps it.
+     *
+     * \return The number of bytes of \a pending passed on, or 
+     *         `std::nullopt` if \a sink did not take a window.
+     */
+    std::optional<std::size_t> flush_archive_windows(
+        std::span<std::byte>  pending,
+        bool                  last,
+        std::size_t           window_size,
+        std::size_t           threads,
+        const archive_cipher& cipher,
+        const archive_sink&   sink);
+    
     /**
      * \brief Reads the entire contents of a file in binary mode into a buffer.
      *
@@ -58,6 +114,18 @@ namespace shader_packager
      */
     byte_buffer read_file(const char* file);
     
+    /**
+     * \brief Reads the entire contents of a file in binary mode into \a into,
+     *        e.g. a slot in a larger buffer.
+     *
+     * \param [in]  file The name of the file to read.
+     * \param [out] into Receives the file's contents. Its size must be the 
+     *                   size of the file.
+     * \return A buffer borrowing \a into; it tests \c false if the file could 
+     *         not be read, is not the size of \a into or is empty.
+     */
+    byte_buffer read_file(const char* file, std::span<std::byte> into);
+    
     /**
      * \brief Writes a buffer of bytes to a file in binary mode.
      *
@@ -73,6 +141,20 @@ namespace shader_packager
     {
         std::unique_ptr<std::byte[]> buffer; ///< The buffer for the bytes.
         std::size_t                  nbytes; ///< Number of bytes in buffer.
+        std::byte*  borrowed = nullptr; ///< Or the bytes, if #buffer does not
+                                        ///< own them, e.g. an arena slot.
+        
+        /**
+         * \brief Creates a buffer referring to \a bytes without owning them.
+         *
+         * \a bytes must outlive the buffer.
+         */
+        static byte_buffer borrow(std::span<std::byte> bytes) noexcept;
+        
+        /**
+         * \brief Returns a pointer to the data, owned or borrowed.
+         */
+        std::byte* data() const noexcept;
         
         /**
          * \brief Returns the data, as a `std::span`.
@@ -92,8 +174,13 @@ namespace shader_packager
         using chunk_size_type = std::uint32_t;
         
         byte_buffer          filebuf; ///< Takes ownership of the data buffer.
+        mapped_file          mapping; ///< Or of the mapping of the file.
         std::span<std::byte> data;    ///< The subrange of the buffer that 
                                       ///< contains the chunk data.
+        std::vector<std::size_t> offsets; ///< Offset in #data of each 
+                                          ///< member's size header.
+        std::span<const char* const> names; ///< Member names, in order.
+        archive_cipher       cipher = h1_cipher; ///< Decrypts/encrypts #data.
     
     public:
         /**
@@ -122,11 +209,95 @@ namespace shader_packager
          * If this function returns a value that is not \c read_error::success,
          * the state of this object is unchanged.
          *
-         * \param [in] The filepath of the archive to load.
+         * \param [in] file    The filepath of the archive to load.
+         * \param [in] threads The maximum number of threads used to decrypt
+         *                     the archive, or 0 for one per hardware thread.
+         * \return `read_error::success` on success, 
+         *         or an appropriate value from \c read_error on failure.
+         */
+        read_error read_from_file(const char* file, std::size_t threads = 1);
+        
+        /**
+         * \brief Loads an archive from \a file by mapping it copy-on-write 
+         *        and decrypting it in place, without copying it to the heap.
+         *
+         * The member spans refer directly into the mapping, which lives as 
+         * long as this object holds the archive.
+         *
+         * If this function returns a value that is not \c read_error::success,
+         * the state of this object is unchanged.
+         *
+         * \param [in] file    The filepath of the archive to load.
+         * \param [in] threads The maximum number of threads used to decrypt
+         *                     the archive, or 0 for one per hardware thread.
          * \return `read_error::success` on success, 
          *         or an appropriate value from \c read_error on failure.
          */
-        read_error read_from_file(const char* file);
+        read_error open_mapped(const char* file, std::size_t threads = 1);
+        
+        /**
+         * \brief Loads an archive from the encrypted bytes in \a buf by 
+         *        decrypting them in place.
+         *
+         * The archive takes ownership of an owning \a buf; the bytes of a 
+         * borrowed one must outlive this object's hold on the archive.
+         *
+         * If this function returns a value that is not \c read_error::success,
+         * the state of this object is unchanged, but \a buf is left 
+         * decrypted.
+         *
+         * \param [in] buf     The encrypted archive.
+         * \param [in] threads The maximum number of threads used to decrypt
+         *                     the archive, or 0 for one per hardware thread.
+         * \return `read_error::success` on success, 
+         *         or an appropriate value from \c read_error on failure.
+         */
+        read_error read_from_buffer(byte_buffer buf, std::size_t threads = 1);
+        
+        /**
+         * \brief Selects how much of an archive #verify_file checks.
+         */
+        enum class verify_mode
+        {
+            full,       ///< Decrypt, hash and validate the whole archive.
+            digest_only ///< Only read the stored digest from the trailer.
+        };
+        
+        /**
+         * \brief Describes an archive checked by #verify_file.
+         */
+        struct verify_result
+        {
+            std::uint64_t        size         = 0;  ///< The archive size.
+            std::size_t          member_count = 0;  ///< Valid members before 
+                                                    ///< any bad header.
+            std::optional<std::uint64_t> bad_header; ///< Offset of the first 
+                                                     ///< bad member header.
+            std::array<char, 33> digest       = {}; ///< The stored digest.
+            std::array<char, 33> computed     = {}; ///< The digest of the 
+                                                    ///< data, if hashed.
+        };
+        
+        /**
+         * \brief Checks the archive in \a file without loading its members.
+         *
+         * The file is streamed through decryption, hashing and header 
+         * validation a window at a time, so memory use does not depend on 
+         * its size. With `verify_mode::digest_only`, only the final chunks 
+         * that hold the trailer are read and decrypted.
+         *
+         * \param [in]  file   The filepath of the archive to check.
+         * \param [out] result If not null, receives what was found.
+         * \param [in]  mode   How much of the archive to check.
+         * \param [in]  cipher The cipher the archive is encrypted with.
+         * \return `read_error::success` if the archive is intact, 
+         *         or an appropriate value from \c read_error otherwise.
+         */
+        static read_error verify_file(
+            const char*           file, 
+            verify_result*        result = nullptr,
+            verify_mode           mode   = verify_mode::full,
+            const archive_cipher& cipher = h1_cipher);
         
         /**
          * \brief Loads an archive from members supplied by individual buffers.
@@ -139,11 +310,28 @@ namespace shader_packager
          * If this function returns `write_error::success`, then the archive 
          * is emptied.
          *
-         * \param [in] file The filepath of the archive to write.
+         * \param [in] file    The filepath of the archive to write.
+         * \param [in] threads The maximum number of threads used to encrypt
+         *                     the archive, or 0 for one per hardware thread.
+         * \return `write_error::success` on success, 
+         *         or an appropriate value from \c write_error on failure.
+         */
+        write_error flush_to_file(const char* file, std::size_t threads = 1);
+        
+        /**
+         * \brief Writes an archive to \a sink, a window at a time.
+         *
+         * If this function returns `write_error::success`, then the archive 
+         * is emptied. A sink that fails is reported as 
+         * `write_error::could_not_open_file`.
+         *
+         * \param [in] sink    Receives the encrypted archive.
+         * \param [in] threads The maximum number of threads used to encrypt
+         *                     the archive, or 0 for one per hardware thread.
          * \return `write_error::success` on success, 
          *         or an appropriate value from \c write_error on failure.
          */
-        write_error flush_to_file(const char* file);
+        write_error flush_to(const archive_sink& sink, std::size_t threads = 1);
         
         /**
          * \brief Creates an object that can be used to enumerate over the 
@@ -151,6 +339,57 @@ namespace shader_packager
          */
         archive_enumerator enumerate() const noexcept;
         
+        /**
+         * \brief Gets the MD5 digest stored in the archive's trailer.
+         *
+         * \return The 32 hex digits of the digest, or an empty string if the
+         *         archive was not loaded by #read_from_file or #open_mapped.
+         */
+        std::string_view digest() const noexcept;
+        
+        /**
+         * \brief Gets the number of members in the archive.
+         */
+        std::size_t member_count() const noexcept { return offsets.size(); }
+        
+        /**
+         * \brief Gets the data of the member at \a index in constant time.
+         *
+         * \return The byte range of the member's data, or `std::nullopt` if 
+         *         `index >= member_count()`.
+         */
+        std::optional<std::span<std::byte>> member(std::size_t index) const 
+            noexcept;
+        
+        /**
+         * \brief Sets the names of the archive members, in order, for use by 
+         *        `member(std::string_view)`.
+         *
+         * \a member_names must outlive any lookups by name.
+         */
+        void set_names(std::span<const char* const> member_names) noexcept
+            { names = member_names; }
+        
+        /**
+         * \brief Sets the cipher that the archive is decrypted with when it 
+         *        is loaded and encrypted with when it is written, 
+         *        #h1_cipher by default.
+         */
+        void set_cipher(const archive_cipher& archive_cipher) noexcept
+            { cipher = archive_cipher; }
+        
+        /**
+         * \brief Gets the data of the member called \a name, per the names 
+         *        given to #set_names.
+         *
+         * The lookup takes constant time for the name lists in names.hpp.
+         *
+         * \return The byte range of the member's data, or `std::nullopt` if 
+         *         there is no such member.
+         */
+        std::optional<std::span<std::byte>> member(std::string_view name) const
+            noexcept;
+        
         /**
          * \brief Invokes \a f on the byte ranges of this archive's members.
          *
@@ -175,13 +414,36 @@ namespace shader_packager
         template<std::invocable<std::span<std::byte>> F>
         std::optional<std::invoke_result_t<F&&, std::span<std::byte>>> 
         for_each(F&& f);
+    
+    private:
+        /**
+         * \brief Decrypts the archive file contents \a buf in place and 
+         *        validates them, pointing #data into \a buf on success.
+         *
+         * The caller takes ownership of \a buf on success.
+         */
+        read_error decrypt_and_validate(
+            std::span<std::byte> buf, 
+            std::size_t          threads);
+        
+        /**
+         * \brief Rebuilds #offsets by walking the member headers of #data.
+         */
+        void index_members();
     };
     
     class archive_enumerator
     {
         using chunk_size_type = std::uint32_t;
         
-        std::span<std::byte> range; ///< The span of enumerable bytes.
+        std::span<std::byte> range; ///< The enumerable bytes, starting 
+                                    ///< with the current chunk's header.
+        std::span<std::byte> chunk; ///< The current chunk's data.
+        bool                 error = false; ///< See #has_error.
+        
+        // Decodes the header at the start of range, once per chunk.
+        void read_header() noexcept;
+    
     public:
         archive_enumerator() = default;
         archive_enumerator(std::span<std::byte> enumerable_range) noexcept;
@@ -249,6 +511,97 @@ namespace shader_packager
         explicit operator bool() const noexcept { return !finished(); }
     };
     
+    class archive_writer
+    {
+        using chunk_size_type = std::uint32_t;
+        
+        const char*  file = nullptr; ///< The filepath of the archive, if any.
+        std::FILE*   fp = nullptr;  ///< Opened on the first flushed window.
+        archive_sink sink;          ///< Receives each encrypted window.
+        byte_buffer  window;        ///< Plaintext awaiting encryption.
+        std::size_t  window_size;   ///< Bytes encrypted and written at a time.
+        std::size_t  fill = 0;      ///< Bytes of \c window in use.
+        std::size_t  threads;       ///< Threads used to encrypt a window.
+        archive_cipher cipher;      ///< Encrypts each window.
+        std::size_t  total = 0;     ///< Archive bytes supplied so far.
+        md5_context  md5;           ///< Digest of the archive bytes so far.
+        std::string  trailer;       ///< The stored digest, once finished.
+        bool         failed = false;
+        
+        bool append(std::span<const std::byte> bytes);
+        bool flush_window(bool last);
+    
+    public:
+        /**
+         * \param [in] file    The filepath of the archive to write. The file 
+         *                     is not opened before the first window is full.
+         * \param [in] threads The maximum number of threads used to encrypt
+         *                     each window, or 0 for one per hardware thread.
+         * \param [in] cipher  The cipher the archive is encrypted with.
+         */
+        explicit archive_writer(
+            const char*           file, 
+            std::size_t           threads = 1,
+            const archive_cipher& cipher  = h1_cipher);
+        
+        /**
+         * \param [in] sink    Receives the encrypted archive a window at a 
+         *                     time. Windows are a whole number of chunks 
+         *                     except the last, which holds the trailer and 
+         *                     the tailing chunk that overlaps it, and so is 
+         *                     only passed on by #finish.
+         * \param [in] threads The maximum number of threads used to encrypt
+         *                     each window, or 0 for one per hardware thread.
+         * \param [in] cipher  The cipher the archive is encrypted with.
+         */
+        explicit archive_writer(
+            archive_sink          sink, 
+            std::size_t           threads = 1,
+            const archive_cipher& cipher  = h1_cipher);
+        archive_writer(const archive_writer&) = delete;
+        archive_writer& operator=(const archive_writer&) = delete;
+        ~archive_writer();
+        
+        /**
+         * \brief Appends \a member, preceded by its size header, to the 
+         *        archive.
+         *
+         * Full windows are hashed, encrypted and written as they fill up; 
+         * \a member is not referenced after this function returns.
+         *
+         * \return \c true on success, or \c false if the member is too large
+         *         for its header or the output could not be written.
+         */
+        bool add_member(std::span<const std::byte> member);
+        
+        /**
+         * \brief Appends \a members, a run of members already laid out with 
+         *        their size headers, e.g. taken from a decrypted archive.
+         *
+         * \return \c true on success, or \c false if the output could not be
+         *         written.
+         */
+        bool add_serialized(std::span<const std::byte> members);
+        
+        /**
+         * \brief Appends the MD5 trailer, then encrypts and writes the final 
+         *        window, including the tailing chunk.
+         *
+         * \return `archive::write_error::success` on success, 
+         *         or an appropriate value from `archive::write_error`.
+         */
+        archive::write_error finish();
+        
+        /**
+         * \brief Gets the MD5 digest stored in the archive.
+         *
+         * \return The 32 hex digits of the digest, or an empty string if 
+         *         #finish has not succeeded.
+         */
+        std::string_view digest() const noexcept
+            { return std::string_view{trailer}.substr(0, trailer.empty() ? 0 : 32); }
+    };
+    
     template<std::invocable<std::span<std::byte>> F>
         requires (std::is_invocable_r_v<void, F&&,  std::span<std::byte>>)
     inline void archive::for_each(F&& f) const
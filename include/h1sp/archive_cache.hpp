@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_ARCHIVE_CACHE_HPP
+#define H1SP_ARCHIVE_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+
+#include <h1sp/archive.hpp>
+
+namespace shader_packager
+{
+    /**
+     * \brief Identifies the contents of a file by its device, inode, size 
+     *        and modification time, so that a file replaced or edited in 
+     *        place is told apart from the one loaded before.
+     */
+    struct file_identity
+    {
+        std::uint64_t device = 0;
+        std::uint64_t inode  = 0;
+        std::uint64_t size   = 0;
+        std::int64_t  mtime  = 0; ///< In nanoseconds where available.
+
+        friend bool operator==(const file_identity&, const file_identity&) = default;
+    };
+
+    /**
+     * \brief An archive decrypted and indexed by #archive_cache.
+     *
+     * On Linux the decrypted archive is kept in anonymous shared memory, 
+     * which other processes can map read-only through #descriptor.
+     */
+    class cached_archive
+    {
+        friend class archive_cache;
+
+        archive              loaded;
+        file_identity        identity;
+        std::span<std::byte> shared_image;   ///< The shared memory, if any.
+        int                  shared_fd = -1; ///< Sealed, or -1.
+
+    public:
+        cached_archive() = default;
+        cached_archive(const cached_archive&) = delete;
+        cached_archive& operator=(const cached_archive&) = delete;
+        ~cached_archive();
+
+        /**
+         * \brief Gets the archive, with the names given to the cache.
+         */
+        const archive& contents() const noexcept { return loaded; }
+
+        /**
+         * \brief Gets a descriptor for the shared memory holding the 
+         *        decrypted archive, or -1 if it is not held that way.
+         *
+         * The memory is sealed, so it can only be mapped read-only and never
+         * changes size. The descriptor is owned by this object.
+         */
+        int descriptor() const noexcept { return shared_fd; }
+
+        /**
+         * \brief Gets the offset of \a member, one of the member ranges of 
+         *        #contents, within the memory behind #descriptor.
+         */
+        std::uint64_t offset_of(std::span<const std::byte> member) const noexcept
+            { return static_cast<std::uint64_t>(member.data() - shared_image.data()); }
+    };
+
+    /**
+     * \brief Keeps the most recently used archives loaded, reloading an 
+     *        archive once its file changes.
+     *
+     * All member functions may be called concurrently.
+     */
+    class archive_cache
+    {
+        struct slot
+        {
+            std::string                           file;
+            std::span<const char* const>          names;
+            std::shared_ptr<const cached_archive> loaded;
+        };
+
+        std::mutex      mutex;
+        std::list<slot> slots; ///< Most recently used first.
+        std::size_t     capacity;
+        std::size_t     threads;
+
+    public:
+        /**
+         * \param [in] capacity The number of archives kept loaded.
+         * \param [in] threads  The maximum number of threads used to decrypt
+         *                      an archive, or 0 for one per hardware thread.
+         */
+        explicit archive_cache(std::size_t capacity, std::size_t threads = 1);
+        archive_cache(const archive_cache&) = delete;
+        archive_cache& operator=(const archive_cache&) = delete;
+
+        /**
+         * \brief Gets the archive in \a file, loading it if it is not 
+         *        loaded or has changed since.
+         *
+         * Archives handed out stay valid after they are evicted or reloaded,
+         * for as long as they are referred to.
+         *
+         * \param [in]  file  The filepath of the archive.
+         * \param [in]  names The names of its members, which must outlive 
+         *                    the cache. An archive loaded with other names 
+         *                    is reloaded.
+         * \param [out] error If not null, receives the reason a load failed.
+         * \return The archive, or null if it could not be loaded.
+         */
+        std::shared_ptr<const cached_archive> get(
+            const std::string&           file,
+            std::span<const char* const> names,
+            archive::read_error*         error = nullptr);
+    };
+
+    /**
+     * \brief Gets the #file_identity of \a file.
+     *
+     * \return \c true on success, otherwise \c false.
+     */
+    bool identify_file(const char* file, file_identity& identity);
+}
+
+#endif // H1SP_ARCHIVE_CACHE_HPP
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_BATCH_IO_HPP
+#define H1SP_BATCH_IO_HPP
+
+#include <cstddef>
+
+#include <span>
+
+namespace shader_packager
+{
+    /**
+     * \brief A file to write with #write_files.
+     */
+    struct file_write
+    {
+        const char*                path; ///< The file to create or truncate.
+        std::span<const std::byte> data; ///< Its new contents.
+    };
+
+    /**
+     * \brief Identifies how #write_files submits its writes.
+     */
+    enum class batch_io_backend
+    {
+        stdio,     ///< One buffered stdio write per file, on a thread pool.
+        io_uring,  ///< One io_uring submission for every write (Linux).
+        overlapped ///< Concurrent overlapped writes (Windows).
+    };
+
+    struct batch_write_options
+    {
+        /// Bypass the page cache for the parts of each file whose data is 
+        /// suitably aligned in memory, where the filesystem allows it.
+        bool        direct = false;
+        /// Concurrent writes for the stdio backend, or 0 for one per 
+        /// hardware thread.
+        std::size_t jobs   = 8;
+    };
+
+    /**
+     * \brief Gets the backend #write_files uses on this platform.
+     *
+     * The io_uring backend falls back to stdio at run time if the kernel 
+     * does not provide io_uring.
+     */
+    batch_io_backend preferred_batch_io_backend() noexcept;
+
+    /**
+     * \brief Writes every file in \a writes, submitting the writes together
+     *        straight from their data, without copying it into stdio 
+     *        buffers.
+     *
+     * Every write is attempted even if some fail.
+     *
+     * \param [in] writes  The files to write.
+     * \param [in] options How to write them.
+     * \return The index of the first write in \a writes that failed, or 
+     *         `writes.size()` if all succeeded.
+     */
+    std::size_t write_files(
+        std::span<const file_write> writes, 
+        const batch_write_options&  options = {});
+}
+
+#endif // H1SP_BATCH_IO_HPP
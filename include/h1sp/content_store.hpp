@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_CONTENT_STORE_HPP
+#define H1SP_CONTENT_STORE_HPP
+
+#include <cstddef>
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <h1sp/manifest.hpp>
+
+/* CONTENT STORES:
+ * A content store is a directory holding each distinct member once, as the
+ * object file DIR/xx/yyyy... where xxyyyy... is the MD5 digest of its data.
+ * Unpacking into a store links each member file to its object and writes a
+ * content index next to the member files,
+ *
+ *   h1sp-cas-index 1
+ *   SIZE MTIME HASH NAME      (one line per member file)
+ *
+ * which records the stamp each member file had when it was linked, so that 
+ * a later pack can read the members whose files are unchanged from the 
+ * store by their HASH. Members shared by many archives are then read once 
+ * per batch, however many member files refer to them.
+ *
+ * Member files are reflinks where the filesystem supports them, and hard 
+ * links otherwise. Objects are read-only, and so are the member files 
+ * hard-linked to them, so that a member file is not edited in place along 
+ * with every other member file linked to the same object; tools that 
+ * replace the file instead are unaffected. An object that was edited all 
+ * the same no longer matches its digest, and is replaced by the next put 
+ * of its data.
+ */
+
+namespace shader_packager
+{
+    /**
+     * \brief A directory of member data addressed by MD5 digest.
+     */
+    class content_store
+    {
+        std::filesystem::path root;
+
+    public:
+        /**
+         * \brief Indicates how a member file refers to its object.
+         */
+        enum class link_kind
+        {
+            reflink,  ///< A copy-on-write clone of the object.
+            hardlink, ///< Another name for the object.
+            copy      ///< A plain copy, where neither link is possible.
+        };
+
+        /**
+         * \brief Uses the store in directory \a root, which is created on 
+         *        first use.
+         */
+        explicit content_store(std::filesystem::path root);
+
+        /**
+         * \brief Gets the path of the object with the given digest.
+         */
+        std::filesystem::path object_path(std::string_view digest) const;
+
+        /**
+         * \brief Adds \a data, whose MD5 digest is \a digest, to the store 
+         *        unless it is already there.
+         *
+         * An object already there is checked against \a digest and its size,
+         * and rewritten if it does not match. Objects are made read-only and
+         * renamed into place once written, so concurrent puts of the same 
+         * data are safe.
+         *
+         * \return \c true on success, otherwise \c false.
+         */
+        bool put(std::string_view digest, std::span<const std::byte> data) const;
+
+        /**
+         * \brief Replaces \a target with a link to the object with the given
+         *        digest.
+         *
+         * \return How \a target refers to the object, or `std::nullopt` on 
+         *         failure.
+         */
+        std::optional<link_kind> link(
+            std::string_view             digest, 
+            const std::filesystem::path& target) const;
+    };
+
+    /**
+     * \brief Replaces \a target with a link to \a source, a reflink where 
+     *        the filesystem supports them, a hard link otherwise, and a copy 
+     *        where neither is possible.
+     *
+     * \return How \a target refers to \a source, or `std::nullopt` on 
+     *         failure.
+     */
+    std::optional<content_store::link_kind> link_file(
+        const std::filesystem::path& source, 
+        const std::filesystem::path& target);
+
+    /**
+     * \brief Records the object each member file was linked to.
+     */
+    struct content_index
+    {
+        struct entry
+        {
+            std::string name;  ///< The member file's name, without prefix.
+            file_stamp  stamp; ///< The member file's stamp when linked.
+            std::string hash;  ///< The digest of the object linked to.
+        };
+
+        std::vector<entry> entries; ///< The member files, in no set order.
+
+        /**
+         * \brief Gets the entry for the member file \a name.
+         *
+         * \return The entry, or \c nullptr if there is none.
+         */
+        const entry* find(std::string_view name) const noexcept;
+
+        /**
+         * \brief Adds \a e, replacing any entry with the same name.
+         */
+        void assign(entry e);
+
+        /**
+         * \brief Loads an index from \a file.
+         *
+         * \return The index, or `std::nullopt` if \a file could not be read
+         *         or is not a valid index.
+         */
+        static std::optional<content_index> read_from_file(const char* file);
+
+        /**
+         * \brief Writes this index to \a file, replacing it.
+         *
+         * \return \c true on success, otherwise \c false.
+         */
+        bool write_to_file(const char* file) const;
+    };
+}
+
+#endif // H1SP_CONTENT_STORE_HPP
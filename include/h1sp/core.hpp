@@ -0,0 +1,297 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_CORE_HPP
+#define H1SP_CORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <concepts>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+#include <h1sp/archive.hpp>
+
+/* CORE API:
+ * These functions operate only on caller-provided buffers. They do not
+ * allocate, throw or print; errors are reported through #core_error only.
+ * They are meant for hosting the packager in a long-running process, where
+ * archives arrive and leave as memory rather than as files.
+ *
+ * The exception is the digest context of the OpenSSL MD5 backend, which 
+ * OpenSSL allocates (a failure to do so terminates); build with 
+ * H1SP_BUILTIN_MD5 for a core that does not allocate at all.
+ */
+
+namespace shader_packager
+{
+    /**
+     * \brief Indicates the result of a core API operation.
+     */
+    enum class core_error
+    {
+        success,
+        archive_too_small, ///< The archive is shorter than its minimum size.
+        digest_mismatch,   ///< The stored digest does not match the data.
+        corrupt_member,    ///< A member header runs past the archive data.
+        no_members,        ///< There are no members to pack.
+        member_too_large,  ///< A member is too large for its size header.
+        buffer_too_small   ///< The output is smaller than #required_size.
+    };
+
+    /**
+     * \brief Validates the member headers of archive data supplied in 
+     *        pieces, in order, by the same rules as #archive_enumerator.
+     *
+     * The size of the data need not be known up front; it is the total 
+     * supplied when #finish is called.
+     */
+    class member_header_scanner
+    {
+        std::uint64_t fed         = 0; ///< Bytes of data supplied so far.
+        std::uint64_t next_header = 0; ///< Offset of the next header.
+        std::uint64_t last_header = 0; ///< Offset of the last header read.
+        std::size_t   members     = 0; ///< Headers read so far.
+        std::size_t   header_fill = 0; ///< Bytes of #header collected.
+        std::array<std::byte, 4> header = {}; ///< The next header, so far.
+
+    public:
+        /**
+         * \brief Reads the headers that lie within \a data, which directly
+         *        follows the data supplied before.
+         */
+        void feed(std::span<const std::byte> data) noexcept;
+
+        /**
+         * \brief Checks that the headers exactly cover the data supplied.
+         *
+         * \param [out] member_count If not null, receives the number of 
+         *                           valid members before any bad header.
+         * \param [out] bad_header   If not null and the data is invalid, 
+         *                           receives the offset of the first bad 
+         *                           header.
+         * \return \c true if the headers are valid, otherwise \c false.
+         */
+        bool finish(
+            std::size_t*   member_count = nullptr,
+            std::uint64_t* bad_header   = nullptr) const noexcept;
+    };
+
+    /**
+     * \brief Describes an archive decoded by #archive_decoder.
+     */
+    struct archive_summary
+    {
+        std::uint64_t        size         = 0;  ///< The archive size.
+        std::array<char, 33> digest       = {}; ///< The stored digest.
+        std::array<char, 33> computed     = {}; ///< The digest of the data.
+        std::size_t          member_count = 0;  ///< Number of valid members
+                                                ///< before any bad header.
+        std::uint64_t        bad_header   = 0;  ///< Offset of the first bad 
+                                                ///< header, if any.
+    };
+
+    /**
+     * \brief Decrypts and validates an archive supplied as encrypted pieces 
+     *        of any size, in constant memory and without knowing its size.
+     *
+     * The last chunk of an archive whose size is not a multiple of 8 
+     * overlaps the one before it, and the trailer is only known once the 
+     * archive ends, so up to 15 encrypted and 33 decrypted bytes are held 
+     * back until #finish. The member data is passed on as it is decrypted.
+     */
+    class archive_decoder
+    {
+        static constexpr std::size_t window_size     = 64 * 1024;
+        static constexpr std::size_t trailer_size    = 33;
+        static constexpr std::size_t cipher_holdback = 15;
+
+        using data_sink = void (*)(void* context, std::span<const std::byte> data);
+
+        std::array<std::byte, window_size + trailer_size + cipher_holdback + 1> buffer;
+        std::size_t           plain = 0; ///< Decrypted bytes at the front.
+        std::size_t           fill  = 0; ///< Bytes of #buffer in use.
+        std::uint64_t         total = 0; ///< Encrypted bytes supplied.
+        md5_context           md5;
+        member_header_scanner scanner;
+        archive_cipher        cipher;
+
+        void consume(std::span<const std::byte> encrypted, data_sink sink, void* context);
+        void drain(bool final, data_sink sink, void* context);
+        core_error conclude(archive_summary* summary) noexcept;
+
+        template<typename F>
+        static void invoke_sink(void* context, std::span<const std::byte> data)
+        {
+            (*static_cast<std::remove_reference_t<F>*>(context))(data);
+        }
+
+        // invoke_sink restores the constness
+        template<typename F>
+        static void* erase(F& f) noexcept
+            { return const_cast<void*>(static_cast<const void*>(std::addressof(f))); }
+
+    public:
+        /**
+         * \param [in] cipher The cipher the archive is encrypted with.
+         */
+        explicit archive_decoder(const archive_cipher& cipher = h1_cipher) noexcept
+            : cipher{cipher} {}
+        archive_decoder(const archive_decoder&) = delete;
+        archive_decoder& operator=(const archive_decoder&) = delete;
+
+        /**
+         * \brief Supplies the next encrypted bytes of the archive.
+         */
+        void update(std::span<const std::byte> encrypted)
+            { consume(encrypted, nullptr, nullptr); }
+
+        /**
+         * \brief Supplies the next encrypted bytes of the archive, passing 
+         *        each run of member data (headers included) decrypted as a 
+         *        result to \a on_data, in order.
+         */
+        template<std::invocable<std::span<const std::byte>> F>
+        void update(std::span<const std::byte> encrypted, F&& on_data)
+            { consume(encrypted, &invoke_sink<F>, erase(on_data)); }
+
+        /**
+         * \brief Ends the archive and validates it.
+         *
+         * \param [out] summary If not null, receives the archive details.
+         * \return `core_error::success` if the archive is intact, 
+         *         or an appropriate value from \c core_error.
+         */
+        core_error finish(archive_summary* summary = nullptr)
+        {
+            drain(true, nullptr, nullptr);
+            return conclude(summary);
+        }
+
+        /**
+         * \brief #finish, passing the remaining member data to \a on_data.
+         */
+        template<std::invocable<std::span<const std::byte>> F>
+        core_error finish(archive_summary* summary, F&& on_data)
+        {
+            drain(true, &invoke_sink<F>, erase(on_data));
+            return conclude(summary);
+        }
+    };
+
+    /**
+     * \brief Describes an archive decrypted by #decrypt_archive_in_place.
+     */
+    struct archive_view
+    {
+        std::span<std::byte> data;          ///< The member data, i.e. the
+                                            ///< archive without its trailer.
+        std::string_view     digest;        ///< The stored digest's 32 digits.
+        std::array<char, 33> computed = {}; ///< The digest of #data,
+                                            ///< null-terminated.
+        std::size_t          member_count = 0; ///< Number of valid members
+                                               ///< before any corrupt one.
+
+        /**
+         * \brief Creates an object that can be used to enumerate over the
+         *        members in #data.
+         */
+        archive_enumerator enumerate() const noexcept
+            { return archive_enumerator{data}; }
+    };
+
+    /**
+     * \brief Decrypts the archive in \a buf in place and validates its digest
+     *        and member headers.
+     *
+     * On error, \a buf is left decrypted and \a view is still filled as far
+     * as it could be, e.g. with both digests on a `digest_mismatch`.
+     *
+     * \param [in,out] buf     The encrypted archive.
+     * \param [out]    view    If not null, receives the decrypted archive.
+     * \param [in]     threads The maximum number of threads used to decrypt
+     *                         \a buf, or 0 for one per hardware thread. Any
+     *                         value other than 1 starts threads, which
+     *                         allocates.
+     * \param [in]     cipher  The cipher the archive is encrypted with.
+     * \return `core_error::success` on success,
+     *         or an appropriate value from \c core_error on failure.
+     */
+    core_error decrypt_archive_in_place(
+        std::span<std::byte>  buf,
+        archive_view*         view    = nullptr,
+        std::size_t           threads = 1,
+        const archive_cipher& cipher  = h1_cipher) noexcept;
+
+    /**
+     * \brief Decrypts and validates several archives in place, like 
+     *        #decrypt_archive_in_place does for each, hashing up to 
+     *        #md5_lane_count of them at once.
+     *
+     * \param [in,out] bufs    The encrypted archives.
+     * \param [out]    results Receives the result for each archive in 
+     *                         \a bufs. Must have at least as many elements.
+     * \param [in]     cipher  The cipher the archives are encrypted with.
+     */
+    void decrypt_archives_in_place(
+        std::span<const std::span<std::byte>> bufs,
+        std::span<core_error>                 results,
+        const archive_cipher&                 cipher = h1_cipher) noexcept;
+
+    /**
+     * \brief Gets the size of the archive that #pack_into produces from
+     *        \a members.
+     */
+    std::size_t required_size(
+        std::span<const std::span<const std::byte>> members) noexcept;
+
+    /**
+     * \brief Packs \a members into an encrypted archive at the start of
+     *        \a out.
+     *
+     * \param [out] out     The buffer receiving the archive. It must be at
+     *                      least `required_size(members)` bytes, and must not
+     *                      overlap \a members.
+     * \param [in]  members The member data, in order.
+     * \param [out] written If not null, receives the size of the archive.
+     * \param [in]  cipher  The cipher to encrypt the archive with.
+     * \return `core_error::success` on success,
+     *         or an appropriate value from \c core_error on failure.
+     */
+    core_error pack_into(
+        std::span<std::byte>                        out,
+        std::span<const std::span<const std::byte>> members,
+        std::size_t*                                written = nullptr,
+        const archive_cipher&                       cipher  = h1_cipher) noexcept;
+
+    /**
+     * \brief #required_size for members given as separate arguments.
+     */
+    template<typename... Members>
+        requires (std::convertible_to<const Members&, std::span<const std::byte>> && ...)
+    std::size_t required_size(const Members&... members) noexcept
+    {
+        const std::array<std::span<const std::byte>, sizeof...(Members)> spans {
+            std::span<const std::byte>(members)...
+        };
+        return required_size(std::span<const std::span<const std::byte>>{spans});
+    }
+
+    /**
+     * \brief #pack_into for members given as separate arguments.
+     */
+    template<typename... Members>
+        requires (std::convertible_to<const Members&, std::span<const std::byte>> && ...)
+    core_error pack_into(std::span<std::byte> out, const Members&... members) noexcept
+    {
+        const std::array<std::span<const std::byte>, sizeof...(Members)> spans {
+            std::span<const std::byte>(members)...
+        };
+        return pack_into(out, std::span<const std::span<const std::byte>>{spans});
+    }
+}
+
+#endif // H1SP_CORE_HPP
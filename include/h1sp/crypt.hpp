@@ -6,10 +6,19 @@
 #include <cstddef>
 #include <cstdint>
 
+#include <algorithm>
+#include <array>
 #include <bit>
 #include <concepts>
+#include <iterator>
 #include <span>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <h1sp/io.hpp>
+#include <h1sp/stats.hpp>
 
 namespace shader_packager
 {
@@ -35,6 +44,28 @@ namespace shader_packager
         { scheme.decrypt_chunk(chunk) } noexcept;
     };
     
+    /**
+     * \brief A constraint for encryption schemes that can also encrypt a 
+     *        contiguous run of whole chunks in a single call.
+     */
+    template<typename Scheme>
+    concept InPlaceBatchEncryptionScheme = InPlaceEncryptionScheme<Scheme> &&
+    requires (const Scheme& scheme, std::byte* chunks, std::size_t count)
+    {
+        { scheme.encrypt_chunks(chunks, count) } noexcept;
+    };
+    
+    /**
+     * \brief A constraint for decryption schemes that can also decrypt a 
+     *        contiguous run of whole chunks in a single call.
+     */
+    template<typename Scheme>
+    concept InPlaceBatchDecryptionScheme = InPlaceDecryptionScheme<Scheme> &&
+    requires (const Scheme& scheme, std::byte* chunks, std::size_t count)
+    {
+        { scheme.decrypt_chunks(chunks, count) } noexcept;
+    };
+    
     /**
      * \brief Implements the Tiny Encryption Algorithm, processing chunks in 
      *        little-endian order.
@@ -64,6 +95,202 @@ namespace shader_packager
         .key = {0x3FFFFFDD, 0x7FC3, 0xE5, 0x3FFFEF}
     };
     
+    /**
+     * \brief Instruction sets that the vectorized cipher kernels can use.
+     */
+    enum class simd_isa
+    {
+        automatic, ///< Use the widest instruction set the CPU supports.
+        scalar,
+        sse2,      ///<  4 chunks per iteration.
+        avx2,      ///<  8 chunks per iteration.
+        avx512,    ///< 16 chunks per iteration.
+        neon       ///<  4 chunks per iteration.
+    };
+    
+    /**
+     * \brief Detects the widest instruction set usable by #simd_tea on the 
+     *        running CPU.
+     *
+     * \return A value from \c simd_isa other than \c simd_isa::automatic.
+     */
+    simd_isa detect_simd_isa() noexcept;
+    
+    /**
+     * \brief Checks whether the kernels for \a isa can run on this CPU.
+     */
+    bool is_simd_isa_supported(simd_isa isa) noexcept;
+    
+    /**
+     * \brief Gets a printable name for \a isa.
+     */
+    const char* simd_isa_name(simd_isa isa) noexcept;
+    
+    /**
+     * \brief Implements the Tiny Encryption Algorithm like #tea, but pushes 
+     *        runs of whole chunks through SIMD registers several at a time.
+     *
+     * Since every chunk is processed independently, the output is identical 
+     * to #tea for the same key and endianness. Single chunks (e.g. the tail 
+     * chunk of a buffer) go through the scalar #tea implementation.
+     *
+     * The vector kernels are only used when \c scalar.endian is the native 
+     * byte order; otherwise every chunk takes the scalar path.
+     */
+    struct simd_tea
+    {
+        static constexpr std::size_t chunk_size = tea::chunk_size;
+        
+        tea      scalar;                     ///< The key and scalar fallback.
+        simd_isa isa = simd_isa::automatic;  ///< The requested instruction set.
+                                             ///< Unsupported requests fall 
+                                             ///< back to #detect_simd_isa.
+        
+        void encrypt_chunk(std::byte* chunk) const noexcept
+            { scalar.encrypt_chunk(chunk); }
+        
+        void decrypt_chunk(std::byte* chunk) const noexcept
+            { scalar.decrypt_chunk(chunk); }
+        
+        /**
+         * \brief Encrypts `[chunks .. chunks + count * chunk_size)` in-place.
+         */
+        void encrypt_chunks(std::byte* chunks, std::size_t count) const noexcept;
+        
+        /**
+         * \brief Decrypts `[chunks .. chunks + count * chunk_size)` in-place.
+         */
+        void decrypt_chunks(std::byte* chunks, std::size_t count) const noexcept;
+    };
+    static_assert(InPlaceBatchEncryptionScheme<simd_tea>);
+    static_assert(InPlaceBatchDecryptionScheme<simd_tea>);
+    
+    /**
+     * \brief The vectorized equivalent of #h1_tea.
+     */
+    inline constexpr simd_tea h1_simd_tea {
+        .scalar = h1_tea
+    };
+    
+    /**
+     * \brief Implements the Tiny Encryption Algorithm like #tea, for a key 
+     *        and endianness fixed at compile time.
+     *
+     * The 32 rounds are unrolled, with the round sums of #schedule and the 
+     * key words folded into them as constants, and the chunk words are 
+     * loaded in \a Endian order without selecting it at run time. Runs of 
+     * whole chunks in the native byte order go through the vector kernels 
+     * of #simd_tea, with #runtime as their key.
+     */
+    template<std::endian Endian, 
+             std::uint32_t K0, std::uint32_t K1, std::uint32_t K2, std::uint32_t K3>
+    struct static_tea
+    {
+        static constexpr std::size_t chunk_size = tea::chunk_size;
+        
+        /**
+         * \brief The equivalent #tea, e.g. for the vector kernels.
+         */
+        static constexpr tea runtime {
+            .endian = Endian,
+            .key = {K0, K1, K2, K3}
+        };
+        
+        /**
+         * \brief The sum that round \c i (counting from 0) of the encryption
+         *        adds in, which decryption uses in reverse order.
+         */
+        static constexpr std::array<std::uint32_t, 32> schedule = [] {
+            std::array<std::uint32_t, 32> sums;
+            std::uint32_t sum = 0;
+            for (auto& s : sums)
+                s = sum += 0x9E3779B9;
+            return sums;
+        }();
+        
+        constexpr void encrypt_chunk(std::byte* chunk) const noexcept
+        {
+            std::uint32_t v0 = deserialize<std::uint32_t, Endian>(chunk);
+            std::uint32_t v1 = deserialize<std::uint32_t, Endian>(chunk + sizeof(v0));
+            encrypt_rounds(v0, v1, std::make_index_sequence<schedule.size()>{});
+            serialize<Endian>(v0, chunk);
+            serialize<Endian>(v1, chunk + sizeof(v0));
+        }
+        
+        constexpr void decrypt_chunk(std::byte* chunk) const noexcept
+        {
+            std::uint32_t v0 = deserialize<std::uint32_t, Endian>(chunk);
+            std::uint32_t v1 = deserialize<std::uint32_t, Endian>(chunk + sizeof(v0));
+            decrypt_rounds(v0, v1, std::make_index_sequence<schedule.size()>{});
+            serialize<Endian>(v0, chunk);
+            serialize<Endian>(v1, chunk + sizeof(v0));
+        }
+        
+        /**
+         * \brief Encrypts `[chunks .. chunks + count * chunk_size)` in-place.
+         */
+        void encrypt_chunks(std::byte* chunks, const std::size_t count) const noexcept
+        {
+            if constexpr (Endian == std::endian::native)
+            {
+                if (detect_simd_isa() != simd_isa::scalar)
+                    return simd_tea{.scalar = runtime}.encrypt_chunks(chunks, count);
+            }
+            
+            for (std::size_t i = 0; i < count; ++i)
+                encrypt_chunk(chunks + i * chunk_size);
+        }
+        
+        /**
+         * \brief Decrypts `[chunks .. chunks + count * chunk_size)` in-place.
+         */
+        void decrypt_chunks(std::byte* chunks, const std::size_t count) const noexcept
+        {
+            if constexpr (Endian == std::endian::native)
+            {
+                if (detect_simd_isa() != simd_isa::scalar)
+                    return simd_tea{.scalar = runtime}.decrypt_chunks(chunks, count);
+            }
+            
+            for (std::size_t i = 0; i < count; ++i)
+                decrypt_chunk(chunks + i * chunk_size);
+        }
+        
+    private:
+        template<std::size_t... Round>
+        static constexpr void encrypt_rounds(
+            std::uint32_t& v0, 
+            std::uint32_t& v1, 
+            std::index_sequence<Round...>) noexcept
+        {
+            ((v0 += ((v1 << 4u) + K0) ^ (v1 + schedule[Round]) ^ ((v1 >> 5u) + K1),
+              v1 += ((v0 << 4u) + K2) ^ (v0 + schedule[Round]) ^ ((v0 >> 5u) + K3)), ...);
+        }
+        
+        template<std::size_t... Round>
+        static constexpr void decrypt_rounds(
+            std::uint32_t& v0, 
+            std::uint32_t& v1, 
+            std::index_sequence<Round...>) noexcept
+        {
+            constexpr std::size_t last = sizeof...(Round) - 1;
+            ((v1 -= ((v0 << 4u) + K2) ^ (v0 + schedule[last - Round]) ^ ((v0 >> 5u) + K3),
+              v0 -= ((v1 << 4u) + K0) ^ (v1 + schedule[last - Round]) ^ ((v1 >> 5u) + K1)), ...);
+        }
+    };
+    
+    /**
+     * \brief #h1_tea as a #static_tea, which #h1_cipher is made of.
+     */
+    inline constexpr static_tea<
+        std::endian::little, 0x3FFFFFDD, 0x7FC3, 0xE5, 0x3FFFEF> h1_static_tea;
+    static_assert(InPlaceBatchEncryptionScheme<decltype(h1_static_tea)>);
+    static_assert(InPlaceBatchDecryptionScheme<decltype(h1_static_tea)>);
+    static_assert(
+        h1_static_tea.runtime.endian == h1_tea.endian &&
+        std::equal(std::begin(h1_tea.key), std::end(h1_tea.key), 
+                   std::begin(h1_static_tea.runtime.key)));
+    
     /**
      * \brief Applies \a scheme to encrypt `[buf .. buf + len)` in-place.
      *
@@ -75,6 +302,8 @@ namespace shader_packager
     template<InPlaceEncryptionScheme Scheme>
     void encrypt_buffer(const Scheme& scheme, std::span<std::byte> buf)
     {
+        H1SP_STATS_SCOPE(encrypt, buf.size());
+        
         const auto len = buf.size();
         const unsigned long chunk_size = scheme.chunk_size;
         if (len < chunk_size)
@@ -84,11 +313,17 @@ namespace shader_packager
         // then re-encrypt the tailing piece along with part of the last chunk
         // already encrypted
         
-        for ( auto chunk = &(*buf.begin()), end = &(*buf.end()) - (len % chunk_size)
-            ; chunk != end
-            ; chunk += chunk_size)
+        if constexpr (InPlaceBatchEncryptionScheme<Scheme>)
         {
-            scheme.encrypt_chunk(chunk);
+            scheme.encrypt_chunks(buf.data(), len / chunk_size);
+        } else
+        {
+            for ( auto chunk = &(*buf.begin()), end = &(*buf.end()) - (len % chunk_size)
+                ; chunk != end
+                ; chunk += chunk_size)
+            {
+                scheme.encrypt_chunk(chunk);
+            }
         }
         
         if ((len % chunk_size) != 0)
@@ -108,6 +343,8 @@ namespace shader_packager
     template<InPlaceDecryptionScheme Scheme>
     void decrypt_buffer(const Scheme& scheme, std::span<std::byte> buf)
     {
+        H1SP_STATS_SCOPE(decrypt, buf.size());
+        
         const auto len = buf.size();
         const unsigned long chunk_size = scheme.chunk_size;
         if (len < chunk_size || len <= 0)
@@ -123,14 +360,282 @@ namespace shader_packager
         }
         
         buf = buf.first(buf.size() - (len % chunk_size));
-        for ( auto chunk = &(*buf.begin()), end = &(*buf.end())
-            ; chunk != end
-            ; chunk += chunk_size)
+        if constexpr (InPlaceBatchDecryptionScheme<Scheme>)
+        {
+            scheme.decrypt_chunks(buf.data(), buf.size() / chunk_size);
+        } else
+        {
+            for ( auto chunk = &(*buf.begin()), end = &(*buf.end())
+                ; chunk != end
+                ; chunk += chunk_size)
+            {
+                scheme.decrypt_chunk(chunk);
+            }
+        }
+    }
+    
+    namespace detail
+    {
+        /**
+         * \brief Splits `[buf .. buf + len)` (a whole number of chunks) into 
+         *        at most \a threads contiguous ranges and invokes \a f on 
+         *        each of them concurrently.
+         *
+         * The calling thread processes the first range; the function returns
+         * once every range has been processed.
+         */
+        template<typename F>
+        void for_each_chunk_range(
+            std::span<std::byte> buf, 
+            const std::size_t    chunk_size,
+            std::size_t          threads,
+            F&&                  f)
+        {
+            // Below this, thread startup costs more than the cipher work.
+            constexpr std::size_t min_bytes_per_thread = 64 * 1024;
+            
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            
+            const std::size_t chunks = buf.size() / chunk_size;
+            threads = std::clamp<std::size_t>(
+                buf.size() / min_bytes_per_thread, 1, threads);
+            
+            if (threads <= 1)
+            {
+                f(buf);
+                return;
+            }
+            
+            const std::size_t per_thread = chunks / threads;
+            const std::size_t extra      = chunks % threads;
+            
+            std::vector<std::jthread> workers;
+            workers.reserve(threads - 1);
+            
+            std::size_t offset = (per_thread + (extra > 0)) * chunk_size;
+            const auto first = buf.first(offset);
+            for (std::size_t t = 1; t < threads; ++t)
+            {
+                const std::size_t n = (per_thread + (t < extra)) * chunk_size;
+                workers.emplace_back([&f, range = buf.subspan(offset, n)] { 
+                    f(range); 
+                });
+                offset += n;
+            }
+            
+            f(first);
+        } // workers join here
+    }
+    
+    /**
+     * \brief Applies \a scheme to encrypt `[buf .. buf + len)` in-place, 
+     *        spreading the whole chunks over up to \a threads threads.
+     *
+     * The result is identical to `encrypt_buffer(scheme, buf)`: the tailing 
+     * chunk, which overlaps the last whole chunk, is only encrypted once all 
+     * whole chunks are.
+     *
+     * \param [in]     scheme  The encryption scheme to use.
+     * \param [in,out] buf     The data to encrypt.
+     * \param [in]     threads The maximum number of threads to use, or 0 to 
+     *                         use one per hardware thread.
+     */
+    template<InPlaceEncryptionScheme Scheme>
+    void encrypt_buffer(
+        const Scheme&        scheme, 
+        std::span<std::byte> buf, 
+        const std::size_t    threads)
+    {
+        const auto len = buf.size();
+        const unsigned long chunk_size = scheme.chunk_size;
+        if (len < chunk_size)
+            return; // can't encrypt, do nothing
+        
+        detail::for_each_chunk_range(
+            buf.first(len - (len % chunk_size)), chunk_size, threads,
+            [&scheme] (std::span<std::byte> range) { 
+                encrypt_buffer(scheme, range); 
+            });
+        
+        if ((len % chunk_size) != 0)
         {
-            scheme.decrypt_chunk(chunk);
+            scheme.encrypt_chunk(&(*buf.begin()) + len - chunk_size);
         }
     }
     
+    /**
+     * \brief Applies \a scheme to decrypt `[buf .. buf + len)` in-place, 
+     *        spreading the whole chunks over up to \a threads threads.
+     *
+     * The result is identical to `decrypt_buffer(scheme, buf)`: the tailing 
+     * chunk is decrypted before any of the whole chunks are.
+     *
+     * \param [in]     scheme  The decryption scheme to use.
+     * \param [in,out] buf     The data to decrypt.
+     * \param [in]     threads The maximum number of threads to use, or 0 to 
+     *                         use one per hardware thread.
+     */
+    template<InPlaceDecryptionScheme Scheme>
+    void decrypt_buffer(
+        const Scheme&        scheme, 
+        std::span<std::byte> buf, 
+        const std::size_t    threads)
+    {
+        const auto len = buf.size();
+        const unsigned long chunk_size = scheme.chunk_size;
+        if (len < chunk_size)
+            return; // can't decrypt, do nothing
+        
+        if ((len % chunk_size) != 0)
+        {
+            scheme.decrypt_chunk(&(*buf.begin()) + len - chunk_size);
+        }
+        
+        detail::for_each_chunk_range(
+            buf.first(len - (len % chunk_size)), chunk_size, threads,
+            [&scheme] (std::span<std::byte> range) { 
+                decrypt_buffer(scheme, range); 
+            });
+    }
+    
+    /**
+     * \brief Encrypts and decrypts archive buffers with a scheme chosen at 
+     *        run time, e.g. by a format profile.
+     *
+     * The buffer functions are #encrypt_buffer and #decrypt_buffer as 
+     * instantiated by #of for the scheme, so a #static_tea keeps its 
+     * unrolled rounds and a #tea key gets the #simd_tea kernels; only the 
+     * call per buffer is indirect.
+     */
+    class archive_cipher
+    {
+        using buffer_function = 
+            void (*)(const tea& key, std::span<std::byte> buf, std::size_t threads);
+        
+        tea             key;
+        buffer_function encrypt_function;
+        buffer_function decrypt_function;
+        
+        constexpr archive_cipher(
+            const tea             key, 
+            const buffer_function encrypt_function, 
+            const buffer_function decrypt_function) noexcept
+            : key{key}
+            , encrypt_function{encrypt_function}
+            , decrypt_function{decrypt_function}
+        {}
+    
+    public:
+        static constexpr std::size_t chunk_size = tea::chunk_size;
+        
+        /**
+         * \brief Gets the cipher for the key of \a scheme, fixed at compile 
+         *        time.
+         */
+        template<std::endian Endian, 
+                 std::uint32_t K0, std::uint32_t K1, std::uint32_t K2, std::uint32_t K3>
+        static constexpr archive_cipher of(const static_tea<Endian, K0, K1, K2, K3>&) noexcept
+        {
+            using scheme = static_tea<Endian, K0, K1, K2, K3>;
+            return {
+                scheme::runtime,
+                [] (const tea&, const std::span<std::byte> buf, const std::size_t threads) {
+                    encrypt_buffer(scheme{}, buf, threads);
+                },
+                [] (const tea&, const std::span<std::byte> buf, const std::size_t threads) {
+                    decrypt_buffer(scheme{}, buf, threads);
+                }
+            };
+        }
+        
+        /**
+         * \brief Gets the cipher for the key of \a scheme, e.g. one read 
+         *        from a file.
+         */
+        static constexpr archive_cipher of(const tea& scheme) noexcept
+        {
+            return {
+                scheme,
+                [] (const tea& key, const std::span<std::byte> buf, const std::size_t threads) {
+                    encrypt_buffer(simd_tea{.scalar = key}, buf, threads);
+                },
+                [] (const tea& key, const std::span<std::byte> buf, const std::size_t threads) {
+                    decrypt_buffer(simd_tea{.scalar = key}, buf, threads);
+                }
+            };
+        }
+        
+        /**
+         * \brief Gets the key and endianness of the cipher.
+         */
+        constexpr const tea& scheme() const noexcept { return key; }
+        
+        /**
+         * \brief Encrypts \a buf in-place as #encrypt_buffer does.
+         */
+        void encrypt(const std::span<std::byte> buf, const std::size_t threads = 1) const
+            { encrypt_function(key, buf, threads); }
+        
+        /**
+         * \brief Decrypts \a buf in-place as #decrypt_buffer does.
+         */
+        void decrypt(const std::span<std::byte> buf, const std::size_t threads = 1) const
+            { decrypt_function(key, buf, threads); }
+    };
+    
+    /**
+     * \brief The cipher of #h1_static_tea, which the archive functions use 
+     *        unless given another.
+     */
+    inline constexpr archive_cipher h1_cipher = archive_cipher::of(h1_static_tea);
+    
+    /**
+     * \brief Calculates an MD5 digest incrementally, from data supplied in 
+     *        pieces.
+     *
+     * Feeding the pieces of a buffer in order through #update produces the 
+     * same digest as #compute_md5_digest on the whole buffer.
+     */
+    class md5_context
+    {
+        alignas(std::max_align_t) unsigned char state[128]; ///< Opaque state.
+    
+    public:
+        /**
+         * With the OpenSSL backend, the context allocates; those functions
+         * throw `std::bad_alloc` on failure. With the built-in backend 
+         * (`H1SP_BUILTIN_MD5`), they do not allocate or throw.
+         */
+        md5_context();
+        md5_context(const md5_context& other);
+        md5_context& operator=(const md5_context& other);
+        ~md5_context();
+        
+        /**
+         * \brief Appends \a buf to the hashed data.
+         */
+        void update(std::span<const std::byte> buf) noexcept;
+        
+        /**
+         * \brief Computes the digest of all data passed to #update.
+         *
+         * The context must not be updated afterwards.
+         *
+         * \return The MD5 digest of the data, as a string.
+         */
+        std::string finish();
+        
+        /**
+         * \brief Computes the digest of all data passed to #update into 
+         *        \a hex, as 32 lowercase hex digits and a null terminator,
+         *        without allocating.
+         *
+         * The context must not be updated afterwards.
+         */
+        void finish(std::array<char, 33>& hex) noexcept;
+    };
+    
     /**
      * \brief Calculates the MD5 digest for some data.
      *
@@ -138,6 +643,27 @@ namespace shader_packager
      * \return The MD5 digest of the data, as a string.
      */
     std::string compute_md5_digest(std::span<const std::byte> buf);
+    
+    /**
+     * \brief Gets the number of streams #compute_md5_digests hashes at once
+     *        on this machine.
+     */
+    std::size_t md5_lane_count() noexcept;
+    
+    /**
+     * \brief Calculates the MD5 digests of several buffers at once.
+     *
+     * MD5 is serial within one stream, so instead up to #md5_lane_count 
+     * independent buffers are hashed in parallel, one per SIMD lane.
+     *
+     * \param [in]  bufs    The data to hash.
+     * \param [out] digests Receives the digest of each buffer in \a bufs, 
+     *                      as by `md5_context::finish`. Must have at least 
+     *                      as many elements as \a bufs.
+     */
+    void compute_md5_digests(
+        std::span<const std::span<const std::byte>> bufs,
+        std::span<std::array<char, 33>>             digests) noexcept;
 }
 
 #endif // H1SP_CRYPT_HPP
\ No newline at end of file
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_LOCAL_SERVER_HPP
+#define H1SP_LOCAL_SERVER_HPP
+
+#include <cstddef>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <span>
+#include <string>
+#include <vector>
+
+/* LOCAL SERVERS:
+ * A local server accepts connections on a Unix domain socket and reads 
+ * requests from them one line at a time. Idle connections are watched by 
+ * the thread that accepts them; a request that arrives is handled on a 
+ * thread pool, so up to one request per pool thread runs at once, however
+ * many connections are open. The requests of one connection are handled 
+ * in order. Replies are written by the request handler, which may pass a 
+ * file descriptor along with them.
+ *
+ * Local servers are only available where Unix domain sockets are, i.e. 
+ * not on Windows.
+ */
+
+namespace shader_packager
+{
+    /**
+     * \brief A connection to a #local_server.
+     */
+    class local_connection
+    {
+        int         fd;
+        std::string pending; ///< Bytes read past the last line.
+
+    public:
+        /**
+         * \brief Takes ownership of the connected socket \a fd.
+         */
+        explicit local_connection(int fd) noexcept : fd(fd) { }
+        local_connection(const local_connection&) = delete;
+        local_connection& operator=(const local_connection&) = delete;
+        ~local_connection();
+
+        /**
+         * \brief Gets the connected socket.
+         */
+        int descriptor() const noexcept { return fd; }
+
+        /**
+         * \brief Checks whether a whole request line has already been read,
+         *        so that #read_line does not wait for the peer.
+         */
+        bool has_line() const noexcept;
+
+        /**
+         * \brief Reads the next request line, without its line break.
+         *
+         * \return \c false once the peer stops sending, on error, or if a 
+         *         line is longer than 64 KiB.
+         */
+        bool read_line(std::string& line);
+
+        /**
+         * \brief Writes \a pieces, in order, as one reply.
+         *
+         * \param [in] pieces     The bytes to write.
+         * \param [in] descriptor If not -1, a file descriptor passed to the
+         *                        peer along with the first byte.
+         * \return \c true on success, otherwise \c false.
+         */
+        bool write(
+            std::span<const std::span<const std::byte>> pieces, 
+            int                                         descriptor = -1);
+
+        /**
+         * \brief Writes \a text as one reply.
+         */
+        bool write(std::string_view text, int descriptor = -1);
+    };
+
+    /**
+     * \brief A Unix domain socket server, see LOCAL SERVERS.
+     */
+    class local_server
+    {
+        int              listen_fd = -1;
+        int              wake_fds[2] = {-1, -1}; ///< Wakes the accepting thread.
+        std::string      path;
+        std::atomic_bool stopping = false;
+        std::mutex       mutex;
+        std::vector<std::shared_ptr<local_connection>> idle;   ///< Waiting for 
+                                                              ///< a request.
+        std::set<int>                                  active; ///< Being served.
+
+        void wake() noexcept;
+
+    public:
+        /**
+         * \brief Handles one request read from \a connection.
+         *
+         * \return \c false to close the connection, \c true to read the next.
+         */
+        using handler = std::function<bool(local_connection& connection, std::string& request)>;
+
+        local_server() = default;
+        local_server(const local_server&) = delete;
+        local_server& operator=(const local_server&) = delete;
+        ~local_server();
+
+        /**
+         * \brief Creates the socket \a socket_path and listens on it.
+         *
+         * A stale socket left at \a socket_path is replaced; any other file
+         * there is not.
+         *
+         * \return \c true on success, otherwise \c false after printing why.
+         */
+        bool listen(const char* socket_path);
+
+        /**
+         * \brief Serves requests with \a on_request, up to \a threads at 
+         *        once (0 for one per hardware thread), until #stop.
+         */
+        void run(std::size_t threads, const handler& on_request);
+
+        /**
+         * \brief Makes #run stop accepting connections and requests, and 
+         *        return once the requests being handled are done.
+         *
+         * This may be called from any thread, or from a signal handler.
+         */
+        void stop() noexcept;
+    };
+}
+
+#endif // H1SP_LOCAL_SERVER_HPP
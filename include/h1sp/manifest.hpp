@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_MANIFEST_HPP
+#define H1SP_MANIFEST_HPP
+
+#include <cstdint>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+/* PACK MANIFEST FILES:
+ * A pack manifest is a text file, written next to an archive, that records
+ * where each member came from so that a later pack can skip the members
+ * whose files have not changed. The format is
+ *
+ *   h1sp-manifest 1
+ *   archive DIGEST SIZE
+ *   SIZE MTIME HASH OFFSET NAME      (one line per member, in order)
+ *
+ * where DIGEST is the archive's stored MD5 digest, the archive's SIZE is in
+ * bytes, MTIME is the member file's modification time in filesystem clock
+ * ticks, HASH is the MD5 digest of the member data and OFFSET is the offset
+ * of the member's size header within the archive.
+ */
+
+namespace shader_packager
+{
+    /**
+     * \brief The size and modification time of a file.
+     */
+    struct file_stamp
+    {
+        std::uint64_t size;  ///< The file size in bytes.
+        std::int64_t  mtime; ///< Modification time in filesystem clock ticks.
+
+        friend bool operator==(const file_stamp&, const file_stamp&) = default;
+    };
+
+    /**
+     * \brief Gets the #file_stamp of \a file.
+     *
+     * \return The stamp, or `std::nullopt` if \a file could not be queried.
+     */
+    std::optional<file_stamp> stat_file(const char* file);
+
+    /**
+     * \brief Records the provenance of each member of a packed archive.
+     */
+    struct pack_manifest
+    {
+        struct entry
+        {
+            std::string   name;   ///< The member name.
+            file_stamp    stamp;  ///< The member file's stamp when packed.
+            std::string   hash;   ///< The MD5 digest of the member data.
+            std::uint64_t offset; ///< Offset of the member's size header.
+        };
+
+        std::string        archive_digest; ///< The archive's stored digest.
+        std::uint64_t      archive_size;   ///< The archive's size in bytes.
+        std::vector<entry> entries;        ///< The members, in order.
+
+        /**
+         * \brief Loads a manifest from \a file.
+         *
+         * \return The manifest, or `std::nullopt` if \a file could not be
+         *         read or is not a valid manifest.
+         */
+        static std::optional<pack_manifest> read_from_file(const char* file);
+
+        /**
+         * \brief Writes this manifest to \a file, replacing it. It is
+         *        written to \a file.partial first and renamed over \a file,
+         *        so that a failed write leaves \a file as it was.
+         *
+         * \return \c true on success, otherwise \c false.
+         */
+        bool write_to_file(const char* file) const;
+    };
+}
+
+#endif // H1SP_MANIFEST_HPP
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_MAPPED_FILE_HPP
+#define H1SP_MAPPED_FILE_HPP
+
+#include <cstddef>
+
+#include <span>
+
+namespace shader_packager
+{
+    /**
+     * \brief Owns a private, copy-on-write memory mapping of a whole file.
+     *
+     * Writes through the mapping are never carried through to the file.
+     */
+    class mapped_file
+    {
+        std::byte*  ptr   = nullptr; ///< The start of the mapping.
+        std::size_t nbytes = 0;      ///< The size of the mapping in bytes.
+
+    public:
+        mapped_file() = default;
+        mapped_file(mapped_file&& other) noexcept;
+        mapped_file& operator=(mapped_file&& other) noexcept;
+        ~mapped_file();
+
+        /**
+         * \brief Maps \a file copy-on-write for reading and writing.
+         *
+         * Nothing is printed on failure so that callers can fall back to
+         * #read_file.
+         *
+         * \param [in] file The name of the file to map.
+         * \return The mapping, which tests \c false if the file could not be
+         *         opened or mapped, or is empty.
+         */
+        static mapped_file map_copy_on_write(const char* file);
+
+        /**
+         * \brief Returns the mapped bytes, as a `std::span`.
+         */
+        std::span<std::byte> range() const noexcept { return {ptr, nbytes}; }
+
+        /**
+         * \brief Checks whether this object holds a mapping.
+         */
+        explicit operator bool() const noexcept { return ptr != nullptr; }
+    };
+}
+
+#endif // H1SP_MAPPED_FILE_HPP
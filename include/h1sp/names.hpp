@@ -3,7 +3,11 @@
 #ifndef H1SP_NAMES_HPP
 #define H1SP_NAMES_HPP
 
+#include <cstddef>
+
 #include <array>
+#include <span>
+#include <string_view>
 
 namespace shader_packager
 {
@@ -21,6 +25,20 @@ namespace shader_packager
      * \brief The names (in order) of the vertex shaders.
      */
     extern const std::array<const char*, 64>  vs_names;
+    
+    /**
+     * \brief Finds the position of \a name in \a names.
+     *
+     * Lookups in #retail_fx_names, #custom_fx_names and #vs_names take 
+     * constant time, using perfect hash tables built at compile time. Other 
+     * lists are searched linearly.
+     *
+     * \return The index of \a name in \a names, or `names.size()` if 
+     *         \a names does not contain \a name.
+     */
+    std::size_t find_name(
+        std::span<const char* const> names, 
+        std::string_view             name) noexcept;
 }
 
 #endif // H1SP_NAMES_HPP
\ No newline at end of file
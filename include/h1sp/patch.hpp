@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_PATCH_HPP
+#define H1SP_PATCH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <h1sp/archive.hpp>
+
+/* ARCHIVE PATCH FILES:
+ * A patch turns one archive into another by replacing, adding or dropping
+ * members by index, i.e. in the order of the archive's member names. It
+ * holds only the data of the members that changed, unencrypted. All
+ * integers are little-endian. The format is
+ *
+ *   "h1sp-patch 1\n"                     (13 octets)
+ *   OLD_DIGEST NEW_DIGEST                (32 hex digits each)
+ *   uint32 OLD_COUNT, NEW_COUNT, CHANGES
+ *   uint32 INDEX, uint32 SIZE, DATA      (CHANGES times)
+ *
+ * where the digests are those stored in the archive the patch applies to
+ * and in the archive it produces, the counts are their numbers of members
+ * and each change replaces or adds member INDEX with the SIZE octets of
+ * DATA. Changes are in increasing INDEX order and each INDEX is less than
+ * NEW_COUNT; every member at or past OLD_COUNT is a change, and the members
+ * at or past NEW_COUNT are dropped.
+ */
+
+namespace shader_packager
+{
+    /**
+     * \brief The member-level differences between two archives.
+     */
+    struct archive_patch
+    {
+        struct change
+        {
+            std::uint32_t              index; ///< The member replaced or added.
+            std::span<const std::byte> data;  ///< Its new data.
+        };
+
+        /**
+         * \brief Indicates the result of an #apply operation.
+         */
+        enum class apply_error
+        {
+            success,
+            wrong_archive,    ///< The archive is not the one patched.
+            could_not_write,  ///< The output could not be written.
+            digest_mismatch   ///< The result is not the patched archive.
+        };
+
+        std::string         old_digest; ///< The digest of the archive patched.
+        std::string         new_digest; ///< The digest of the result.
+        std::uint32_t       old_count = 0; ///< Members in the archive patched.
+        std::uint32_t       new_count = 0; ///< Members in the result.
+        std::vector<change> changes;       ///< The changed members, in order.
+        byte_buffer         storage;       ///< Holds the change data, if it
+                                           ///< was read by #read_from_file.
+
+        /**
+         * \brief Finds the members of \a to that differ from those of
+         *        \a from, or that \a from does not have.
+         *
+         * Both archives must have been loaded from a file or buffer, and the
+         * changes refer to the members of \a to, which must outlive them.
+         */
+        static archive_patch diff(const archive& from, const archive& to);
+
+        /**
+         * \brief Loads a patch from \a file.
+         *
+         * \return The patch, or `std::nullopt` if \a file could not be read
+         *         or is not a valid patch.
+         */
+        static std::optional<archive_patch> read_from_file(const char* file);
+
+        /**
+         * \brief Writes this patch to \a file, replacing it.
+         *
+         * \return \c true on success, otherwise \c false.
+         */
+        bool write_to_file(const char* file) const;
+
+        /**
+         * \brief Writes the archive that results from patching \a from to
+         *        \a file.
+         *
+         * Runs of unchanged members are copied from \a from as they are, and
+         * the result is hashed and encrypted a window at a time as it is
+         * written to \a file.partial, which is renamed over \a file once it
+         * is complete. It is removed instead, leaving \a file as it was, if
+         * the result cannot be written or its digest is not #new_digest.
+         *
+         * \param [in] from    The archive to patch, with #old_digest.
+         * \param [in] file    The filepath of the archive to write.
+         * \param [in] threads The maximum number of threads used to encrypt
+         *                     the result, or 0 for one per hardware thread.
+         * \return `apply_error::success` on success,
+         *         or an appropriate value from \c apply_error on failure.
+         */
+        apply_error apply(
+            const archive& from,
+            const char*    file,
+            std::size_t    threads = 1) const;
+    };
+}
+
+#endif // H1SP_PATCH_HPP
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_PROFILE_HPP
+#define H1SP_PROFILE_HPP
+
+#include <concepts>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <h1sp/archive.hpp>
+#include <h1sp/crypt.hpp>
+#include <h1sp/names.hpp>
+
+/* FORMAT PROFILES:
+ * A profile describes one kind of shader archive: the names of its members,
+ * in order, the extension and default prefix of their files, and the cipher
+ * (key and endianness) the archive is encrypted with. The member layout and
+ * the MD5 trailer are those of archive.hpp for every profile.
+ *
+ * The built-in profiles are types, for use as template parameters, and
+ * format_profile describes any of them at run time. Other profiles are read
+ * from a profile file, a text file with one setting per line:
+ *
+ *   name NAME              a name for messages; defaults to the filepath
+ *   extension EXTENSION    the member file extension, e.g. fx
+ *   prefix PREFIX          the default member prefix; defaults to EXTENSION/
+ *   key K0 K1 K2 K3        the TEA key, in decimal, octal (0...) or hex
+ *                          (0x...); defaults to Halo's
+ *   endian {little|big}    the TEA byte order; defaults to little
+ *   member NAME            the next member name
+ *
+ * where extension and at least one member are required. Empty lines and
+ * lines starting with # are ignored.
+ */
+
+namespace shader_packager
+{
+    /**
+     * \brief A constraint for types that describe an archive format at
+     *        compile time.
+     */
+    template<typename Profile>
+    concept FormatProfile = requires
+    {
+        { Profile::name }      -> std::convertible_to<std::string_view>;
+        { Profile::extension } -> std::convertible_to<const char*>;
+        { Profile::prefix }    -> std::convertible_to<const char*>;
+        { Profile::names }     -> std::convertible_to<std::span<const char* const>>;
+        { archive_cipher::of(Profile::cipher) } -> std::same_as<archive_cipher>;
+    };
+
+    /**
+     * \brief The effects archive of PC (retail).
+     */
+    struct pc_fx_profile
+    {
+        static constexpr std::string_view name      = "pc-fx";
+        static constexpr const char*      extension = "fx";
+        static constexpr const char*      prefix    = "fx/";
+        static constexpr std::span<const char* const> names = retail_fx_names;
+        static constexpr const auto&      cipher    = h1_static_tea;
+    };
+
+    /**
+     * \brief The effects archive of Custom Edition.
+     */
+    struct ce_fx_profile
+    {
+        static constexpr std::string_view name      = "ce-fx";
+        static constexpr const char*      extension = "fx";
+        static constexpr const char*      prefix    = "fx/";
+        static constexpr std::span<const char* const> names = custom_fx_names;
+        static constexpr const auto&      cipher    = h1_static_tea;
+    };
+
+    /**
+     * \brief The vertex shaders archive of PC (retail).
+     */
+    struct pc_vsh_profile
+    {
+        static constexpr std::string_view name      = "pc-vsh";
+        static constexpr const char*      extension = "vsh";
+        static constexpr const char*      prefix    = "vsh/";
+        static constexpr std::span<const char* const> names = vs_names;
+        static constexpr const auto&      cipher    = h1_static_tea;
+    };
+
+    /**
+     * \brief The vertex shaders archive of Custom Edition.
+     */
+    struct ce_vsh_profile
+    {
+        static constexpr std::string_view name      = "ce-vsh";
+        static constexpr const char*      extension = "vsh";
+        static constexpr const char*      prefix    = "vsh/";
+        static constexpr std::span<const char* const> names = vs_names;
+        static constexpr const auto&      cipher    = h1_static_tea;
+    };
+
+    static_assert(FormatProfile<pc_fx_profile>);
+    static_assert(FormatProfile<ce_fx_profile>);
+    static_assert(FormatProfile<pc_vsh_profile>);
+    static_assert(FormatProfile<ce_vsh_profile>);
+
+    /**
+     * \brief Describes an archive format at run time.
+     */
+    struct format_profile
+    {
+        std::string                  name;      ///< Identifies the profile.
+        std::string                  extension; ///< The member file extension.
+        std::string                  prefix;    ///< The default member prefix.
+        std::span<const char* const> names;     ///< The member names, in order.
+        archive_cipher               cipher = h1_cipher; ///< The archive cipher.
+        byte_buffer                  storage;   ///< Holds the names of a 
+                                                ///< profile read by 
+                                                ///< #read_from_file.
+        std::vector<const char*>     members;   ///< Its #names.
+
+        /**
+         * \brief Describes \a Profile at run time.
+         *
+         * The cipher is that of `Profile::cipher`, so a #static_tea keeps
+         * its compile-time key.
+         */
+        template<FormatProfile Profile>
+        static format_profile of()
+        {
+            return {
+                .name      = std::string{Profile::name},
+                .extension = Profile::extension,
+                .prefix    = Profile::prefix,
+                .names     = Profile::names,
+                .cipher    = archive_cipher::of(Profile::cipher),
+                .storage   = {},
+                .members   = {}
+            };
+        }
+
+        /**
+         * \brief Loads a profile from the profile file \a file.
+         *
+         * \return The profile, or `std::nullopt` if \a file could not be
+         *         read or is not a valid profile file.
+         */
+        static std::optional<format_profile> read_from_file(const char* file);
+    };
+
+    /**
+     * \brief Gets the built-in profiles, pc-fx, ce-fx, pc-vsh and ce-vsh.
+     */
+    std::span<const format_profile> builtin_profiles();
+
+    /**
+     * \brief Finds the built-in profile called \a name.
+     *
+     * \return The profile, or null if there is no such profile.
+     */
+    const format_profile* find_profile(std::string_view name);
+}
+
+#endif // H1SP_PROFILE_HPP
@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_STATS_HPP
+#define H1SP_STATS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <chrono>
+
+/* HOT-PATH STATISTICS:
+ * When built with H1SP_ENABLE_STATS, each stage below counts its calls, its
+ * bytes and the wall and CPU time it took, summed over every thread, and
+ * the stages that handle one member at a time also record each member.
+ * Stages may nest, e.g. a member read includes its read_file.
+ *
+ * Otherwise the H1SP_STATS_ macros expand to nothing, their arguments are
+ * not evaluated, and nothing else here is compiled in.
+ */
+
+#if H1SP_ENABLE_STATS
+    /// Times the rest of the enclosing block as \a stage, handling \a bytes.
+    #define H1SP_STATS_SCOPE(stage, bytes) \
+        ::shader_packager::stat_scope h1sp_stat_scope \
+            {::shader_packager::stat_stage::stage, (bytes)}
+    
+    /// Like H1SP_STATS_SCOPE, also recording the time for \a member.
+    #define H1SP_STATS_MEMBER_SCOPE(stage, bytes, member) \
+        ::shader_packager::stat_scope h1sp_stat_scope \
+            {::shader_packager::stat_stage::stage, (bytes), (member)}
+    
+    /// Sets the bytes handled by the scope of this block, once known.
+    #define H1SP_STATS_SET_BYTES(bytes) h1sp_stat_scope.set_bytes(bytes)
+#else
+    #define H1SP_STATS_SCOPE(stage, bytes) static_cast<void>(0)
+    #define H1SP_STATS_MEMBER_SCOPE(stage, bytes, member) static_cast<void>(0)
+    #define H1SP_STATS_SET_BYTES(bytes) static_cast<void>(0)
+#endif
+
+namespace shader_packager
+{
+#if H1SP_ENABLE_STATS
+    /**
+     * \brief The stages that are timed.
+     */
+    enum class stat_stage
+    {
+        read_file,    ///< #read_file.
+        write_file,   ///< #write_file.
+        batch_write,  ///< #write_files.
+        decrypt,      ///< #decrypt_buffer, per thread.
+        encrypt,      ///< #encrypt_buffer, per thread.
+        md5,          ///< Hashing, single or multi-buffer.
+        validate,     ///< Scanning and indexing member headers.
+        member_read,  ///< Getting one member's data when packing.
+        member_write, ///< Writing one member's file when unpacking.
+        count
+    };
+    
+    /**
+     * \brief Times a stage from construction to destruction.
+     */
+    class stat_scope
+    {
+        stat_stage                            stage;
+        std::uint64_t                         bytes;
+        const char*                           member;
+        std::chrono::steady_clock::time_point wall_start;
+        std::uint64_t                         cpu_start;
+    
+    public:
+        /**
+         * \param [in] stage  The stage being timed.
+         * \param [in] bytes  The bytes it handles.
+         * \param [in] member If not null, the name of the member it handles,
+         *                    which must outlive the report.
+         */
+        stat_scope(stat_stage stage, std::uint64_t bytes, const char* member = nullptr) noexcept;
+        stat_scope(const stat_scope&) = delete;
+        stat_scope& operator=(const stat_scope&) = delete;
+        ~stat_scope();
+        
+        void set_bytes(std::uint64_t n) noexcept { bytes = n; }
+    };
+    
+    /**
+     * \brief Prints the statistics gathered so far as a table or as JSON,
+     *        with the wall and CPU time of the whole process.
+     */
+    void print_stats(std::FILE* out, bool json);
+#endif
+}
+
+#endif // H1SP_STATS_HPP
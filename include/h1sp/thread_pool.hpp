@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_THREAD_POOL_HPP
+#define H1SP_THREAD_POOL_HPP
+
+#include <cstddef>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace shader_packager
+{
+    /**
+     * \brief A fixed number of worker threads that run submitted tasks in
+     *        submission order.
+     *
+     * Destroying the pool waits for every submitted task to complete.
+     */
+    class thread_pool
+    {
+        std::mutex                        mutex;
+        std::condition_variable           wakeup;
+        std::deque<std::function<void()>> tasks;
+        bool                              stopping = false;
+        std::vector<std::jthread>         workers;
+
+        void post(std::function<void()> task);
+        void run() noexcept;
+
+    public:
+        /**
+         * \param [in] threads The number of worker threads, or 0 for one per
+         *                     hardware thread.
+         */
+        explicit thread_pool(std::size_t threads);
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+        ~thread_pool();
+
+        /**
+         * \brief Gets the number of worker threads.
+         */
+        std::size_t size() const noexcept { return workers.size(); }
+
+        /**
+         * \brief Queues \a f to run on a worker thread.
+         *
+         * \return A future for the result of invoking \a f.
+         */
+        template<typename F>
+        std::future<std::invoke_result_t<std::decay_t<F>&>> submit(F&& f)
+        {
+            using result_type = std::invoke_result_t<std::decay_t<F>&>;
+
+            // std::function needs a copyable target, packaged_task is not
+            auto task = std::make_shared<std::packaged_task<result_type()>>(
+                std::forward<F>(f));
+            auto result = task->get_future();
+            post([task = std::move(task)] { (*task)(); });
+            return result;
+        }
+    };
+}
+
+#endif // H1SP_THREAD_POOL_HPP
@@ -5,26 +5,45 @@
 #include <cstdio>
 
 #include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
 #include <numeric>
 #include <utility>
 
+#include <h1sp/core.hpp>
 #include <h1sp/crypt.hpp>
 #include <h1sp/io.hpp>
+#include <h1sp/mapped_file.hpp>
+#include <h1sp/names.hpp>
+#include <h1sp/stats.hpp>
 
 namespace shader_packager
 {
+    byte_buffer byte_buffer::borrow(const std::span<std::byte> bytes) noexcept
+    {
+        return {.buffer = nullptr, .nbytes = bytes.size(), .borrowed = bytes.data()};
+    }
+    
+    std::byte* byte_buffer::data() const noexcept
+    {
+        return buffer ? buffer.get() : borrowed;
+    }
+    
     byte_buffer::operator bool() const noexcept
     {
-        return static_cast<bool>(buffer);
+        return buffer || borrowed != nullptr;
     }
     
     std::span<std::byte> byte_buffer::range() const noexcept
     {
-        return {buffer.get(), nbytes};
+        return {data(), nbytes};
     }
     
     byte_buffer read_file(const char* file)
     {
+        H1SP_STATS_SCOPE(read_file, 0);
+        
         byte_buffer result {};
         
         auto fp = std::fopen(file, "rb");
@@ -59,11 +78,42 @@ namespace shader_packager
         if (result.nbytes != size) 
             result = byte_buffer{};
         
+        H1SP_STATS_SET_BYTES(result.nbytes);
+        
         return result;
     }
     
+    byte_buffer read_file(const char* file, const std::span<std::byte> into)
+    {
+        H1SP_STATS_SCOPE(read_file, into.size());
+        
+        // an empty file reads as a failure, as with read_file(file)
+        if (into.empty())
+            return {};
+        
+        auto fp = std::fopen(file, "rb");
+        if (fp == nullptr)
+        {
+            std::perror("failed to open file for reading\n");
+            return {};
+        }
+        
+        // the file must end exactly where into does
+        const bool complete = 
+            std::fread(into.data(), sizeof(std::byte), into.size(), fp) == into.size() &&
+            std::fgetc(fp) == EOF;
+        std::fclose(fp);
+        
+        if (!complete)
+            return {};
+        
+        return byte_buffer::borrow(into);
+    }
+    
     bool write_file(const char* file, std::span<const std::byte> buf)
     {
+        H1SP_STATS_SCOPE(write_file, buf.size());
+        
         auto fp = std::fopen(file, "wb");
         if (fp == nullptr)
         {
@@ -71,67 +121,179 @@ namespace shader_packager
             return false;
         }
         
-        std::fwrite(buf.data(), sizeof(std::byte), buf.size(), fp);
+        // an empty span may have no data, which fwrite does not take
+        if (!buf.empty())
+            std::fwrite(buf.data(), sizeof(std::byte), buf.size(), fp);
         std::fclose(fp);
         fp = nullptr;
         
         return true;
     }
     
-    archive::read_error archive::read_from_file(const char* file)
+    namespace
+    {
+        using chunk_size_type = std::uint32_t;
+        
+        // A window of this many bytes is hashed and encrypted before moving 
+        // on to the next, so that it is still in L1/L2 for each step.
+        constexpr std::size_t stream_window_size = 64 * 1024;
+        static_assert(stream_window_size % tea::chunk_size == 0);
+    }
+    
+    archive::read_error archive::read_from_file(
+        const char*       file, 
+        const std::size_t threads)
     {
         auto buf = read_file(file);
         if (!buf)
             return read_error::could_not_open_file;
         
-        // Strictly speaking, this should be < 33, but Halo requires the 
-        // archive to be non-empty, even if its just one byte.
-        // The stored MD5 hash is null-terminated, and Halo checks for that
-        // null-terminator.
-        if (buf.nbytes < 34)
+        return read_from_buffer(std::move(buf), threads);
+    }
+    
+    archive::read_error archive::read_from_buffer(
+        byte_buffer       buf, 
+        const std::size_t threads)
+    {
+        if (!buf)
             return read_error::archive_data_is_corrupt;
         
-        const auto archive_data = buf.range().first(buf.nbytes - 33);
-        const auto archive_md5 = std::string_view(
-            reinterpret_cast<const char*>(buf.range().last(33).data()), 
-            33);
+        const auto error = decrypt_and_validate(buf.range(), threads);
+        if (error == read_error::success)
+        {
+            mapping = mapped_file{};
+            filebuf = std::move(buf);
+        }
+        
+        return error;
+    }
+    
+    archive::read_error archive::open_mapped(
+        const char*       file, 
+        const std::size_t threads)
+    {
+        auto map = mapped_file::map_copy_on_write(file);
+        if (!map)
+            return read_error::could_not_open_file;
         
-        // decrypt buffer and verify hash is correct
-        decrypt_buffer(h1_tea, buf.range());
+        const auto error = decrypt_and_validate(map.range(), threads);
+        if (error == read_error::success)
         {
-            const auto md5_str = compute_md5_digest(archive_data);
-            const std::string_view md5_sv(md5_str.c_str(), md5_str.size() + 1);
-            // we need to ensure the null terminator is there, so we use sv's
-            if (archive_md5 != md5_sv)
-            {
-                std::fprintf(stderr, 
-                    "md5 did not match\n"
-                    "\tcomputed %.32s\n"
-                    "\tneeded %.32s\n",
-                    md5_str.c_str(),
-                    archive_md5.data());
-                return read_error::archive_data_is_corrupt;
-            }
+            filebuf = byte_buffer{};
+            mapping = std::move(map);
         }
         
-        // verify each archive entry is not corrupt
+        return error;
+    }
+    
+    archive::read_error archive::decrypt_and_validate(
+        const std::span<std::byte> buf, 
+        const std::size_t          threads)
+    {
+        archive_view view;
+        switch (decrypt_archive_in_place(buf, &view, threads, cipher))
         {
-            long member = 0;
-            archive_enumerator e{archive_data};
-            for (; e; e.advance()) { ++member; }
-            if (e.has_error())
-            {
-                std::fprintf(stderr, "error at archive member %ld\n", member);
-                return read_error::archive_data_is_corrupt;
-            }
+        case core_error::success:
+            break;
+        case core_error::digest_mismatch:
+            std::fprintf(stderr, 
+                "md5 did not match\n"
+                "\tcomputed %.32s\n"
+                "\tneeded %.32s\n",
+                view.computed.data(),
+                view.digest.data());
+            return read_error::archive_data_is_corrupt;
+        case core_error::corrupt_member:
+            std::fprintf(stderr, "error at archive member %ld\n", 
+                static_cast<long>(view.member_count));
+            return read_error::archive_data_is_corrupt;
+        default:
+            return read_error::archive_data_is_corrupt;
         }
         
         // everything checks out, assign the final values
-        filebuf = std::move(buf);
-        data    = archive_data;
+        data = view.data;
+        index_members();
         return read_error::success;
     }
     
+    archive::read_error archive::verify_file(
+        const char* const     file, 
+        verify_result* const  result,
+        const verify_mode     mode,
+        const archive_cipher& cipher)
+    {
+        constexpr std::size_t trailer_size = 33;
+        
+        std::unique_ptr<std::FILE, decltype(&std::fclose)> fp {
+            std::fopen(file, "rb"), &std::fclose
+        };
+        if (!fp)
+            return read_error::could_not_open_file;
+        
+        verify_result found {};
+        const auto finish = [&] (const read_error error) {
+            if (result != nullptr)
+                *result = found;
+            return error;
+        };
+        
+        if (mode == verify_mode::digest_only)
+        {
+            if (std::fseek(fp.get(), 0, SEEK_END) != 0)
+                return read_error::could_not_open_file;
+            const long size = std::ftell(fp.get());
+            if (size < 0)
+                return read_error::could_not_open_file;
+            found.size = static_cast<std::uint64_t>(size);
+            if (static_cast<std::size_t>(size) < trailer_size + 1)
+                return finish(read_error::archive_data_is_corrupt);
+            
+            // The chunks covering the trailer, starting on a chunk boundary,
+            // decrypt on their own just as they do at the end of the archive.
+            const std::size_t start = 
+                (static_cast<std::size_t>(size) - trailer_size) / tea::chunk_size * tea::chunk_size;
+            std::array<std::byte, trailer_size + 2 * tea::chunk_size> last;
+            const auto tail = std::span{last}.first(static_cast<std::size_t>(size) - start);
+            if (std::fseek(fp.get(), static_cast<long>(start), SEEK_SET) != 0
+                || std::fread(tail.data(), 1, tail.size(), fp.get()) != tail.size())
+                return read_error::could_not_open_file;
+            
+            cipher.decrypt(tail);
+            std::copy_n(
+                reinterpret_cast<const char*>(tail.last(trailer_size).data()),
+                trailer_size,
+                found.digest.begin());
+            
+            return finish(found.digest.back() == '\0' ? read_error::success 
+                                                      : read_error::archive_data_is_corrupt);
+        }
+        
+        const auto decoder = std::make_unique<archive_decoder>(cipher);
+        const auto window  = std::make_unique<std::byte[]>(stream_window_size);
+        for (;;)
+        {
+            const auto n = std::fread(window.get(), 1, stream_window_size, fp.get());
+            decoder->update({window.get(), n});
+            if (n < stream_window_size)
+                break;
+        }
+        if (std::ferror(fp.get()))
+            return read_error::could_not_open_file;
+        
+        archive_summary summary;
+        const auto error = decoder->finish(&summary);
+        found.size         = summary.size;
+        found.member_count = summary.member_count;
+        found.digest       = summary.digest;
+        found.computed     = summary.computed;
+        if (error == core_error::corrupt_member)
+            found.bad_header = summary.bad_header;
+        
+        return finish(error == core_error::success ? read_error::success 
+                                                   : read_error::archive_data_is_corrupt);
+    }
+    
     void archive::load_members_from(const std::span<const byte_buffer> member_bufs)
     {
         const std::size_t total_size = std::accumulate(
@@ -179,9 +341,12 @@ namespace shader_packager
         // Set members
         filebuf = std::move(buf);
         data    = filebuf.range().first(buf.nbytes - 33);
+        index_members();
     }
     
-    archive::write_error archive::flush_to_file(const char* file)
+    archive::write_error archive::flush_to_file(
+        const char*       file, 
+        const std::size_t threads)
     {
         if (data.size() < sizeof(chunk_size_type))
             return write_error::no_data_to_write;
@@ -191,39 +356,279 @@ namespace shader_packager
         if (fp == nullptr)
             return write_error::could_not_open_file;
         
-        // encrypt archive
-        encrypt_buffer(h1_tea, filebuf.range());
+        const auto error = flush_to([fp] (const std::span<const std::byte> bytes) {
+            return std::fwrite(bytes.data(), sizeof(std::byte), bytes.size(), fp) == bytes.size();
+        }, threads);
+        const bool closed = std::fclose(fp) == 0;
         
-        // write to the buffer to the file
-        std::fwrite(
-            filebuf.buffer.get(), 
-            sizeof(std::byte), filebuf.nbytes, 
-            fp);
-        std::fclose(fp);
+        if (error == write_error::success && !closed)
+            return write_error::could_not_open_file;
+        return error;
+    }
+    
+    archive::write_error archive::flush_to(
+        const archive_sink& sink, 
+        const std::size_t   threads)
+    {
+        if (data.size() < sizeof(chunk_size_type))
+            return write_error::no_data_to_write;
+        
+        // The whole archive is encrypted in place, tailing chunk included, 
+        // so every window is final.
+        cipher.encrypt(filebuf.range(), threads);
+        
+        for (auto rest = std::span<const std::byte>{filebuf.range()}; !rest.empty(); )
+        {
+            const auto window = rest.first(std::min(rest.size(), stream_window_size));
+            if (!sink(window))
+            {
+                *this = archive{};
+                return write_error::could_not_open_file;
+            }
+            rest = rest.subspan(window.size());
+        }
         
         // "flush" archive by emptying it
         *this = archive{};
         return write_error::success;
     }
     
+    std::size_t archive_window_size(const std::size_t threads) noexcept
+    {
+        return threads == 1 ? stream_window_size : 64 * stream_window_size;
+    }
+    
+    std::optional<std::size_t> flush_archive_windows(
+        const std::span<std::byte> pending,
+        const bool                 last,
+        const std::size_t          window_size,
+        const std::size_t          threads,
+        const archive_cipher&      cipher,
+        const archive_sink&        sink)
+    {
+        // Every window but the last is a whole number of chunks, so the 
+        // chunks line up with those of the complete archive. The last window 
+        // takes what is left, and at least a chunk for the tailing chunk to 
+        // overlap.
+        std::size_t flushed = 0;
+        while (flushed < pending.size())
+        {
+            const std::size_t left  = pending.size() - flushed;
+            const bool        final = last && left < window_size + cipher.chunk_size;
+            if (!final && left < window_size)
+                break;
+            
+            const auto window = pending.subspan(flushed, final ? left : window_size);
+            cipher.encrypt(window, threads);
+            if (!sink(window))
+                return std::nullopt;
+            flushed += window.size();
+        }
+        
+        return flushed;
+    }
+    
+    archive_writer::archive_writer(
+        const char*           file, 
+        const std::size_t     threads,
+        const archive_cipher& cipher)
+        : archive_writer(archive_sink{}, threads, cipher)
+    {
+        this->file = file;
+        sink = [this] (const std::span<const std::byte> bytes) {
+            if (fp == nullptr)
+                fp = std::fopen(this->file, "wb");
+            if (fp == nullptr)
+                return false;
+            return std::fwrite(bytes.data(), sizeof(std::byte), bytes.size(), fp) == bytes.size();
+        };
+    }
+    
+    archive_writer::archive_writer(
+        archive_sink          sink, 
+        const std::size_t     threads,
+        const archive_cipher& cipher)
+        : sink(std::move(sink))
+        , window_size(archive_window_size(threads))
+        , threads(threads)
+        , cipher(cipher)
+    {
+        // room for the MD5 trailer in the final window
+        window.nbytes = window_size + 33;
+        window.buffer = std::unique_ptr<std::byte[]>(new std::byte[window.nbytes]);
+    }
+    
+    archive_writer::~archive_writer()
+    {
+        if (fp != nullptr)
+            std::fclose(fp);
+    }
+    
+    bool archive_writer::flush_window(const bool last)
+    {
+        // the window is either full or the last, so it is passed on whole
+        if (!flush_archive_windows(window.range().first(fill), last, window_size, 
+                                   threads, cipher, sink))
+        {
+            failed = true;
+            return false;
+        }
+        fill = 0;
+        return true;
+    }
+    
+    bool archive_writer::append(std::span<const std::byte> bytes)
+    {
+        md5.update(bytes);
+        total += bytes.size();
+        
+        while (!bytes.empty())
+        {
+            const auto n = std::min(bytes.size(), window_size - fill);
+            std::copy_n(bytes.begin(), n, window.buffer.get() + fill);
+            fill += n;
+            bytes = bytes.subspan(n);
+            
+            if (fill == window_size && !flush_window(false))
+                return false;
+        }
+        
+        return true;
+    }
+    
+    bool archive_writer::add_member(std::span<const std::byte> member)
+    {
+        if (failed || member.size() > std::numeric_limits<chunk_size_type>::max())
+            return false;
+        
+        std::array<std::byte, sizeof(chunk_size_type)> header;
+        serialize<std::endian::little>(
+            static_cast<chunk_size_type>(member.size()), 
+            header.begin());
+        
+        return append(header) && append(member);
+    }
+    
+    bool archive_writer::add_serialized(const std::span<const std::byte> members)
+    {
+        return !failed && append(members);
+    }
+    
+    archive::write_error archive_writer::finish()
+    {
+        if (failed)
+            return archive::write_error::could_not_open_file;
+        
+        if (total < sizeof(chunk_size_type))
+            return archive::write_error::no_data_to_write;
+        
+        // The trailer always fits: fill < window_size after any append.
+        const auto md5_str = md5.finish();
+        std::copy_n(
+            reinterpret_cast<const std::byte*>(md5_str.c_str()), 
+            33, 
+            window.buffer.get() + fill);
+        fill += 33;
+        
+        if (!flush_window(true))
+            return archive::write_error::could_not_open_file;
+        
+        if (fp != nullptr)
+        {
+            const bool closed = std::fclose(fp) == 0;
+            fp = nullptr;
+            if (!closed)
+            {
+                failed = true;
+                return archive::write_error::could_not_open_file;
+            }
+        }
+        trailer = md5_str;
+        return archive::write_error::success;
+    }
+    
     archive_enumerator archive::enumerate() const noexcept
     {
         return archive_enumerator{data};
     }
     
+    std::string_view archive::digest() const noexcept
+    {
+        if (!filebuf && !mapping)
+            return {};
+        
+        // the trailer directly follows the member data
+        return {reinterpret_cast<const char*>(data.data() + data.size()), 32};
+    }
+    
+    std::optional<std::span<std::byte>> archive::member(const std::size_t index) 
+        const noexcept
+    {
+        if (index >= offsets.size())
+            return std::nullopt;
+        
+        const auto header = data.subspan(offsets[index]);
+        const auto chunk_size = 
+            deserialize<chunk_size_type, std::endian::little>(header.data());
+        return header.subspan(sizeof(chunk_size_type), chunk_size);
+    }
+    
+    std::optional<std::span<std::byte>> archive::member(const std::string_view name)
+        const noexcept
+    {
+        return member(find_name(names, name));
+    }
+    
+    void archive::index_members()
+    {
+        H1SP_STATS_SCOPE(validate, data.size());
+        
+        offsets.clear();
+        for (auto e = enumerate(); e; e.advance())
+        {
+            offsets.push_back(static_cast<std::size_t>(
+                e.data().data() - data.data()) - sizeof(chunk_size_type));
+        }
+    }
+    
     archive_enumerator::archive_enumerator(std::span<std::byte> enumerable_range) 
         noexcept
         : range(enumerable_range)
-        { }
+    {
+        read_header();
+    }
+    
+    void archive_enumerator::read_header() noexcept
+    {
+        chunk = {};
+        error = false;
+        if (range.empty())
+            return;
+        
+        // compared against what remains, so that a huge size cannot wrap
+        if (range.size() < sizeof(chunk_size_type))
+        {
+            error = true;
+            return;
+        }
+        
+        const auto chunk_size = 
+            deserialize<chunk_size_type, std::endian::little>(range.data());
+        if (chunk_size > range.size() - sizeof(chunk_size_type))
+        {
+            error = true;
+            return;
+        }
+        
+        chunk = range.subspan(sizeof(chunk_size_type), chunk_size);
+    }
     
     archive_enumerator& archive_enumerator::advance() noexcept
     {
         if (!finished())
         {
-            const auto chunk_size = 
-                deserialize<chunk_size_type, std::endian::little>(range.data());
-            range = range.last(
-                range.size() - chunk_size - sizeof(chunk_size_type));
+            range = range.subspan(sizeof(chunk_size_type) + chunk.size());
+            read_header();
         }
         
         return *this;
@@ -231,13 +636,7 @@ namespace shader_packager
     
     std::span<std::byte> archive_enumerator::data() const noexcept
     {
-        if (finished())
-            return {};
-        
-        const auto chunk_size = 
-            deserialize<chunk_size_type, std::endian::little>(range.data());
-        
-        return range.subspan(sizeof(chunk_size_type), chunk_size);
+        return chunk;
     }
     
     bool archive_enumerator::is_at_end() const noexcept
@@ -247,19 +646,7 @@ namespace shader_packager
     
     bool archive_enumerator::has_error() const noexcept
     {
-        if (is_at_end())
-            return false;
-        
-        if (range.size() < sizeof(chunk_size_type))
-            return true;
-        
-        const auto chunk_size = 
-            deserialize<chunk_size_type, std::endian::little>(range.data());
-        
-        if ((chunk_size + sizeof(chunk_size_type)) > range.size())
-            return true;
-        
-        return false;
+        return error;
     }
     
     bool archive_enumerator::finished() const noexcept
@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/archive_cache.hpp>
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+
+#include <h1sp/manifest.hpp>
+
+#if defined(_WIN32)
+    // identified by stat_file alone
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace shader_packager
+{
+    namespace
+    {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+        // Loads file into anonymous shared memory and decrypts it there, or 
+        // returns std::nullopt if no sealed shared memory could be created.
+        std::optional<archive::read_error> load_shared(
+            const char*           file,
+            const std::size_t     size,
+            const std::size_t     threads,
+            archive&              loaded,
+            std::span<std::byte>& image,
+            int&                  shared_fd)
+        {
+            if (size == 0)
+                return std::nullopt;
+
+            const int fd = ::memfd_create("h1sp-archive", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            if (fd == -1)
+                return std::nullopt;
+
+            void* const ptr = ::ftruncate(fd, static_cast<off_t>(size)) == 0
+                ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                : MAP_FAILED;
+            if (ptr == MAP_FAILED)
+            {
+                ::close(fd);
+                return std::nullopt;
+            }
+
+            const std::span<std::byte> memory{static_cast<std::byte*>(ptr), size};
+            auto buf = read_file(file, memory);
+            const auto error = buf ? loaded.read_from_buffer(std::move(buf), threads)
+                                   : archive::read_error::could_not_open_file;
+            if (error != archive::read_error::success)
+            {
+                ::munmap(ptr, size);
+                ::close(fd);
+                return error;
+            }
+
+            // The memory cannot be sealed against writes while it is mapped 
+            // writable, so the writable mapping is swapped for a placeholder,
+            // which keeps its addresses (that the archive refers to) from 
+            // being taken meanwhile, and mapped back read-only once sealed. 
+            // The seals hold for every descriptor of the memory, including 
+            // ones reopened read-write through /proc.
+            constexpr int seals = F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL;
+            const bool sealed = 
+                ::mmap(ptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED &&
+                ::fcntl(fd, F_ADD_SEALS, seals) == 0 &&
+                ::mmap(ptr, size, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+            if (!sealed)
+            {
+                ::munmap(ptr, size);
+                ::close(fd);
+                loaded = archive{};
+                return std::nullopt;
+            }
+
+            shared_fd = fd;
+            image = memory;
+            return error;
+        }
+#endif
+    }
+
+    cached_archive::~cached_archive()
+    {
+#if !defined(_WIN32)
+        if (!shared_image.empty())
+            ::munmap(shared_image.data(), shared_image.size());
+        if (shared_fd != -1)
+            ::close(shared_fd);
+#endif
+    }
+
+    archive_cache::archive_cache(const std::size_t capacity, const std::size_t threads)
+        : capacity(capacity)
+        , threads(threads)
+        { }
+
+    std::shared_ptr<const cached_archive> archive_cache::get(
+        const std::string&                 file,
+        const std::span<const char* const> names,
+        archive::read_error* const         error)
+    {
+        file_identity identity;
+        if (!identify_file(file.c_str(), identity))
+        {
+            if (error != nullptr)
+                *error = archive::read_error::could_not_open_file;
+            return {};
+        }
+
+        const auto matches = [&] (const slot& s) { return s.file == file; };
+        {
+            std::lock_guard lock{mutex};
+            const auto it = std::find_if(slots.begin(), slots.end(), matches);
+            if (it != slots.end()                   &&
+                it->names.data() == names.data()    &&
+                it->names.size() == names.size()    &&
+                it->loaded->identity == identity)
+            {
+                slots.splice(slots.begin(), slots, it);
+                return it->loaded;
+            }
+        }
+
+        // Load outside the lock, so that other archives are served meanwhile.
+        // The identity is taken first: if the file changes while it is read,
+        // the next lookup sees a newer identity and loads it again.
+        auto fresh = std::make_shared<cached_archive>();
+        fresh->identity = identity;
+        std::optional<archive::read_error> loaded;
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+        loaded = load_shared(file.c_str(), static_cast<std::size_t>(identity.size), 
+            threads, fresh->loaded, fresh->shared_image, fresh->shared_fd);
+#endif
+        if (!loaded)
+        {
+            loaded = fresh->loaded.open_mapped(file.c_str(), threads);
+            if (*loaded == archive::read_error::could_not_open_file)
+                loaded = fresh->loaded.read_from_file(file.c_str(), threads);
+        }
+        if (*loaded != archive::read_error::success)
+        {
+            if (error != nullptr)
+                *error = *loaded;
+            return {};
+        }
+        fresh->loaded.set_names(names);
+
+        std::lock_guard lock{mutex};
+        slots.remove_if(matches);
+        if (capacity != 0)
+        {
+            slots.push_front({file, names, fresh});
+            while (slots.size() > capacity)
+                slots.pop_back();
+        }
+
+        return fresh;
+    }
+
+    bool identify_file(const char* const file, file_identity& identity)
+    {
+#if defined(_WIN32)
+        const auto stamp = stat_file(file);
+        if (!stamp)
+            return false;
+
+        identity = {.size = stamp->size, .mtime = stamp->mtime};
+        return true;
+#else
+        struct ::stat st;
+        if (::stat(file, &st) != 0)
+            return false;
+
+    #if defined(__APPLE__)
+        const auto& mtime = st.st_mtimespec;
+    #else
+        const auto& mtime = st.st_mtim;
+    #endif
+        identity = {
+            .device = static_cast<std::uint64_t>(st.st_dev),
+            .inode  = static_cast<std::uint64_t>(st.st_ino),
+            .size   = static_cast<std::uint64_t>(st.st_size),
+            .mtime  = static_cast<std::int64_t>(mtime.tv_sec) * 1'000'000'000 + mtime.tv_nsec
+        };
+        return true;
+#endif
+    }
+}
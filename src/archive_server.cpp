@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "archive_server.hpp"
+
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <array>
+#include <atomic>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <h1sp/archive.hpp>
+#include <h1sp/archive_cache.hpp>
+#include <h1sp/local_server.hpp>
+
+#include "operations.hpp"
+#include "options.hpp"
+
+namespace h1sp
+{
+    namespace
+    {
+        // the server stopped by SIGINT and SIGTERM
+        std::atomic<shader_packager::local_server*> serving = nullptr;
+
+        extern "C" void stop_serving(int)
+        {
+            if (auto* const server = serving.load())
+                server->stop();
+        }
+
+        // a stream for the messages of operations nobody reads
+        std::FILE* null_stream()
+        {
+#if defined(_WIN32)
+            static std::FILE* const stream = std::fopen("NUL", "w");
+#else
+            static std::FILE* const stream = std::fopen("/dev/null", "w");
+#endif
+            return stream != nullptr ? stream : stderr;
+        }
+
+        bool handle_request(
+            shader_packager::local_connection& connection,
+            std::string&                       line,
+            shader_packager::archive_cache&    cache,
+            shader_packager::local_server&     server)
+        {
+            using namespace std::literals::string_view_literals;
+            namespace sp = shader_packager;
+
+            // Every reply is a line "ok SIZE [FIELDS...]" followed by SIZE bytes
+            // of payload, or a line "error REASON".
+            const auto fail = [&connection] (const std::string_view reason) {
+                return connection.write("error " + std::string{reason} + "\n");
+            };
+
+            std::vector<char*> args;
+            split_arguments(line, args);
+            if (args.empty())
+                return true;
+
+            const std::string_view request = args[0];
+            if (request == "shutdown"sv)
+            {
+                connection.write("ok 0\n"sv);
+                server.stop();
+                return false;
+            }
+
+            if (request == "pack"sv)
+            {
+                // the rest is one pack operation as on the command line, 
+                // without its -p
+                static char pack_mode[] = "-p";
+                std::vector<char*> operation{pack_mode};
+                operation.insert(operation.end(), args.begin() + 1, args.end());
+                operation_context              defaults = {};
+                std::vector<operation_context> ops;
+                if (parse_operations(operation, defaults, ops) != parse_status::success ||
+                    ops.size() != 1)
+                    return fail("invalid pack request");
+
+                // The server's standard output is not the client's, and the 
+                // messages of concurrent packs would interleave on it.
+                if (ops.front().file == "-"sv)
+                    return fail("cannot pack to standard output");
+                ops.front().messages = null_stream();
+                if (const char* reason = perform_operation(ops.front()))
+                    return fail(reason);
+                return connection.write("ok 0\n"sv);
+            }
+
+            // get, map and list: REQUEST {-pc|-ce} {-fx|-vsh} FILE [NAME]
+            const bool named = request == "get"sv || request == "map"sv;
+            if ((!named && request != "list"sv)                 ||
+                args.size() != (named ? 5u : 4u)                ||
+                (args[1] != "-pc"sv && args[1] != "-ce"sv)      ||
+                (args[2] != "-fx"sv && args[2] != "-vsh"sv))
+                return fail("invalid request");
+
+            const auto names = fixed_profile(args[1], args[2])->names;
+            auto error = sp::archive::read_error::success;
+            const auto loaded = cache.get(args[3], names, &error);
+            if (!loaded)
+            {
+                return fail(error == sp::archive::read_error::could_not_open_file
+                    ? "could not open file" : "archive data is corrupt");
+            }
+            const auto& archive = loaded->contents();
+
+            char status[64];
+            if (request == "list"sv)
+            {
+                std::string listing;
+                for (std::size_t i = 0; i < archive.member_count(); ++i)
+                {
+                    const char* name = i < names.size() ? names[i] : "?";
+                    listing += name;
+                    listing += ' ';
+                    listing += std::to_string(archive.member(i)->size());
+                    listing += '\n';
+                }
+                std::snprintf(status, sizeof(status), "ok %zu\n", listing.size());
+                return connection.write(status + listing);
+            }
+
+            const auto member = archive.member(std::string_view{args[4]});
+            if (!member)
+                return fail("archive has no member " + std::string{args[4]});
+
+            if (request == "map"sv)
+            {
+                // The member is mapped by the client from the server's copy of 
+                // the decrypted archive, which is passed as a sealed fd.
+                if (loaded->descriptor() == -1)
+                    return fail("archive is not in shared memory");
+                std::snprintf(status, sizeof(status), "ok 0 %llu %zu\n",
+                    static_cast<unsigned long long>(loaded->offset_of(*member)),
+                    member->size());
+                return connection.write(status, loaded->descriptor());
+            }
+
+            // the member is sent straight from the cached archive
+            std::snprintf(status, sizeof(status), "ok %zu\n", member->size());
+            const std::array<std::span<const std::byte>, 2> reply {
+                std::as_bytes(std::span{status, std::strlen(status)}),
+                *member
+            };
+            return connection.write(reply);
+        }
+    }
+
+    int serve_archives(std::span<char* const> args)
+    {
+        using namespace std::literals::string_view_literals;
+        namespace sp = shader_packager;
+
+        const char* socket_path = args[0];
+        std::size_t jobs     = 0;
+        std::size_t threads  = 1;
+        std::size_t capacity = 16;
+        for (auto it = args.begin() + 1; it != args.end(); ++it)
+        {
+            std::size_t* value = nullptr;
+            if      (*it == "--jobs"sv)  value = &jobs;
+            else if (*it == "-j"sv)      value = &threads;
+            else if (*it == "--cache"sv) value = &capacity;
+
+            if (value == nullptr || std::next(it) == args.end() || 
+                !parse_thread_count(*++it, *value))
+            {
+                std::printf("invalid server option %s\n", *it);
+                return EXIT_FAILURE;
+            }
+        }
+
+        sp::local_server server;
+        if (!server.listen(socket_path))
+            return EXIT_FAILURE;
+
+        sp::archive_cache cache{capacity, threads};
+        serving = &server;
+        std::signal(SIGINT, stop_serving);
+        std::signal(SIGTERM, stop_serving);
+
+        std::printf("serving on %s\n", socket_path);
+        std::fflush(stdout);
+        server.run(jobs, [&cache, &server] (auto& connection, auto& request) {
+            return handle_request(connection, request, cache, server);
+        });
+
+        serving = nullptr;
+        return EXIT_SUCCESS;
+    }
+}
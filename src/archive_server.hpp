@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_ARCHIVE_SERVER_HPP
+#define H1SP_ARCHIVE_SERVER_HPP
+
+#include <span>
+
+namespace h1sp
+{
+    /**
+     * \brief Serves archive requests on the Unix domain socket \a args[0] 
+     *        until a `shutdown` request or a termination signal, with the 
+     *        options in the rest of \a args.
+     */
+    int serve_archives(std::span<char* const> args);
+}
+
+#endif // H1SP_ARCHIVE_SERVER_HPP
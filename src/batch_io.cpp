@@ -0,0 +1,465 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/batch_io.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <future>
+#include <limits>
+#include <vector>
+
+#include <h1sp/archive.hpp>
+#include <h1sp/stats.hpp>
+#include <h1sp/thread_pool.hpp>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#elif defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #define H1SP_IO_URING 1
+    #include <cerrno>
+
+    #include <fcntl.h>
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace shader_packager
+{
+    namespace
+    {
+        // O_DIRECT and FILE_FLAG_NO_BUFFERING need the data, offset and
+        // length to be multiples of the logical block size; the page size
+        // covers every common device.
+        constexpr std::size_t direct_alignment = 4096;
+
+        bool is_direct_aligned(const void* p) noexcept
+        {
+            return reinterpret_cast<std::uintptr_t>(p) % direct_alignment == 0;
+        }
+
+        std::size_t write_files_stdio(
+            const std::span<const file_write> writes,
+            const batch_write_options&        options)
+        {
+            std::vector<std::future<bool>> written;
+            written.reserve(writes.size());
+            {
+                thread_pool pool{options.jobs};
+                for (const auto& w : writes)
+                    written.push_back(pool.submit([&w] { return write_file(w.path, w.data); }));
+            }
+
+            const auto first_failed = std::find_if(written.begin(), written.end(),
+                [] (auto& f) { return !f.get(); });
+            return static_cast<std::size_t>(first_failed - written.begin());
+        }
+
+#if defined(_WIN32)
+        std::size_t write_files_overlapped(
+            const std::span<const file_write> writes,
+            const batch_write_options&        options)
+        {
+            // Stay well below the handle and outstanding I/O limits by
+            // writing in waves.
+            constexpr std::size_t wave_size = 64;
+
+            std::size_t first_failed = writes.size();
+            for (std::size_t first = 0; first < writes.size(); first += wave_size)
+            {
+                const auto wave = writes.subspan(first, std::min(wave_size, writes.size() - first));
+
+                struct pending
+                {
+                    HANDLE     file  = INVALID_HANDLE_VALUE;
+                    OVERLAPPED ov    = {};
+                    bool       ok    = false;
+                };
+                std::vector<pending> pendings(wave.size());
+
+                for (std::size_t i = 0; i < wave.size(); ++i)
+                {
+                    const auto& w = wave[i];
+                    auto&       p = pendings[i];
+
+                    // unbuffered writes must be whole sectors, so only files
+                    // that are can skip the cache
+                    const bool direct = options.direct
+                                     && is_direct_aligned(w.data.data())
+                                     && w.data.size() % direct_alignment == 0;
+                    p.file = CreateFileA(
+                        w.path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED
+                            | (direct ? FILE_FLAG_NO_BUFFERING : 0),
+                        nullptr);
+                    if (p.file == INVALID_HANDLE_VALUE)
+                        continue;
+
+                    p.ov.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+                    if (p.ov.hEvent == nullptr)
+                        continue;
+
+                    p.ok = WriteFile(p.file, w.data.data(), static_cast<DWORD>(w.data.size()),
+                                     nullptr, &p.ov)
+                        || GetLastError() == ERROR_IO_PENDING;
+                }
+
+                for (std::size_t i = 0; i < wave.size(); ++i)
+                {
+                    auto& p = pendings[i];
+                    if (p.ok)
+                    {
+                        DWORD written = 0;
+                        p.ok = GetOverlappedResult(p.file, &p.ov, &written, TRUE)
+                            && written == wave[i].data.size();
+                    }
+
+                    if (p.ov.hEvent != nullptr)
+                        CloseHandle(p.ov.hEvent);
+                    if (p.file != INVALID_HANDLE_VALUE)
+                        CloseHandle(p.file);
+
+                    if (!p.ok && first_failed == writes.size())
+                        first_failed = first + i;
+                }
+            }
+
+            return first_failed;
+        }
+#endif // _WIN32
+
+#if H1SP_IO_URING
+        /**
+         * \brief A minimal io_uring instance, set up with raw system calls so
+         *        that liburing is not required.
+         */
+        class uring
+        {
+            int           ring_fd = -1;
+            void*         sq_ring = MAP_FAILED;
+            std::size_t   sq_ring_size = 0;
+            void*         cq_ring = MAP_FAILED;
+            std::size_t   cq_ring_size = 0;
+            io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+            std::size_t   sqes_size = 0;
+
+            unsigned* sq_head;
+            unsigned* sq_tail;
+            unsigned* sq_mask;
+            unsigned* sq_array;
+            unsigned  sq_entries = 0;
+            unsigned* cq_head;
+            unsigned* cq_tail;
+            unsigned* cq_mask;
+            io_uring_cqe* cqes;
+
+            unsigned to_submit = 0;
+
+            template<typename T>
+            static T* at(void* ring, const std::uint32_t offset) noexcept
+            {
+                return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+            }
+
+        public:
+            explicit uring(const unsigned entries) noexcept
+            {
+                io_uring_params params;
+                std::memset(&params, 0, sizeof(params));
+                ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+                if (ring_fd < 0)
+                    return;
+
+                sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                if (params.features & IORING_FEAT_SINGLE_MMAP)
+                    sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+                sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+                if (sq_ring == MAP_FAILED)
+                    return;
+
+                if (params.features & IORING_FEAT_SINGLE_MMAP)
+                {
+                    cq_ring = sq_ring;
+                } else
+                {
+                    cq_ring = ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+                    if (cq_ring == MAP_FAILED)
+                        return;
+                }
+
+                sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+                sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqes_size,
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd, IORING_OFF_SQES));
+                if (sqes == MAP_FAILED)
+                    return;
+
+                sq_head    = at<unsigned>(sq_ring, params.sq_off.head);
+                sq_tail    = at<unsigned>(sq_ring, params.sq_off.tail);
+                sq_mask    = at<unsigned>(sq_ring, params.sq_off.ring_mask);
+                sq_array   = at<unsigned>(sq_ring, params.sq_off.array);
+                sq_entries = params.sq_entries;
+                cq_head    = at<unsigned>(cq_ring, params.cq_off.head);
+                cq_tail    = at<unsigned>(cq_ring, params.cq_off.tail);
+                cq_mask    = at<unsigned>(cq_ring, params.cq_off.ring_mask);
+                cqes       = at<io_uring_cqe>(cq_ring, params.cq_off.cqes);
+            }
+
+            uring(const uring&) = delete;
+            uring& operator=(const uring&) = delete;
+
+            ~uring()
+            {
+                if (sqes != MAP_FAILED)
+                    ::munmap(sqes, sqes_size);
+                if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+                    ::munmap(cq_ring, cq_ring_size);
+                if (sq_ring != MAP_FAILED)
+                    ::munmap(sq_ring, sq_ring_size);
+                if (ring_fd >= 0)
+                    ::close(ring_fd);
+            }
+
+            explicit operator bool() const noexcept { return sqes != MAP_FAILED; }
+
+            unsigned capacity() const noexcept { return sq_entries; }
+
+            /**
+             * \brief Queues a write of \a len bytes at \a offset to \a fd.
+             */
+            void push_write(
+                const int           fd,
+                const void* const   buf,
+                const unsigned      len,
+                const std::uint64_t offset,
+                const std::uint64_t user_data) noexcept
+            {
+                const unsigned tail  = *sq_tail;
+                const unsigned index = tail & *sq_mask;
+
+                io_uring_sqe& sqe = sqes[index];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode    = IORING_OP_WRITE;
+                sqe.fd        = fd;
+                sqe.addr      = reinterpret_cast<std::uint64_t>(buf);
+                sqe.len       = len;
+                sqe.off       = offset;
+                sqe.user_data = user_data;
+
+                sq_array[index] = index;
+                __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+                ++to_submit;
+            }
+
+            /**
+             * \brief Submits the queued writes and waits for at least one
+             *        completion.
+             *
+             * \return \c true on success, otherwise \c false.
+             */
+            bool submit_and_wait() noexcept
+            {
+                for (;;)
+                {
+                    const long submitted = ::syscall(__NR_io_uring_enter, ring_fd,
+                        to_submit, 1u, IORING_ENTER_GETEVENTS, nullptr, 0);
+                    if (submitted >= 0)
+                    {
+                        to_submit -= static_cast<unsigned>(submitted);
+                        return true;
+                    }
+                    if (errno != EINTR)
+                        return false;
+                }
+            }
+
+            /**
+             * \brief Calls \a f with the user data and result of each
+             *        completed write.
+             */
+            template<typename F>
+            void reap(F&& f)
+            {
+                unsigned head = *cq_head;
+                const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+                for (; head != tail; ++head)
+                {
+                    const io_uring_cqe& cqe = cqes[head & *cq_mask];
+                    f(cqe.user_data, cqe.res);
+                }
+                __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            }
+        };
+
+        /**
+         * \brief Writes the files through \a ring.
+         */
+        std::size_t write_files_uring(
+            uring&                            ring,
+            const std::span<const file_write> writes,
+            const batch_write_options&        options)
+        {
+            struct pending
+            {
+                int           fd     = -1;
+                std::uint64_t done   = 0;     ///< Bytes written so far.
+                std::uint64_t limit  = 0;     ///< End of the current phase.
+                bool          failed = false;
+            };
+            std::vector<pending>     pendings(writes.size());
+            std::vector<std::size_t> ready;
+            ready.reserve(writes.size());
+
+            for (std::size_t i = 0; i < writes.size(); ++i)
+            {
+                const auto& w = writes[i];
+                auto&       p = pendings[i];
+                const int   flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+                // The aligned body of a file is written with O_DIRECT first,
+                // then the flag is dropped for the remainder.
+                const std::size_t body = w.data.size() / direct_alignment * direct_alignment;
+                if (options.direct && body != 0 && is_direct_aligned(w.data.data()))
+                {
+                    p.fd    = ::open(w.path, flags | O_DIRECT, 0644);
+                    p.limit = body;
+                }
+                if (p.fd < 0)
+                {
+                    p.fd    = ::open(w.path, flags, 0644);
+                    p.limit = w.data.size();
+                }
+
+                if (p.fd < 0)
+                    p.failed = true;
+                else if (w.data.empty())
+                    continue;
+                else
+                    ready.push_back(i);
+            }
+
+            // Keep the ring full; each completion either finishes a file,
+            // moves it to its next phase or resubmits the rest of a short
+            // write.
+            constexpr std::uint64_t max_write = 1u << 30;
+            std::size_t in_flight = 0;
+            bool        ring_ok   = true;
+            while (ring_ok && (!ready.empty() || in_flight != 0))
+            {
+                while (!ready.empty() && in_flight < ring.capacity())
+                {
+                    const std::size_t i = ready.back();
+                    ready.pop_back();
+
+                    const auto& p = pendings[i];
+                    ring.push_write(
+                        p.fd,
+                        writes[i].data.data() + p.done,
+                        static_cast<unsigned>(std::min(p.limit - p.done, max_write)),
+                        p.done,
+                        i);
+                    ++in_flight;
+                }
+
+                // writes the rest of file i through the page cache
+                auto leave_direct = [&] (const std::size_t i) {
+                    auto& p = pendings[i];
+                    const int flags = ::fcntl(p.fd, F_GETFL);
+                    if (flags == -1 || ::fcntl(p.fd, F_SETFL, flags & ~O_DIRECT) == -1)
+                    {
+                        p.failed = true;
+                        return;
+                    }
+                    p.limit = writes[i].data.size();
+                    ready.push_back(i);
+                };
+
+                ring_ok = ring.submit_and_wait();
+                ring.reap([&] (const std::uint64_t i, const int res) {
+                    --in_flight;
+                    auto& p = pendings[i];
+                    const bool direct = p.limit != writes[i].data.size();
+                    if (res == -EINTR || res == -EAGAIN)
+                    {
+                        ready.push_back(i);
+                    } else if (res == -EINVAL && direct)
+                    {
+                        // the device needs a stricter alignment
+                        leave_direct(i);
+                    } else if (res <= 0)
+                    {
+                        p.failed = true;
+                    } else
+                    {
+                        p.done += static_cast<std::uint64_t>(res);
+                        if (p.done < p.limit)
+                            ready.push_back(i);
+                        else if (direct)
+                            leave_direct(i);
+                    }
+                });
+            }
+
+            std::size_t first_failed = writes.size();
+            for (std::size_t i = 0; i < writes.size(); ++i)
+            {
+                auto& p = pendings[i];
+                if (p.fd >= 0 && ::close(p.fd) != 0)
+                    p.failed = true;
+
+                const bool complete = p.done == writes[i].data.size();
+                if ((p.failed || !complete) && first_failed == writes.size())
+                    first_failed = i;
+            }
+
+            return first_failed;
+        }
+#endif // H1SP_IO_URING
+    }
+
+    batch_io_backend preferred_batch_io_backend() noexcept
+    {
+#if defined(_WIN32)
+        return batch_io_backend::overlapped;
+#elif H1SP_IO_URING
+        return batch_io_backend::io_uring;
+#else
+        return batch_io_backend::stdio;
+#endif
+    }
+
+    std::size_t write_files(
+        const std::span<const file_write> writes,
+        const batch_write_options&        options)
+    {
+        if (writes.empty())
+            return 0;
+
+#if H1SP_ENABLE_STATS
+        std::uint64_t total = 0;
+        for (const auto& write : writes)
+            total += write.data.size();
+        H1SP_STATS_SCOPE(batch_write, total);
+#endif
+
+#if defined(_WIN32)
+        return write_files_overlapped(writes, options);
+#elif H1SP_IO_URING
+        constexpr std::size_t max_entries = 256;
+        uring ring{static_cast<unsigned>(std::min(writes.size(), max_entries))};
+        if (ring)
+            return write_files_uring(ring, writes, options);
+#endif
+
+        return write_files_stdio(writes, options);
+    }
+}
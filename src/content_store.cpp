@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/content_store.hpp>
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <h1sp/archive.hpp>
+#include <h1sp/crypt.hpp>
+
+#if defined(__linux__)
+    #include <fcntl.h>
+    #include <linux/fs.h>
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+#endif
+
+namespace shader_packager
+{
+    namespace
+    {
+        struct file_closer
+        {
+            void operator()(std::FILE* fp) const noexcept { std::fclose(fp); }
+        };
+
+        using file_ptr = std::unique_ptr<std::FILE, file_closer>;
+
+        constexpr const char* index_magic = "h1sp-cas-index 1";
+
+        // Clones source to target, sharing its extents; fails where the 
+        // filesystem cannot.
+        bool reflink(const std::filesystem::path& source, const std::filesystem::path& target)
+        {
+#if defined(__linux__) && defined(FICLONE)
+            const int src = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+            if (src == -1)
+                return false;
+
+            const int dst = ::open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (dst == -1)
+            {
+                ::close(src);
+                return false;
+            }
+
+            const bool cloned = ::ioctl(dst, FICLONE, src) == 0;
+            ::close(dst);
+            ::close(src);
+            if (!cloned)
+                ::unlink(target.c_str());
+
+            return cloned;
+#else
+            (void)source;
+            (void)target;
+            return false;
+#endif
+        }
+    }
+
+    content_store::content_store(std::filesystem::path root)
+        : root(std::move(root))
+        { }
+
+    std::filesystem::path content_store::object_path(const std::string_view digest) const
+    {
+        // fan out over 256 directories to keep each one small
+        return root / digest.substr(0, 2) / digest.substr(2);
+    }
+
+    bool content_store::put(
+        const std::string_view           digest, 
+        const std::span<const std::byte> data) const
+    {
+        const auto object = object_path(digest);
+
+        // An object is only reused if it still holds the data it is named
+        // by; one that was edited, e.g. through a hard link by a tool that
+        // ignores its permissions, is replaced.
+        std::error_code ec;
+        if (std::filesystem::exists(object, ec))
+        {
+            if (std::filesystem::file_size(object, ec) == data.size() && !ec)
+            {
+                const auto contents = read_file(object.string().c_str());
+                if (contents && compute_md5_digest(contents.range()) == digest)
+                    return true;
+            }
+
+            std::filesystem::permissions(object, std::filesystem::perms::owner_write,
+                std::filesystem::perm_options::add, ec);
+            std::filesystem::remove(object, ec);
+        }
+
+        std::filesystem::create_directories(object.parent_path(), ec);
+        if (ec)
+            return false;
+
+        auto temp = object;
+        temp += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        if (!write_file(temp.string().c_str(), data))
+            return false;
+
+        // Objects are read-only, and so are the member files hard-linked to
+        // them, so that editing a member file in place does not edit the
+        // object under every other member file linked to it.
+        using std::filesystem::perms;
+        std::filesystem::permissions(temp, perms::owner_read | perms::group_read | perms::others_read, ec);
+        if (!ec)
+            std::filesystem::rename(temp, object, ec);
+        if (ec)
+        {
+            std::filesystem::remove(temp, ec);
+            return false;
+        }
+
+        return true;
+    }
+
+    std::optional<content_store::link_kind> content_store::link(
+        const std::string_view       digest, 
+        const std::filesystem::path& target) const
+    {
+        return link_file(object_path(digest), target);
+    }
+
+    std::optional<content_store::link_kind> link_file(
+        const std::filesystem::path& source, 
+        const std::filesystem::path& target)
+    {
+        using link_kind = content_store::link_kind;
+
+        std::error_code ec;
+        std::filesystem::remove(target, ec);
+
+        if (reflink(source, target))
+            return link_kind::reflink;
+
+        std::filesystem::create_hard_link(source, target, ec);
+        if (!ec)
+            return link_kind::hardlink;
+
+        // a copy is a file of its own, so it need not be read-only
+        std::filesystem::copy_file(source, target, ec);
+        if (!ec)
+        {
+            std::filesystem::permissions(target, std::filesystem::perms::owner_write,
+                std::filesystem::perm_options::add, ec);
+            return link_kind::copy;
+        }
+
+        return std::nullopt;
+    }
+
+    const content_index::entry* content_index::find(const std::string_view name) const noexcept
+    {
+        const auto it = std::find_if(entries.begin(), entries.end(),
+            [name] (const entry& e) { return e.name == name; });
+        return it != entries.end() ? &*it : nullptr;
+    }
+
+    void content_index::assign(entry e)
+    {
+        const auto it = std::find_if(entries.begin(), entries.end(),
+            [&e] (const entry& other) { return other.name == e.name; });
+        if (it != entries.end())
+            *it = std::move(e);
+        else
+            entries.push_back(std::move(e));
+    }
+
+    std::optional<content_index> content_index::read_from_file(const char* file)
+    {
+        const file_ptr fp{std::fopen(file, "r")};
+        if (!fp)
+            return std::nullopt;
+
+        char magic[32] = {};
+        if (std::fscanf(fp.get(), "%31[^\n]\n", magic) != 1 ||
+            std::string_view{magic} != index_magic)
+            return std::nullopt;
+
+        content_index result {};
+        for (;;)
+        {
+            entry e {};
+            char hash[33] = {};
+            char name[256] = {};
+            const int fields = std::fscanf(fp.get(),
+                "%" SCNu64 " %" SCNd64 " %32s %255s\n",
+                &e.stamp.size, &e.stamp.mtime, hash, name);
+            if (fields == EOF)
+                break;
+            if (fields != 4)
+                return std::nullopt;
+
+            e.hash = hash;
+            e.name = name;
+            result.entries.push_back(std::move(e));
+        }
+
+        return result;
+    }
+
+    bool content_index::write_to_file(const char* file) const
+    {
+        const file_ptr fp{std::fopen(file, "w")};
+        if (!fp)
+            return false;
+
+        std::fprintf(fp.get(), "%s\n", index_magic);
+
+        for (const auto& e : entries)
+        {
+            std::fprintf(fp.get(), "%" PRIu64 " %" PRId64 " %s %s\n",
+                e.stamp.size, e.stamp.mtime, e.hash.c_str(), e.name.c_str());
+        }
+
+        return std::fflush(fp.get()) == 0 && std::ferror(fp.get()) == 0;
+    }
+}
@@ -0,0 +1,349 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/core.hpp>
+
+#include <cstdint>
+
+#include <algorithm>
+#include <limits>
+#include <string_view>
+
+#include <h1sp/crypt.hpp>
+#include <h1sp/io.hpp>
+#include <h1sp/stats.hpp>
+
+namespace shader_packager
+{
+    namespace
+    {
+        using chunk_size_type = std::uint32_t;
+
+        // The MD5 digest in lowercase hex, plus its null terminator.
+        constexpr std::size_t trailer_size = 33;
+
+        // A window of this many bytes is decrypted, hashed and scanned before
+        // moving on to the next, so that it is still in L1/L2 for each step.
+        constexpr std::size_t stream_window_size = 64 * 1024;
+        static_assert(stream_window_size % tea::chunk_size == 0);
+    }
+
+    void member_header_scanner::feed(const std::span<const std::byte> data) noexcept
+    {
+        H1SP_STATS_SCOPE(validate, data.size());
+        
+        const std::uint64_t begin = fed;
+        const std::uint64_t end   = fed + data.size();
+        fed = end;
+
+        // next_header + header_fill >= begin: the bytes of a header that 
+        // started before data were collected from the data supplied before
+        while (next_header < end)
+        {
+            const std::uint64_t from = next_header + header_fill;
+            const std::size_t   n    = static_cast<std::size_t>(
+                std::min<std::uint64_t>(header.size() - header_fill, end - from));
+            std::copy_n(data.begin() + (from - begin), n, header.begin() + header_fill);
+            header_fill += n;
+            if (header_fill < header.size())
+                break;
+
+            const auto chunk_size = 
+                deserialize<chunk_size_type, std::endian::little>(header.data());
+            header_fill = 0;
+            last_header = next_header;
+            next_header += chunk_size + sizeof(chunk_size_type);
+            ++members;
+        }
+    }
+
+    bool member_header_scanner::finish(
+        std::size_t* const   member_count,
+        std::uint64_t* const bad_header) const noexcept
+    {
+        // A header past the end of the data is bad, as is one that runs 
+        // past it; a bad header is never followed by another.
+        std::size_t   count = members;
+        std::uint64_t bad   = next_header;
+        if (next_header > fed)
+        {
+            --count;
+            bad = last_header;
+        }
+
+        if (member_count != nullptr)
+            *member_count = count;
+        if (bad_header != nullptr && next_header != fed)
+            *bad_header = bad;
+
+        return next_header == fed;
+    }
+
+    void archive_decoder::consume(
+        std::span<const std::byte> encrypted,
+        const data_sink            sink,
+        void* const                context)
+    {
+        while (!encrypted.empty())
+        {
+            const std::size_t n = std::min(encrypted.size(), buffer.size() - fill);
+            std::copy_n(encrypted.begin(), n, buffer.begin() + fill);
+            fill  += n;
+            total += n;
+            encrypted = encrypted.subspan(n);
+
+            if (fill == buffer.size())
+                drain(false, sink, context);
+        }
+    }
+
+    void archive_decoder::drain(const bool final, const data_sink sink, void* const context)
+    {
+        // The encrypted bytes start on a chunk boundary. Chunk j is not 
+        // overlapped by the tail chunk once 8j + 16 bytes have arrived.
+        const std::size_t encrypted = fill - plain;
+        std::size_t decryptable = 0;
+        if (final)
+            decryptable = encrypted >= tea::chunk_size ? encrypted : 0;
+        else if (encrypted >= 2 * tea::chunk_size)
+            decryptable = (encrypted - tea::chunk_size) / tea::chunk_size * tea::chunk_size;
+
+        cipher.decrypt(std::span{buffer}.subspan(plain, decryptable));
+        plain += decryptable;
+
+        // everything but what may be the trailer is member data
+        const std::size_t data = plain > trailer_size ? plain - trailer_size : 0;
+        if (data != 0)
+        {
+            const auto piece = std::span<const std::byte>{buffer}.first(data);
+            md5.update(piece);
+            scanner.feed(piece);
+            if (sink != nullptr)
+                sink(context, piece);
+
+            std::copy(buffer.begin() + data, buffer.begin() + fill, buffer.begin());
+            fill  -= data;
+            plain -= data;
+        }
+    }
+
+    core_error archive_decoder::conclude(archive_summary* const summary) noexcept
+    {
+        archive_summary result {.size = total};
+
+        if (total < trailer_size + 1)
+        {
+            if (summary != nullptr)
+                *summary = result;
+            return core_error::archive_too_small;
+        }
+
+        // the trailer is all that is left
+        std::copy_n(
+            reinterpret_cast<const char*>(buffer.data()), 
+            trailer_size, 
+            result.digest.begin());
+        md5.finish(result.computed);
+        const bool members_ok = scanner.finish(&result.member_count, &result.bad_header);
+
+        if (summary != nullptr)
+            *summary = result;
+
+        if (result.digest != result.computed)
+            return core_error::digest_mismatch;
+
+        if (!members_ok)
+            return core_error::corrupt_member;
+
+        return core_error::success;
+    }
+
+    core_error decrypt_archive_in_place(
+        const std::span<std::byte> buf,
+        archive_view* const        view,
+        const std::size_t          threads,
+        const archive_cipher&      cipher) noexcept
+    {
+        // Strictly speaking, this should be < 33, but Halo requires the
+        // archive to be non-empty, even if its just one byte.
+        // The stored MD5 hash is null-terminated, and Halo checks for that
+        // null-terminator.
+        if (buf.size() < trailer_size + 1)
+            return core_error::archive_too_small;
+
+        const auto archive_data = buf.first(buf.size() - trailer_size);
+        const auto archive_md5 = std::string_view(
+            reinterpret_cast<const char*>(buf.last(trailer_size).data()),
+            trailer_size);
+
+        // Decrypt the buffer, hash the archive data and validate the member
+        // headers in a single pass over cache-sized windows.
+        // The tailing chunk must be decrypted before the whole chunks (see
+        // decrypt_buffer); with threads, the whole buffer is decrypted up
+        // front instead and only hashing and validation are windowed.
+        md5_context           md5;
+        member_header_scanner scanner;
+        {
+            const auto chunk_size = cipher.chunk_size;
+            const auto whole_size = buf.size() - (buf.size() % chunk_size);
+
+            if (threads != 1)
+                cipher.decrypt(buf, threads);
+            else if (whole_size != buf.size())
+                cipher.decrypt(buf.last(chunk_size));
+
+            for (std::size_t offset = 0; offset < whole_size; )
+            {
+                const auto window = buf.subspan(
+                    offset, std::min(stream_window_size, whole_size - offset));
+
+                if (threads == 1)
+                    cipher.decrypt(window);
+
+                offset += window.size();
+
+                if (window.data() < archive_data.data() + archive_data.size())
+                {
+                    const auto data = window.first(std::min(
+                        window.size(), archive_data.size() - (offset - window.size())));
+                    md5.update(data);
+                    scanner.feed(data);
+                }
+            }
+        }
+
+        archive_view result {
+            .data   = archive_data,
+            .digest = archive_md5.substr(0, trailer_size - 1)
+        };
+        const bool members_ok = scanner.finish(&result.member_count);
+        md5.finish(result.computed);
+        if (view != nullptr)
+            *view = result;
+
+        // we need to ensure the null terminator is there, so we compare all
+        // 33 characters
+        if (archive_md5 != std::string_view{result.computed.data(), trailer_size})
+            return core_error::digest_mismatch;
+
+        if (!members_ok)
+            return core_error::corrupt_member;
+
+        return core_error::success;
+    }
+
+    void decrypt_archives_in_place(
+        const std::span<const std::span<std::byte>> bufs,
+        const std::span<core_error>                 results,
+        const archive_cipher&                       cipher) noexcept
+    {
+        // Archives are decrypted and scanned one at a time, then hashed in 
+        // groups of at most max_group, so no storage needs to be allocated.
+        constexpr std::size_t max_group = 16;
+
+        for (std::size_t first = 0; first < bufs.size(); first += max_group)
+        {
+            const auto group = bufs.subspan(first, std::min(max_group, bufs.size() - first));
+
+            std::array<std::span<const std::byte>, max_group> hashed;
+            std::array<std::size_t, max_group>               hashed_index;
+            std::size_t count = 0;
+            for (std::size_t i = 0; i < group.size(); ++i)
+            {
+                const auto buf = group[i];
+                auto&      result = results[first + i];
+                if (buf.size() < trailer_size + 1)
+                {
+                    result = core_error::archive_too_small;
+                    continue;
+                }
+
+                cipher.decrypt(buf);
+
+                const auto archive_data = buf.first(buf.size() - trailer_size);
+                member_header_scanner scanner;
+                scanner.feed(archive_data);
+                result = scanner.finish() ? core_error::success
+                                          : core_error::corrupt_member;
+
+                hashed[count]       = archive_data;
+                hashed_index[count] = i;
+                ++count;
+            }
+
+            std::array<std::array<char, trailer_size>, max_group> computed;
+            compute_md5_digests(
+                std::span{hashed}.first(count),
+                std::span{computed}.first(count));
+
+            // as in decrypt_archive_in_place, a bad digest is reported first
+            for (std::size_t j = 0; j < count; ++j)
+            {
+                const auto buf = group[hashed_index[j]];
+                const auto archive_md5 = std::string_view(
+                    reinterpret_cast<const char*>(buf.last(trailer_size).data()),
+                    trailer_size);
+                if (archive_md5 != std::string_view{computed[j].data(), trailer_size})
+                    results[first + hashed_index[j]] = core_error::digest_mismatch;
+            }
+        }
+    }
+
+    std::size_t required_size(
+        const std::span<const std::span<const std::byte>> members) noexcept
+    {
+        std::size_t size = trailer_size;
+        for (const auto& member : members)
+            size += sizeof(chunk_size_type) + member.size();
+
+        return size;
+    }
+
+    core_error pack_into(
+        const std::span<std::byte>                        out,
+        const std::span<const std::span<const std::byte>> members,
+        std::size_t* const                                written,
+        const archive_cipher&                             cipher) noexcept
+    {
+        if (members.empty())
+            return core_error::no_members;
+
+        const bool too_large = std::any_of(members.begin(), members.end(),
+            [] (const auto& member) {
+                return member.size() > std::numeric_limits<chunk_size_type>::max();
+            });
+        if (too_large)
+            return core_error::member_too_large;
+
+        const std::size_t size = required_size(members);
+        if (out.size() < size)
+            return core_error::buffer_too_small;
+
+        // Lay out the plaintext archive, then encrypt it in place.
+        std::byte* cursor = out.data();
+        for (const auto& member : members)
+        {
+            cursor = serialize<std::endian::little>(
+                static_cast<chunk_size_type>(member.size()),
+                cursor);
+            cursor = std::copy(member.begin(), member.end(), cursor);
+        }
+
+        const auto archive_data = out.first(size - trailer_size);
+
+        md5_context md5;
+        md5.update(archive_data);
+        std::array<char, trailer_size> digest;
+        md5.finish(digest);
+        std::copy_n(
+            reinterpret_cast<const std::byte*>(digest.data()),
+            trailer_size,
+            cursor);
+
+        cipher.encrypt(out.first(size));
+
+        if (written != nullptr)
+            *written = size;
+
+        return core_error::success;
+    }
+}
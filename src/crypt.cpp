@@ -11,8 +11,6 @@
 #include <limits>
 #include <stdexcept>
 
-#include <openssl/md5.h>
-
 static_assert(
     CHAR_BIT == 8,
     "I pity whoever has to fix this project when this assertion fails."
@@ -77,29 +75,4 @@ void tea::decrypt_chunk(std::byte* chunk) const noexcept
     serialize(v1, chunk + sizeof(v0), endian);
 }
 
-std::string compute_md5_digest(std::span<const std::byte> buf)
-{
-    const auto len = buf.size();
-    if (len > std::numeric_limits<unsigned long>::max())
-        throw std::range_error("buffer length could not be represented as ulong");
-    
-    unsigned char digest[MD5_DIGEST_LENGTH] = {};
-    (void)MD5(
-        reinterpret_cast<const unsigned char*>(buf.data()), 
-        static_cast<unsigned long>(len), 
-        digest);
-    
-    std::string result = "";
-    result.reserve(sizeof("abcdefghijklmnopqrstuvwxyz012345"));
-    
-    for (const auto& d : digest)
-    {
-        char strbuf[3] = {};
-        std::snprintf(strbuf, std::size(strbuf), "%02hhx", d);
-        result += std::string_view{strbuf, 2};
-    }
-    
-    return result;
-}
-
 } // namespace shader_packager
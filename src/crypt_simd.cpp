@@ -0,0 +1,494 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/crypt.hpp>
+
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    #define H1SP_SIMD_X86 1
+    #define H1SP_SIMD_X86_DISPATCH 1
+    #define H1SP_TARGET(isa) __attribute__((target(isa)))
+    #include <immintrin.h>
+#elif defined(_M_X64)
+    // MSVC: SSE2 is part of the x64 baseline; there is no portable way to
+    // compile the wider kernels without /arch, so only SSE2 is provided.
+    #define H1SP_SIMD_X86 1
+    #define H1SP_TARGET(isa)
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON)
+    #define H1SP_SIMD_NEON 1
+    #include <arm_neon.h>
+#endif
+
+// Layout notes:
+//  A run of chunks is a sequence of (v0, v1) pairs of 32-bit words. The x86
+//  kernels load two registers worth of chunks, [x0 y0 x1 y1 ...], shuffle
+//  each 128-bit lane into [x0 x1 y0 y1] and then use unpack{lo,hi}_epi64 to
+//  split them into one register of v0 words and one of v1 words. The lane
+//  order that falls out of this differs between the register widths, but
+//  since every lane is independent, only the inverse sequence on the way out
+//  matters.
+//  NEON has a de-interleaving load (vld2q), so no shuffles are needed there.
+
+namespace shader_packager
+{
+
+namespace
+{
+    constexpr std::uint32_t tea_delta = 0x9E3779B9;
+    constexpr std::uint32_t tea_decrypt_sum = 0xC6EF3720;
+
+    void encrypt_scalar(const tea& t, std::byte* p, std::size_t count) noexcept
+    {
+        for (; count > 0; --count, p += tea::chunk_size)
+            t.encrypt_chunk(p);
+    }
+
+    void decrypt_scalar(const tea& t, std::byte* p, std::size_t count) noexcept
+    {
+        for (; count > 0; --count, p += tea::chunk_size)
+            t.decrypt_chunk(p);
+    }
+
+#if H1SP_SIMD_X86
+    H1SP_TARGET("sse2")
+    void encrypt_sse2(const tea& t, std::byte* p, std::size_t count) noexcept
+    {
+        const __m128i k0 = _mm_set1_epi32(static_cast<int>(t.key[0]));
+        const __m128i k1 = _mm_set1_epi32(static_cast<int>(t.key[1]));
+        const __m128i k2 = _mm_set1_epi32(static_cast<int>(t.key[2]));
+        const __m128i k3 = _mm_set1_epi32(static_cast<int>(t.key[3]));
+        const __m128i delta = _mm_set1_epi32(static_cast<int>(tea_delta));
+
+        for (; count >= 4; count -= 4, p += 4 * tea::chunk_size)
+        {
+            auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+            a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+            b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+            auto v0 = _mm_unpacklo_epi64(a, b);
+            auto v1 = _mm_unpackhi_epi64(a, b);
+
+            auto sum = _mm_setzero_si128();
+            for (int i = 0; i < 32; ++i)
+            {
+                sum = _mm_add_epi32(sum, delta);
+                v0 = _mm_add_epi32(v0, _mm_xor_si128(
+                    _mm_xor_si128(
+                        _mm_add_epi32(_mm_slli_epi32(v1, 4), k0),
+                        _mm_add_epi32(v1, sum)),
+                    _mm_add_epi32(_mm_srli_epi32(v1, 5), k1)));
+                v1 = _mm_add_epi32(v1, _mm_xor_si128(
+                    _mm_xor_si128(
+                        _mm_add_epi32(_mm_slli_epi32(v0, 4), k2),
+                        _mm_add_epi32(v0, sum)),
+                    _mm_add_epi32(_mm_srli_epi32(v0, 5), k3)));
+            }
+
+            a = _mm_shuffle_epi32(_mm_unpacklo_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+            b = _mm_shuffle_epi32(_mm_unpackhi_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 16), b);
+        }
+
+        encrypt_scalar(t, p, count);
+    }
+
+    H1SP_TARGET("sse2")
+    void decrypt_sse2(const tea& t, std::byte* p, std::size_t count) noexcept
+    {
+        const __m128i k0 = _mm_set1_epi32(static_cast<int>(t.key[0]));
+        const __m128i k1 = _mm_set1_epi32(static_cast<int>(t.key[1]));
+        const __m128i k2 = _mm_set1_epi32(static_cast<int>(t.key[2]));
+        const __m128i k3 = _mm_set1_epi32(static_cast<int>(t.key[3]));
+        const __m128i delta = _mm_set1_epi32(static_cast<int>(tea_delta));
+
+        for (; count >= 4; count -= 4, p += 4 * tea::chunk_size)
+        {
+            auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+            a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+            b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+            auto v0 = _mm_unpacklo_epi64(a, b);
+            auto v1 = _mm_unpackhi_epi64(a, b);
+
+            auto sum = _mm_set1_epi32(static_cast<int>(tea_decrypt_sum));
+            for (int i = 0; i < 32; ++i)
+            {
+                v1 = _mm_sub_epi32(v1, _mm_xor_si128(
+                    _mm_xor_si128(
+                        _mm_add_epi32(_mm_slli_epi32(v0, 4), k2),
+                        _mm_add_epi32(v0, sum)),
+                    _mm_add_epi32(_mm_srli_epi32(v0, 5), k3)));
+                v0 = _mm_sub_epi32(v0, _mm_xor_si128(
+                    _mm_xor_si128(
+                        _mm_add_epi32(_mm_slli_epi32(v1, 4), k0),
+                        _mm_add_epi32(v1, sum)),
+                    _mm_add_epi32(_mm_srli_epi32(v1, 5), k1)));
+                sum = _mm_sub_epi32(sum, delta);
+            }
+
+            a = _mm_shuffle_epi32(_mm_unpacklo_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+            b = _mm_shuffle_epi32(_mm_unpackhi_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 16), b);
+        }
+
+        decrypt_scalar(t, p, count);
+    }
+#endif // H1SP_SIMD_X86
+
+#if H1SP_SIMD_X86_DISPATCH
+    H1SP_TARGET("avx2")
+    void encrypt_avx2(const tea& t, std::byte* p, std::size_t count) noexcept
+    {
+        const __m256i k0 = _mm256_set1_epi32(static_cast<int>(t.key[0]));
+        const __m256i k1 = _mm256_set1_epi32(static_cast<int>(t.key[1]));
+        const __m256i k2 = _mm256_set1_epi32(static_cast<int>(t.key[2]));
+        const __m256i k3 = _mm256_set1_epi32(static_cast<int>(t.key[3]));
+        const __m256i delta = _mm256_set1_epi32(static_cast<int>(tea_delta));
+
+        for (; count >= 8; count -= 8, p += 8 * tea::chunk_size)
+        {
+            auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+            a = _mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+            b = _mm256_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+            auto v0 = _mm256_unpacklo_epi64(a, b);
+            auto v1 = _mm256_unpackhi_epi64(a, b);
+
+            auto sum = _mm256_setzero_si256();
+            for (int i = 0; i < 32; ++i)
+            {
+                sum = _mm256_add_epi32(sum, delta);
+                v0 = _mm256_add_epi32(v0, _mm256_xor_si256(
+                    _mm256_xor_si256(
+                        _mm256_add_epi32(_mm256_slli_epi32(v1, 4), k0),
+                        _mm256_add_epi32(v1, sum)),
+                    _mm256_add_epi32(_mm256_srli_epi32(v1, 5), k1)));
+                v1 = _mm256_add_epi32(v1, _mm256_xor_si256(
+                    _mm256_xor_si256(
+                        _mm256_add_epi32(_mm256_slli_epi32(v0, 4), k2),
+                        _mm256_add_epi32(v0, sum)),
+                    _mm256_add_epi32(_mm256_srli_epi32(v0, 5), k3)));
+            }
+
+            a = _mm256_shuffle_epi32(_mm256_unpacklo_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+            b = _mm256_shuffle_epi32(_mm256_unpackhi_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + 32), b);
+        }
+
+        encrypt_scalar(t, p, count);
+    }
+
+    H1SP_TARGET("avx2")
+    void decrypt_avx2(const tea& t, std::byte* p, std::size_t count) noexcept
+    {
+        const __m256i k0 = _mm256_set1_epi32(static_cast<int>(t.key[0]));
+        const __m256i k1 = _mm256_set1_epi32(static_cast<int>(t.key[1]));
+        const __m256i k2 = _mm256_set1_epi32(static_cast<int>(t.key[2]));
+        const __m256i k3 = _mm256_set1_epi32(static_cast<int>(t.key[3]));
+        const __m256i delta = _mm256_set1_epi32(static_cast<int>(tea_delta));
+
+        for (; count >= 8; count -= 8, p += 8 * tea::chunk_size)
+        {
+            auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+            a = _mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+            b = _mm256_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+            auto v0 = _mm256_unpacklo_epi64(a, b);
+            auto v1 = _mm256_unpackhi_epi64(a, b);
+
+            auto sum = _mm256_set1_epi32(static_cast<int>(tea_decrypt_sum));
+            for (int i = 0; i < 32; ++i)
+            {
+                v1 = _mm256_sub_epi32(v1, _mm256_xor_si256(
+                    _mm256_xor_si256(
+                        _mm256_add_epi32(_mm256_slli_epi32(v0, 4), k2),
+                        _mm256_add_epi32(v0, sum)),
+                    _mm256_add_epi32(_mm256_srli_epi32(v0, 5), k3)));
+                v0 = _mm256_sub_epi32(v0, _mm256_xor_si256(
+                    _mm256_xor_si256(
+                        _mm256_add_epi32(_mm256_slli_epi32(v1, 4), k0),
+                        _mm256_add_epi32(v1, sum)),
+                    _mm256_add_epi32(_mm256_srli_epi32(v1, 5), k1)));
+                sum = _mm256_sub_epi32(sum, delta);
+            }
+
+            a = _mm256_shuffle_epi32(_mm256_unpacklo_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+            b = _mm256_shuffle_epi32(_mm256_unpackhi_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + 32), b);
+        }
+
+        decrypt_scalar(t, p, count);
+    }
+
+    constexpr auto avx512_deinterleave =
+        static_cast<_MM_PERM_ENUM>(_MM_SHUFFLE(3, 1, 2, 0));
+
+    H1SP_TARGET("avx512f")
+    void encrypt_avx512(const tea& t, std::byte* p, std::size_t count) noexcept
+    {
+        const __m512i k0 = _mm512_set1_epi32(static_cast<int>(t.key[0]));
+        const __m512i k1 = _mm512_set1_epi32(static_cast<int>(t.key[1]));
+        const __m512i k2 = _mm512_set1_epi32(static_cast<int>(t.key[2]));
+        const __m512i k3 = _mm512_set1_epi32(static_cast<int>(t.key[3]));
+        const __m512i delta = _mm512_set1_epi32(static_cast<int>(tea_delta));
+
+        for (; count >= 16; count -= 16, p += 16 * tea::chunk_size)
+        {
+            auto a = _mm512_loadu_si512(p);
+            auto b = _mm512_loadu_si512(p + 64);
+            a = _mm512_shuffle_epi32(a, avx512_deinterleave);
+            b = _mm512_shuffle_epi32(b, avx512_deinterleave);
+            auto v0 = _mm512_unpacklo_epi64(a, b);
+            auto v1 = _mm512_unpackhi_epi64(a, b);
+
+            auto sum = _mm512_setzero_si512();
+            for (int i = 0; i < 32; ++i)
+            {
+                sum = _mm512_add_epi32(sum, delta);
+                v0 = _mm512_add_epi32(v0, _mm512_xor_si512(
+                    _mm512_xor_si512(
+                        _mm512_add_epi32(_mm512_slli_epi32(v1, 4), k0),
+                        _mm512_add_epi32(v1, sum)),
+                    _mm512_add_epi32(_mm512_srli_epi32(v1, 5), k1)));
+                v1 = _mm512_add_epi32(v1, _mm512_xor_si512(
+                    _mm512_xor_si512(
+                        _mm512_add_epi32(_mm512_slli_epi32(v0, 4), k2),
+                        _mm512_add_epi32(v0, sum)),
+                    _mm512_add_epi32(_mm512_srli_epi32(v0, 5), k3)));
+            }
+
+            a = _mm512_shuffle_epi32(_mm512_unpacklo_epi64(v0, v1), avx512_deinterleave);
+            b = _mm512_shuffle_epi32(_mm512_unpackhi_epi64(v0, v1), avx512_deinterleave);
+            _mm512_storeu_si512(p, a);
+            _mm512_storeu_si512(p + 64, b);
+        }
+
+        encrypt_scalar(t, p, count);
+    }
+
+    H1SP_TARGET("avx512f")
+    void decrypt_avx512(const tea& t, std::byte* p, std::size_t count) noexcept
+    {
+        const __m512i k0 = _mm512_set1_epi32(static_cast<int>(t.key[0]));
+        const __m512i k1 = _mm512_set1_epi32(static_cast<int>(t.key[1]));
+        const __m512i k2 = _mm512_set1_epi32(static_cast<int>(t.key[2]));
+        const __m512i k3 = _mm512_set1_epi32(static_cast<int>(t.key[3]));
+        const __m512i delta = _mm512_set1_epi32(static_cast<int>(tea_delta));
+
+        for (; count >= 16; count -= 16, p += 16 * tea::chunk_size)
+        {
+            auto a = _mm512_loadu_si512(p);
+            auto b = _mm512_loadu_si512(p + 64);
+            a = _mm512_shuffle_epi32(a, avx512_deinterleave);
+            b = _mm512_shuffle_epi32(b, avx512_deinterleave);
+            auto v0 = _mm512_unpacklo_epi64(a, b);
+            auto v1 = _mm512_unpackhi_epi64(a, b);
+
+            auto sum = _mm512_set1_epi32(static_cast<int>(tea_decrypt_sum));
+            for (int i = 0; i < 32; ++i)
+            {
+                v1 = _mm512_sub_epi32(v1, _mm512_xor_si512(
+                    _mm512_xor_si512(
+                        _mm512_add_epi32(_mm512_slli_epi32(v0, 4), k2),
+                        _mm512_add_epi32(v0, sum)),
+                    _mm512_add_epi32(_mm512_srli_epi32(v0, 5), k3)));
+                v0 = _mm512_sub_epi32(v0, _mm512_xor_si512(
+                    _mm512_xor_si512(
+                        _mm512_add_epi32(_mm512_slli_epi32(v1, 4), k0),
+                        _mm512_add_epi32(v1, sum)),
+                    _mm512_add_epi32(_mm512_srli_epi32(v1, 5), k1)));
+                sum = _mm512_sub_epi32(sum, delta);
+            }
+
+            a = _mm512_shuffle_epi32(_mm512_unpacklo_epi64(v0, v1), avx512_deinterleave);
+            b = _mm512_shuffle_epi32(_mm512_unpackhi_epi64(v0, v1), avx512_deinterleave);
+            _mm512_storeu_si512(p, a);
+            _mm512_storeu_si512(p + 64, b);
+        }
+
+        decrypt_scalar(t, p, count);
+    }
+#endif // H1SP_SIMD_X86_DISPATCH
+
+#if H1SP_SIMD_NEON
+    void encrypt_neon(const tea& t, std::byte* p, std::size_t count) noexcept
+    {
+        const uint32x4_t k0 = vdupq_n_u32(t.key[0]);
+        const uint32x4_t k1 = vdupq_n_u32(t.key[1]);
+        const uint32x4_t k2 = vdupq_n_u32(t.key[2]);
+        const uint32x4_t k3 = vdupq_n_u32(t.key[3]);
+        const uint32x4_t delta = vdupq_n_u32(tea_delta);
+
+        for (; count >= 4; count -= 4, p += 4 * tea::chunk_size)
+        {
+            auto v = vld2q_u32(reinterpret_cast<const std::uint32_t*>(p));
+            auto sum = vdupq_n_u32(0);
+            for (int i = 0; i < 32; ++i)
+            {
+                sum = vaddq_u32(sum, delta);
+                v.val[0] = vaddq_u32(v.val[0], veorq_u32(
+                    veorq_u32(
+                        vaddq_u32(vshlq_n_u32(v.val[1], 4), k0),
+                        vaddq_u32(v.val[1], sum)),
+                    vaddq_u32(vshrq_n_u32(v.val[1], 5), k1)));
+                v.val[1] = vaddq_u32(v.val[1], veorq_u32(
+                    veorq_u32(
+                        vaddq_u32(vshlq_n_u32(v.val[0], 4), k2),
+                        vaddq_u32(v.val[0], sum)),
+                    vaddq_u32(vshrq_n_u32(v.val[0], 5), k3)));
+            }
+            vst2q_u32(reinterpret_cast<std::uint32_t*>(p), v);
+        }
+
+        encrypt_scalar(t, p, count);
+    }
+
+    void decrypt_neon(const tea& t, std::byte* p, std::size_t count) noexcept
+    {
+        const uint32x4_t k0 = vdupq_n_u32(t.key[0]);
+        const uint32x4_t k1 = vdupq_n_u32(t.key[1]);
+        const uint32x4_t k2 = vdupq_n_u32(t.key[2]);
+        const uint32x4_t k3 = vdupq_n_u32(t.key[3]);
+        const uint32x4_t delta = vdupq_n_u32(tea_delta);
+
+        for (; count >= 4; count -= 4, p += 4 * tea::chunk_size)
+        {
+            auto v = vld2q_u32(reinterpret_cast<const std::uint32_t*>(p));
+            auto sum = vdupq_n_u32(tea_decrypt_sum);
+            for (int i = 0; i < 32; ++i)
+            {
+                v.val[1] = vsubq_u32(v.val[1], veorq_u32(
+                    veorq_u32(
+                        vaddq_u32(vshlq_n_u32(v.val[0], 4), k2),
+                        vaddq_u32(v.val[0], sum)),
+                    vaddq_u32(vshrq_n_u32(v.val[0], 5), k3)));
+                v.val[0] = vsubq_u32(v.val[0], veorq_u32(
+                    veorq_u32(
+                        vaddq_u32(vshlq_n_u32(v.val[1], 4), k0),
+                        vaddq_u32(v.val[1], sum)),
+                    vaddq_u32(vshrq_n_u32(v.val[1], 5), k1)));
+                sum = vsubq_u32(sum, delta);
+            }
+            vst2q_u32(reinterpret_cast<std::uint32_t*>(p), v);
+        }
+
+        decrypt_scalar(t, p, count);
+    }
+#endif // H1SP_SIMD_NEON
+
+    using kernel = void (*)(const tea&, std::byte*, std::size_t) noexcept;
+
+    simd_isa resolve(const simd_tea& t) noexcept
+    {
+        if (t.scalar.endian != std::endian::native)
+            return simd_isa::scalar;
+
+        if (t.isa != simd_isa::automatic && is_simd_isa_supported(t.isa))
+            return t.isa;
+
+        return detect_simd_isa();
+    }
+
+    kernel encrypt_kernel(simd_isa isa) noexcept
+    {
+        switch (isa)
+        {
+#if H1SP_SIMD_X86_DISPATCH
+        case simd_isa::avx512: return encrypt_avx512;
+        case simd_isa::avx2:   return encrypt_avx2;
+#endif
+#if H1SP_SIMD_X86
+        case simd_isa::sse2:   return encrypt_sse2;
+#endif
+#if H1SP_SIMD_NEON
+        case simd_isa::neon:   return encrypt_neon;
+#endif
+        default:               return encrypt_scalar;
+        }
+    }
+
+    kernel decrypt_kernel(simd_isa isa) noexcept
+    {
+        switch (isa)
+        {
+#if H1SP_SIMD_X86_DISPATCH
+        case simd_isa::avx512: return decrypt_avx512;
+        case simd_isa::avx2:   return decrypt_avx2;
+#endif
+#if H1SP_SIMD_X86
+        case simd_isa::sse2:   return decrypt_sse2;
+#endif
+#if H1SP_SIMD_NEON
+        case simd_isa::neon:   return decrypt_neon;
+#endif
+        default:               return decrypt_scalar;
+        }
+    }
+}
+
+bool is_simd_isa_supported(simd_isa isa) noexcept
+{
+    switch (isa)
+    {
+    case simd_isa::automatic:
+    case simd_isa::scalar:
+        return true;
+#if H1SP_SIMD_X86_DISPATCH
+    case simd_isa::sse2:   return __builtin_cpu_supports("sse2");
+    case simd_isa::avx2:   return __builtin_cpu_supports("avx2");
+    case simd_isa::avx512: return __builtin_cpu_supports("avx512f");
+#elif H1SP_SIMD_X86
+    case simd_isa::sse2:   return true;
+#endif
+#if H1SP_SIMD_NEON
+    case simd_isa::neon:   return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+simd_isa detect_simd_isa() noexcept
+{
+    static const simd_isa best = [] {
+        for (auto isa : {simd_isa::avx512, simd_isa::avx2, simd_isa::sse2, simd_isa::neon})
+        {
+            if (is_simd_isa_supported(isa))
+                return isa;
+        }
+        return simd_isa::scalar;
+    }();
+
+    return best;
+}
+
+const char* simd_isa_name(simd_isa isa) noexcept
+{
+    switch (isa)
+    {
+    case simd_isa::automatic: return "automatic";
+    case simd_isa::scalar:    return "scalar";
+    case simd_isa::sse2:      return "sse2";
+    case simd_isa::avx2:      return "avx2";
+    case simd_isa::avx512:    return "avx512";
+    case simd_isa::neon:      return "neon";
+    default:                  return "unknown";
+    }
+}
+
+void simd_tea::encrypt_chunks(std::byte* chunks, std::size_t count) const noexcept
+{
+    encrypt_kernel(resolve(*this))(scalar, chunks, count);
+}
+
+void simd_tea::decrypt_chunks(std::byte* chunks, std::size_t count) const noexcept
+{
+    decrypt_kernel(resolve(*this))(scalar, chunks, count);
+}
+
+} // namespace shader_packager
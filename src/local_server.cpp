@@ -0,0 +1,328 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/local_server.hpp>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include <h1sp/thread_pool.hpp>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+namespace shader_packager
+{
+#if defined(_WIN32)
+    local_connection::~local_connection() = default;
+
+    bool local_connection::has_line() const noexcept { return false; }
+
+    bool local_connection::read_line(std::string&) { return false; }
+
+    bool local_connection::write(std::span<const std::span<const std::byte>>, int)
+        { return false; }
+
+    local_server::~local_server() = default;
+
+    bool local_server::listen(const char*)
+    {
+        std::puts("local servers are not supported on this platform\n");
+        return false;
+    }
+
+    void local_server::run(std::size_t, const handler&) { }
+
+    void local_server::wake() noexcept { }
+
+    void local_server::stop() noexcept { }
+#else
+    namespace
+    {
+    #if defined(MSG_NOSIGNAL)
+        constexpr int send_flags = MSG_NOSIGNAL;
+    #else
+        constexpr int send_flags = 0;
+    #endif
+
+        constexpr std::size_t max_line_size = 64 * 1024;
+    }
+
+    local_connection::~local_connection()
+    {
+        if (fd != -1)
+            ::close(fd);
+    }
+
+    bool local_connection::has_line() const noexcept
+    {
+        return pending.find('\n') != std::string::npos;
+    }
+
+    bool local_connection::read_line(std::string& line)
+    {
+        for (std::size_t scanned = 0; ; )
+        {
+            const auto end = pending.find('\n', scanned);
+            if (end != std::string::npos)
+            {
+                line.assign(pending, 0, end);
+                pending.erase(0, end + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                return true;
+            }
+            if (pending.size() > max_line_size)
+                return false;
+            scanned = pending.size();
+
+            char buf[4096];
+            const auto n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            pending.append(buf, static_cast<std::size_t>(n));
+        }
+    }
+
+    bool local_connection::write(
+        const std::span<const std::span<const std::byte>> pieces,
+        int                                               descriptor)
+    {
+        std::vector<::iovec> iov;
+        iov.reserve(pieces.size());
+        for (const auto& piece : pieces)
+        {
+            if (!piece.empty())
+                iov.push_back({const_cast<std::byte*>(piece.data()), piece.size()});
+        }
+
+        // The pieces are sent straight from where they are, resuming after 
+        // partial sends; the descriptor goes with the first of them.
+        alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+        auto next = iov.begin();
+        while (next != iov.end())
+        {
+            ::msghdr msg {};
+            msg.msg_iov    = &*next;
+            msg.msg_iovlen = static_cast<decltype(msg.msg_iovlen)>(
+                std::min<std::size_t>(iov.end() - next, IOV_MAX));
+            if (descriptor != -1)
+            {
+                std::memset(control, 0, sizeof(control));
+                msg.msg_control    = control;
+                msg.msg_controllen = sizeof(control);
+                auto* const cmsg = CMSG_FIRSTHDR(&msg);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type  = SCM_RIGHTS;
+                cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+                std::memcpy(CMSG_DATA(cmsg), &descriptor, sizeof(int));
+            }
+
+            auto sent = ::sendmsg(fd, &msg, send_flags);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent <= 0)
+                return false;
+            descriptor = -1;
+
+            for (; next != iov.end() && static_cast<std::size_t>(sent) >= next->iov_len; ++next)
+                sent -= static_cast<decltype(sent)>(next->iov_len);
+            if (next != iov.end())
+            {
+                next->iov_base = static_cast<char*>(next->iov_base) + sent;
+                next->iov_len -= static_cast<std::size_t>(sent);
+            }
+        }
+
+        return true;
+    }
+
+    local_server::~local_server()
+    {
+        if (listen_fd != -1)
+        {
+            ::close(listen_fd);
+            ::unlink(path.c_str());
+        }
+        for (const int fd : wake_fds)
+        {
+            if (fd != -1)
+                ::close(fd);
+        }
+    }
+
+    bool local_server::listen(const char* const socket_path)
+    {
+        ::sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        if (std::strlen(socket_path) >= sizeof(addr.sun_path))
+        {
+            std::printf("socket path %s is too long\n", socket_path);
+            return false;
+        }
+        std::strcpy(addr.sun_path, socket_path);
+
+        if (::pipe(wake_fds) != 0)
+        {
+            std::perror("failed to create pipe");
+            return false;
+        }
+        for (const int fd : wake_fds)
+        {
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+
+        // only ever replace a socket, e.g. one left by a server that was killed
+        struct ::stat st;
+        if (::lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+            ::unlink(socket_path);
+
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1)
+        {
+            std::perror("failed to create socket");
+            return false;
+        }
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (::bind(fd, reinterpret_cast<const ::sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(fd, SOMAXCONN) != 0)
+        {
+            std::perror("failed to listen on socket");
+            ::close(fd);
+            return false;
+        }
+
+        listen_fd = fd;
+        path      = socket_path;
+        return true;
+    }
+
+    void local_server::run(const std::size_t threads, const handler& on_request)
+    {
+        thread_pool pool{threads};
+
+        // Hands a connection with a request waiting to the pool, which 
+        // returns it to the idle ones once it has no more waiting.
+        const auto serve = [&] (std::shared_ptr<local_connection> connection) {
+            const int fd = connection->descriptor();
+            {
+                std::lock_guard lock{mutex};
+                active.insert(fd);
+            }
+            pool.submit([this, &on_request, connection = std::move(connection), fd] {
+                bool open = true;
+                std::string request;
+                do
+                {
+                    open = connection->read_line(request) && on_request(*connection, request);
+                } while (open && connection->has_line() && !stopping);
+
+                std::lock_guard lock{mutex};
+                active.erase(fd);
+                if (open && !stopping)
+                {
+                    idle.push_back(connection);
+                    wake();
+                }
+            });
+        };
+
+        std::vector<std::shared_ptr<local_connection>> watched;
+        std::vector<::pollfd>                          polled;
+        while (!stopping)
+        {
+            {
+                std::lock_guard lock{mutex};
+                std::move(idle.begin(), idle.end(), std::back_inserter(watched));
+                idle.clear();
+            }
+
+            polled.assign({{listen_fd, POLLIN, 0}, {wake_fds[0], POLLIN, 0}});
+            for (const auto& connection : watched)
+                polled.push_back({connection->descriptor(), POLLIN, 0});
+
+            if (::poll(polled.data(), static_cast<::nfds_t>(polled.size()), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                std::perror("failed to wait for requests");
+                break;
+            }
+
+            if (polled[1].revents != 0)
+            {
+                char drained[64];
+                while (::read(wake_fds[0], drained, sizeof(drained)) > 0)
+                    { }
+            }
+
+            if (stopping)
+                break;
+
+            auto kept = watched.begin();
+            for (std::size_t i = 0; i < watched.size(); ++i)
+            {
+                if (polled[i + 2].revents != 0)
+                    serve(std::move(watched[i]));
+                else
+                    *kept++ = std::move(watched[i]);
+            }
+            watched.erase(kept, watched.end());
+
+            if ((polled[0].revents & POLLIN) != 0)
+            {
+                const int fd = ::accept(listen_fd, nullptr, nullptr);
+                if (fd != -1)
+                {
+                    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+                    watched.push_back(std::make_shared<local_connection>(fd));
+                } else if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN)
+                {
+                    std::perror("failed to accept connection");
+                    break;
+                }
+            }
+        }
+
+        // wake the requests waiting for the rest of their line, which the 
+        // pool then waits for
+        std::lock_guard lock{mutex};
+        for (const int fd : active)
+            ::shutdown(fd, SHUT_RD);
+    }
+
+    void local_server::wake() noexcept
+    {
+        const char byte = 0;
+        (void)!::write(wake_fds[1], &byte, 1);
+    }
+
+    void local_server::stop() noexcept
+    {
+        stopping = true;
+        wake();
+    }
+#endif
+
+    bool local_connection::write(const std::string_view text, const int descriptor)
+    {
+        const std::span<const std::byte> piece{
+            reinterpret_cast<const std::byte*>(text.data()), text.size()
+        };
+        return write(std::span{&piece, 1}, descriptor);
+    }
+}
@@ -5,8 +5,36 @@ USAGE
   h1sp {-h|--help}
   h1sp {-u|--unpack} {-pc|-ce} {-fx|-vsh} INPUT_FILE [PREFIX] 
     Unpack the shader archive INPUT_FILE by writing each member to files prefixed with PREFIX.
+    An INPUT_FILE of - reads the archive from standard input as it arrives.
   h1sp {-p|--pack} {-pc|-ce} {-fx|-vsh} OUTPUT_FILE [PREFIX]
     Creates a shader archive OUTPUT_FILE by packing members located via PREFIX.
+    An OUTPUT_FILE of - writes the archive to standard output as it is packed;
+    the messages of every operation then go to standard error.
+  h1sp --batch JOB_FILE [OPTIONS]
+    Performs the operations listed in JOB_FILE, one per line.
+  h1sp --pack-all OUTDIR [OPTIONS]
+    Packs all four archives, OUTDIR/{pc,ce}/{fx,vsh}.bin, from fx/ and vsh/
+    concurrently, reading each member file once for all of them.
+  h1sp {-v|--verify} FILE...
+    Checks that each shader archive FILE is intact, as Halo would.
+  h1sp --digest FILE...
+    Prints the MD5 digest stored in each shader archive FILE, unchecked.
+  h1sp --list FILE [--json] [--hash] [-j N]
+    Lists the index, offset, size and name of each member of the shader
+    archive FILE, and its stored digest; --hash adds the MD5 digest of each
+    member, computed across -j threads, and --json prints it all as JSON.
+  h1sp --diff OLD NEW [PATCH]
+    Lists the members of the shader archive NEW that differ from those of OLD,
+    by index and name; if PATCH is given, writes a patch holding just those.
+  h1sp --apply OLD PATCH OUT
+    Writes the shader archive OUT that results from applying PATCH to OLD,
+    copying the unchanged members from OLD.
+  h1sp --serve SOCKET [--jobs N] [--cache N] [-j N]
+    Serves requests for archive members on the Unix domain socket SOCKET,
+    keeping the archives requested decrypted in memory.
+  
+  Several operations may also be given on one command line, one after the
+  other; they are performed concurrently and must not depend on each other.
   
   OPTIONS
      -pc indicates that the shader archive is for the retail client.
@@ -15,63 +43,194 @@ USAGE
         PREFIX defaults to "fx/".
      -vsh indicates that the shader archive is a vertex shaders archive.
         PREFIX defaults to "vsh/".
+     --profile PROFILE reads the archive format from the profile file
+        PROFILE: its member names, their file extension and default PREFIX
+        and its cipher key. Operations may then leave out {-pc|-ce}
+        {-fx|-vsh}, as in -u --profile mod.profile INPUT_FILE [PREFIX].
+     -j N encrypts/decrypts the archive using up to N threads.
+        0 uses one thread per hardware thread. Defaults to 1.
+     --io-jobs N reads or writes up to N member files concurrently.
+        0 uses one per hardware thread. Defaults to 8.
+     --incremental records the packed members in OUTPUT_FILE.manifest and,
+        if that manifest and OUTPUT_FILE are already present, only re-reads
+        the member files that changed since and only re-encrypts the archive
+        from the first changed member onwards.
+     --only NAME[,NAME...] unpacks only the named members. Each NAME may be
+        a glob pattern, where * matches any run of characters and ? matches
+        any single character, e.g. environment_texture_*.
+     --cas DIR stores each unpacked member once in the content store DIR,
+        by its MD5 digest, and makes the member files links to it. Packing
+        with --cas DIR reads the member files that are unchanged since from
+        the store instead.
+     --direct-io writes the unpacked members with O_DIRECT (unbuffered on
+        Windows) where their alignment allows, bypassing the page cache.
+     --dedupe, when unpacking, hashes the members across -j threads and
+        writes each distinct member once; the files of members with the
+        same data are links to the first one's file, as with --cas, and are
+        listed as duplicates.
+     --atomic, when unpacking from standard input, writes each member to
+        a .partial file and only renames them to the member files once the
+        whole archive has checked out; otherwise the members are written as
+        they arrive and left in place if the archive turns out corrupt.
+     --batch JOB_FILE reads the operations from JOB_FILE. Each line holds
+        one operation and its own options, as on the command line; options
+        given with --batch apply to every line. Empty lines and lines
+        starting with # are ignored, and "..." quotes an argument.
+     --jobs N performs up to N operations concurrently. 0 uses one per
+        hardware thread. Defaults to 0.
+     --stats[=json] prints the bytes handled and the wall and CPU time
+        spent in each stage, per member and in total, once the operations
+        are done. Requires a build with H1SP_ENABLE_STATS.
+  
+  SERVER
+     Each request is a line of arguments, quoted as in a JOB_FILE:
+       get {-pc|-ce} {-fx|-vsh} FILE NAME   replies with member NAME of FILE.
+       map {-pc|-ce} {-fx|-vsh} FILE NAME   passes a descriptor of sealed,
+         read-only shared memory holding the decrypted FILE (Linux only),
+         replying with the offset and size of member NAME in it.
+       list {-pc|-ce} {-fx|-vsh} FILE       replies with the name and size
+         of each member, one per line.
+       pack {-pc|-ce} {-fx|-vsh} FILE [PREFIX] [OPTIONS]  packs FILE as -p
+         would, printing nothing; FILE cannot be -.
+       shutdown                             stops the server.
+     Each reply is a line "ok SIZE [OFFSET SIZE]" followed by SIZE bytes,
+     or a line "error REASON". An archive is reloaded once its file
+     changes. --jobs N handles up to N requests at once (0 uses one per
+     hardware thread, the default), --cache N keeps up to N archives
+     loaded (16 by default) and -j N decrypts each with up to N threads.
 */
 
-#include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 
 #include <array>
 #include <algorithm>
-#include <memory>
+#include <deque>
+#include <iterator>
+#include <future>
+#include <filesystem>
+#include <numeric>
+#include <string>
 #include <string_view>
+#include <system_error>
+#include <vector>
 
 #include <h1sp/archive.hpp>
-#include <h1sp/crypt.hpp>
+#include <h1sp/io.hpp>
+#include <h1sp/manifest.hpp>
 #include <h1sp/names.hpp>
+#include <h1sp/patch.hpp>
+#include <h1sp/profile.hpp>
+#include <h1sp/stats.hpp>
+#include <h1sp/thread_pool.hpp>
+
+#include "archive_server.hpp"
+#include "member_file_cache.hpp"
+#include "operations.hpp"
+#include "options.hpp"
 
 namespace 
 {
-    enum class client_version {unspecified, pc, ce};
-    enum class archive_type {unspecified, fx, vsh};
-    enum class operation_mode {unspecified, unpack, pack};
-    
-    struct operation_context
-    {
-        operation_mode mode;   ///< The operation to perform.
-        client_version client; ///< The client version of the archive.
-        archive_type   type;   ///< The archive type.
-        const char*    file;   ///< The file to operate on.
-        const char*    prefix; ///< A file prefix for the operation.
-    };
-    
-    enum class unpack_error
-    {
-        success,
-        could_not_read,
-        corrupted_data
-    };
+    using h1sp::hash_members;
+    using h1sp::member_file_cache;
+    using h1sp::operation_context;
+    using h1sp::operation_mode;
+    using h1sp::parse_operations;
+    using h1sp::parse_status;
+    using h1sp::parse_thread_count;
+    using h1sp::perform_operation;
+    using h1sp::serve_archives;
+    using h1sp::split_arguments;
+    using h1sp::writes_stdout;
     
     const char* binpath = "h1sp";
     
     void print_usage();
     
     /**
-     * \brief Performs an archive operation using the given parameters.
+     * \brief Reads the jobs of a batch file, one operation group (and its 
+     *        options) per line. Empty lines and lines starting with `#` are 
+     *        ignored.
      *
-     * \return `nullptr` on success, or a null-terminated string on error that
-     *         indicates the reason for failure.
+     * \param [in]  file     The batch file.
+     * \param [in]  defaults Option values for options a job does not give.
+     * \param [out] lines    Receives the storage for the jobs' arguments.
+     * \param [out] ops      Receives the parsed jobs.
+     * \return \c true on success, otherwise \c false after printing why.
      */
-    const char* perform_operation(const operation_context& op);
+    bool read_batch_file(
+        const char*                     file,
+        const operation_context&        defaults,
+        std::deque<std::string>&        lines,
+        std::vector<operation_context>& ops);
+    
+    /**
+     * \brief Plans a pack of every archive variant into \a dir, as 
+     *        `dir/{pc,ce}/{fx,vsh}.bin`, creating the directories.
+     *
+     * The operations run as a batch does, so each member file is read once
+     * however many of the archives it is packed into.
+     *
+     * \param [in]  dir      The output directory.
+     * \param [in]  defaults Option values for the pack operations.
+     * \param [out] lines    Receives the storage for the operations' arguments.
+     * \param [out] ops      Receives the pack operations.
+     * \return \c true on success, otherwise \c false after printing why.
+     */
+    bool plan_pack_all(
+        const char*                     dir,
+        const operation_context&        defaults,
+        std::deque<std::string>&        lines,
+        std::vector<operation_context>& ops);
+    
+    /**
+     * \brief Performs \a ops, running up to \a jobs of them concurrently 
+     *        (0 for one per hardware thread) when there is more than one.
+     *
+     * \return `EXIT_SUCCESS` if every operation succeeded, otherwise 
+     *         `EXIT_FAILURE`.
+     */
+    int run_operations(std::span<const operation_context> ops, std::size_t jobs);
+    
+    /**
+     * \brief Checks that each archive in \a files is intact, as loading it 
+     *        would, printing a line with the result for each.
+     *
+     * \return `EXIT_SUCCESS` if every archive is intact, otherwise 
+     *         `EXIT_FAILURE`.
+     */
+    int verify_archives(std::span<char* const> files);
+    
+    /**
+     * \brief Prints the digest stored in each archive in \a files.
+     */
+    int print_digests(std::span<char* const> files);
+    
+    /**
+     * \brief Prints the members that differ between the archives \a args[0]
+     *        and \a args[1], writing a patch for them to \a args[2] if given.
+     */
+    int diff_archives(std::span<char* const> args);
+    
+    /**
+     * \brief Applies the patch \a args[1] to the archive \a args[0], writing
+     *        the result to \a args[2].
+     */
+    int apply_patch(std::span<char* const> args);
+    
+    /**
+     * \brief Lists the members of the archive in \a args, with the options
+     *        in the rest of \a args.
+     */
+    int list_archive(std::span<char* const> args);
 }
 
 int main(int argc, char* argv[])
 {
     using namespace std::literals::string_view_literals;
     
-    operation_context op = {};
-    
     if (argc >= 1)
         binpath = argv[0];
     
@@ -79,241 +238,741 @@ int main(int argc, char* argv[])
     {
         print_usage();
         return EXIT_SUCCESS;
-    } else if (
-        (argc >= 5 && argc <= 6)                            && 
-        (argv[1] == "-u"sv || argv[1] == "--unpack"sv ||
-         argv[1] == "-p"sv || argv[1] == "--pack"sv)        &&
-        (argv[2] == "-pc"sv || argv[2] == "-ce"sv)          &&
-        (argv[3] == "-fx"sv || argv[3] == "-vsh"sv)) 
+    }
+    
+    if (argc >= 3 && (argv[1] == "-v"sv || argv[1] == "--verify"sv))
+        return verify_archives({argv + 2, argv + argc});
+    
+    if (argc >= 3 && argv[1] == "--digest"sv)
+        return print_digests({argv + 2, argv + argc});
+    
+    if (argc >= 3 && argv[1] == "--serve"sv)
+        return serve_archives({argv + 2, argv + argc});
+    
+    if (argc >= 2 && argv[1] == "--diff"sv)
+        return diff_archives({argv + 2, argv + argc});
+    
+    if (argc >= 2 && argv[1] == "--apply"sv)
+        return apply_patch({argv + 2, argv + argc});
+    
+    if (argc >= 2 && argv[1] == "--list"sv)
+        return list_archive({argv + 2, argv + argc});
+    
+    // Pull out the options that only make sense once per invocation.
+    std::vector<char*> args(argv + std::min(argc, 1), argv + argc);
+    const char* batch_file = nullptr;
+    const char* pack_all_dir = nullptr;
+    std::size_t jobs = 0;
+#if H1SP_ENABLE_STATS
+    enum class stats_format {none, table, json} stats = stats_format::none;
+#endif
     {
-        op.mode   = (argv[1] == "-u"sv || argv[1] == "--unpack"sv)
-                  ? operation_mode::unpack : operation_mode::pack;
-        op.client = argv[2] == "-pc"sv ? client_version::pc : client_version::ce;
-        op.type   = argv[3] == "-fx"sv ? archive_type::fx : archive_type::vsh;
-        op.file   = argv[4];
-        if (argc >= 6)                        op.prefix = argv[5];
-        else if (op.type == archive_type::fx) op.prefix = "fx/";
-        else                                  op.prefix = "vsh/";
-    } else 
+        auto out = args.begin();
+        for (auto it = out; it != args.end(); ++it)
+        {
+            if (*it == "--batch"sv && std::next(it) != args.end())
+            {
+                batch_file = *++it;
+            } else if (*it == "--pack-all"sv && std::next(it) != args.end())
+            {
+                pack_all_dir = *++it;
+            } else if (*it == "--jobs"sv && std::next(it) != args.end())
+            {
+                ++it;
+                if (!parse_thread_count(*it, jobs))
+                {
+                    std::printf("invalid job count %s\n", *it);
+                    return EXIT_FAILURE;
+                }
+            } else if (*it == "--stats"sv || *it == "--stats=json"sv)
+            {
+#if H1SP_ENABLE_STATS
+                stats = *it == "--stats"sv ? stats_format::table : stats_format::json;
+#else
+                std::puts("--stats requires a build with H1SP_ENABLE_STATS\n");
+                return EXIT_FAILURE;
+#endif
+            } else
+            {
+                *out++ = *it;
+            }
+        }
+        args.erase(out, args.end());
+    }
+    
+    std::vector<operation_context> ops;
+    std::deque<std::string>        batch_lines; // backs the batch job args
+    operation_context              defaults    = {};
+    if (batch_file != nullptr && pack_all_dir != nullptr)
     {
-        std::puts("invalid use\n");
-        print_usage();
+        std::puts("--pack-all cannot be combined with --batch\n");
+        return EXIT_FAILURE;
+    } else if (pack_all_dir != nullptr)
+    {
+        // the remaining options apply to every pack
+        if (parse_operations(args, defaults, ops, false) != parse_status::success)
+            return EXIT_FAILURE;
+        if (!ops.empty())
+        {
+            std::puts("operations cannot be combined with --pack-all\n");
+            return EXIT_FAILURE;
+        }
+        if (!plan_pack_all(pack_all_dir, defaults, batch_lines, ops))
+            return EXIT_FAILURE;
+    } else if (batch_file != nullptr)
+    {
+        // the remaining options are defaults for every job in the batch
+        if (parse_operations(args, defaults, ops, false) != parse_status::success)
+            return EXIT_FAILURE;
+        if (!ops.empty())
+        {
+            std::puts("operations cannot be combined with --batch\n");
+            return EXIT_FAILURE;
+        }
+        if (!read_batch_file(batch_file, defaults, batch_lines, ops))
+            return EXIT_FAILURE;
+    } else
+    {
+        switch (parse_operations(args, defaults, ops))
+        {
+        case parse_status::success:
+            break;
+        case parse_status::invalid_use:
+            std::puts("invalid use\n");
+            print_usage();
+            return EXIT_FAILURE;
+        default:
+            return EXIT_FAILURE;
+        }
+    }
+    
+    const auto reads_stdin = [] (const operation_context& op) {
+        return op.mode == operation_mode::unpack && op.file == "-"sv;
+    };
+    if (std::count_if(ops.begin(), ops.end(), reads_stdin) > 1)
+    {
+        std::puts("only one operation can read standard input\n");
         return EXIT_FAILURE;
     }
     
-    const char* reason = perform_operation(op);
-    if (reason != nullptr)
+    const auto stdout_writers = std::count_if(ops.begin(), ops.end(), writes_stdout);
+    if (stdout_writers > 1)
     {
-        std::printf("operation failed: %s\n", reason);
+        std::puts("only one operation can write standard output\n");
         return EXIT_FAILURE;
     }
     
-    return EXIT_SUCCESS;
+    // Keep the archive on standard output free of every operation's messages.
+    if (stdout_writers != 0)
+    {
+        for (auto& op : ops)
+            op.messages = stderr;
+    }
+    
+    const int status = run_operations(ops, jobs);
+#if H1SP_ENABLE_STATS
+    if (stats != stats_format::none)
+    {
+        shader_packager::print_stats(
+            stdout_writers != 0 ? stderr : stdout, 
+            stats == stats_format::json);
+    }
+#endif
+    return status;
 }
 
 namespace 
 {
-    std::span<const char* const> get_names(
-        client_version client, 
-        archive_type   type)
+    bool read_batch_file(
+        const char*                     file,
+        const operation_context&        defaults,
+        std::deque<std::string>&        lines,
+        std::vector<operation_context>& ops)
     {
-        using shader_packager::vs_names;
-        using shader_packager::retail_fx_names;
-        using shader_packager::custom_fx_names;
+        std::FILE* fp = std::fopen(file, "r");
+        if (fp == nullptr)
+        {
+            std::perror("failed to open batch file");
+            return false;
+        }
         
-        switch (type)
+        bool ok = true;
+        char linebuf[4096];
+        for (int lineno = 1; ok && std::fgets(linebuf, sizeof(linebuf), fp); ++lineno)
         {
-        case archive_type::vsh: return vs_names;
-        case archive_type::fx:
-            switch (client)
+            auto& line = lines.emplace_back(linebuf);
+            std::vector<char*> args;
+            split_arguments(line, args);
+            if (args.empty())
+                continue;
+            
+            std::vector<operation_context> line_ops;
+            operation_context line_defaults = defaults;
+            if (parse_operations(args, line_defaults, line_ops) != parse_status::success)
             {
-            case client_version::pc: return retail_fx_names;
-            case client_version::ce: return custom_fx_names;
-            default: break;;
+                std::printf("%s:%d: invalid job\n", file, lineno);
+                ok = false;
             }
-        default: break;
+            std::move(line_ops.begin(), line_ops.end(), std::back_inserter(ops));
         }
+        std::fclose(fp);
         
-        return {};
-    }
-    
-    const char* get_archive_member_extension(archive_type type)
-    {
-        switch (type)
+        if (ok && ops.empty())
         {
-        case archive_type::vsh: return "vsh";
-        case archive_type::fx:  return "fx";
-        default:                return "";
+            std::printf("%s: no jobs\n", file);
+            ok = false;
         }
+        
+        return ok;
     }
     
-    void print_usage()
+    bool plan_pack_all(
+        const char*                     dir,
+        const operation_context&        defaults,
+        std::deque<std::string>&        lines,
+        std::vector<operation_context>& ops)
     {
-        std::printf(
-R"(
-USAGE
-  %s {-h|--help}
-  %s {-u|--unpack} {-pc|-ce} {-fx|-vsh} INPUT_FILE [PREFIX] 
-    Unpack the shader archive INPUT_FILE by writing each member to files prefixed with PREFIX.
-  %s {-p|--pack} {-pc|-ce} {-fx|-vsh} OUTPUT_FILE [PREFIX]
-    Creates a shader archive OUTPUT_FILE by packing members located via PREFIX.
-  
-  OPTIONS
-     -pc indicates that the shader archive is for the retail client.
-     -ce indicates that the shader archive is for the Custom Edition client.
-     -fx indicates that the shader archive is an effects archive.
-        PREFIX defaults to "fx/".
-     -vsh indicates that the shader archive is a vertex shaders archive.
-        PREFIX defaults to "vsh/".
-)",
-            binpath,
-            binpath,
-            binpath
-        );
+        for (const char* client : {"-pc", "-ce"})
+        {
+            const auto client_dir = std::filesystem::path{dir} / (client + 1);
+            std::error_code ec;
+            std::filesystem::create_directories(client_dir, ec);
+            if (ec)
+            {
+                std::printf("could not create %s\n", client_dir.string().c_str());
+                return false;
+            }
+            
+            for (const char* type : {"-fx", "-vsh"})
+            {
+                // parsed like a batch line, so the same rules apply
+                std::vector<char*> args;
+                for (const char* arg : {"-p", client, type})
+                    args.push_back(lines.emplace_back(arg).data());
+                args.push_back(lines.emplace_back(
+                    (client_dir / (std::string{type + 1} + ".bin")).string()).data());
+                
+                operation_context job_defaults = defaults;
+                if (parse_operations(args, job_defaults, ops) != parse_status::success)
+                    return false;
+            }
+        }
+        
+        return true;
     }
     
-    // Returns nullptr on success, otherwise returns an error string
-    const char* perform_unpack_operation(const operation_context& op)
+    int run_operations(std::span<const operation_context> ops, std::size_t jobs)
     {
-        using enum shader_packager::archive::read_error;
-        
-        // load the archive and check for errors
-        shader_packager::archive archive;
+        if (ops.size() == 1)
         {
-            const auto error = archive.read_from_file(op.file); 
-            switch (error)
+            const char* reason = perform_operation(ops.front());
+            if (reason != nullptr)
             {
-            case success:
-                break; // continue processing
-            case could_not_open_file:
-                return "could not open file";
-            case archive_data_is_corrupt:
-                return "archive is corrupt";
-            default:
-                return "unknown read error";
+                std::fprintf(ops.front().messages,
+                    "operation failed: %s\n", reason);
+                return EXIT_FAILURE;
             }
+            
+            return EXIT_SUCCESS;
         }
         
-        // write each archive member to its own file
+        // Jobs packing from the same prefix share their member file reads.
+        member_file_cache cache;
+        std::vector<std::future<const char*>> results;
+        results.reserve(ops.size());
         {
-            const char* prefix = op.prefix;
-            const char* extension = get_archive_member_extension(op.type);
-            const auto names = get_names(op.client, op.type);
-            std::size_t i = 0;
+            shader_packager::thread_pool pool{jobs};
+            for (const auto& op : ops)
+            {
+                results.push_back(pool.submit([&op, &cache] {
+                    operation_context job = op;
+                    job.cache = &cache;
+                    return perform_operation(job);
+                }));
+            }
             
-            enum unpack_error
+            // waits for every job
+        }
+        
+        int status = EXIT_SUCCESS;
+        for (std::size_t i = 0; i < ops.size(); ++i)
+        {
+            const char* reason = results[i].get();
+            if (reason != nullptr)
             {
-                unpack_success,
-                unpack_too_many_members,
-                unpack_write_error
-            };
+                std::fprintf(ops[i].messages,
+                    "operation %zu (%s) failed: %s\n", i + 1, ops[i].file, reason);
+                status = EXIT_FAILURE;
+            }
+        }
+        
+        return status;
+    }
+    
+    int verify_archives(std::span<char* const> files)
+    {
+        namespace sp = shader_packager;
+        
+        // Archives are loaded a group at a time, so that the digests of a 
+        // whole group are computed together, one archive per SIMD lane.
+        const std::size_t group_size = sp::md5_lane_count();
+        
+        int status = EXIT_SUCCESS;
+        for (std::size_t first = 0; first < files.size(); first += group_size)
+        {
+            const auto group = files.subspan(
+                first, std::min(group_size, files.size() - first));
             
-            const unpack_error error = archive.for_each(
-            [prefix, extension, names, &i] 
-            (std::span<std::byte> data) -> unpack_error
+            std::vector<sp::mapped_file>      maps;
+            std::vector<std::span<std::byte>> archives;
+            std::vector<bool>                 mapped(group.size(), false);
+            std::vector<const char*>          reasons(group.size(), nullptr);
+            for (std::size_t i = 0; i < group.size(); ++i)
             {
-                if (i >= names.size())
-                    return unpack_too_many_members;
-                
-                const char* name = names[i];
-                char dstname[1024];
-                std::snprintf(dstname, std::size(dstname), "%s%s.%s",
-                    prefix, name, extension
-                );
-
-                if (!shader_packager::write_file(dstname, data))
+                auto map = sp::mapped_file::map_copy_on_write(group[i]);
+                if (map)
                 {
-                    return unpack_write_error;
+                    archives.push_back(map.range());
+                    maps.push_back(std::move(map));
+                    mapped[i] = true;
+                } else
+                {
+                    // stream what cannot be mapped rather than reading it 
+                    // all into memory
+                    sp::archive::verify_result result;
+                    switch (sp::archive::verify_file(group[i], &result))
+                    {
+                    case sp::archive::read_error::success:
+                        break;
+                    case sp::archive::read_error::could_not_open_file:
+                        reasons[i] = "could not open file";
+                        break;
+                    default:
+                        // the digests of an archive too small for its 
+                        // trailer are both empty
+                        if (result.size < 33 + 1)
+                            reasons[i] = "archive is too small";
+                        else if (result.digest != result.computed)
+                            reasons[i] = "md5 did not match";
+                        else
+                            reasons[i] = "archive member is corrupt";
+                        break;
+                    }
                 }
-                
-                ++i;
-                return unpack_success;
-            }).value_or(unpack_success);
+            }
+            
+            std::vector<sp::core_error> results(archives.size());
+            sp::decrypt_archives_in_place(archives, results);
             
-            if (error == unpack_success) {
-                // DO NOTHING; success
-            } else if (error == unpack_too_many_members) {
-                // DO NOTHING; Halo does not treat this an error
-            } else if (unpack_write_error)
+            for (std::size_t i = 0, j = 0; i < group.size(); ++i)
             {
-                std::printf("failed to write member %s\n", names[i]);
-                return "failed to write member to corresponding file";
-            } else if (i < names.size())
+                if (mapped[i])
+                {
+                    switch (results[j++])
+                    {
+                    case sp::core_error::success:
+                        break;
+                    case sp::core_error::archive_too_small:
+                        reasons[i] = "archive is too small";
+                        break;
+                    case sp::core_error::digest_mismatch:
+                        reasons[i] = "md5 did not match";
+                        break;
+                    default:
+                        reasons[i] = "archive member is corrupt";
+                        break;
+                    }
+                }
+                
+                if (reasons[i] == nullptr)
+                {
+                    std::printf("%s: ok\n", group[i]);
+                } else
+                {
+                    std::printf("%s: failed (%s)\n", group[i], reasons[i]);
+                    status = EXIT_FAILURE;
+                }
+            }
+        }
+        
+        return status;
+    }
+    
+    int print_digests(std::span<char* const> files)
+    {
+        namespace sp = shader_packager;
+        
+        int status = EXIT_SUCCESS;
+        for (const char* file : files)
+        {
+            sp::archive::verify_result result;
+            switch (sp::archive::verify_file(file, &result, sp::archive::verify_mode::digest_only))
             {
-                return "loaded archive has missing members";
+            case sp::archive::read_error::success:
+                std::printf("%.32s  %s\n", result.digest.data(), file);
+                break;
+            case sp::archive::read_error::could_not_open_file:
+                std::printf("%s: failed (could not open file)\n", file);
+                status = EXIT_FAILURE;
+                break;
+            default:
+                std::printf("%s: failed (archive is corrupt)\n", file);
+                status = EXIT_FAILURE;
+                break;
             }
-            
-            std::printf("unpacked %d archive members prefixed with %s\n",
-                (int)i, prefix);
         }
         
-        return nullptr;
+        return status;
     }
     
-    const char* perform_pack_operation(const operation_context& op)
+    // Gets the names of the members of an archive of count members, going 
+    // by the only list of that length, or an empty list if there is none.
+    std::span<const char* const> names_for_count(const std::size_t count)
     {
         namespace sp = shader_packager;
         
-        const auto names = get_names(op.client, op.type);
-        std::vector<sp::byte_buffer> filebufs;
-        filebufs.reserve(names.size());
+        for (const auto& profile : sp::builtin_profiles())
+        {
+            if (profile.names.size() == count)
+                return profile.names;
+        }
         
-        // load the member files into memory
+        return {};
+    }
+    
+    int diff_archives(std::span<char* const> args)
+    {
+        namespace sp = shader_packager;
+        
+        if (args.size() != 2 && args.size() != 3)
+        {
+            std::puts("invalid use\n");
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        
+        sp::archive from;
+        sp::archive to;
+        for (const auto& [file, archive] : {std::pair{args[0], &from}, std::pair{args[1], &to}})
         {
-            const char* extension = get_archive_member_extension(op.type);
-            for (const char* name : names)
+            switch (archive->read_from_file(file))
             {
-                char filepath[1024];
-                std::snprintf(filepath, std::size(filepath), "%s%s.%s",
-                    op.prefix, name, extension);
-                auto filebuf = sp::read_file(filepath);
-                if (!filebuf)
-                {
-                    std::fprintf(stderr, "on file %s: \n", filepath);
-                    return "failed to read member file";
-                }
-                filebufs.push_back(std::move(filebuf));
+            case sp::archive::read_error::success:
+                break;
+            case sp::archive::read_error::could_not_open_file:
+                std::printf("%s: failed (could not open file)\n", file);
+                return EXIT_FAILURE;
+            default:
+                std::printf("%s: failed (archive is corrupt)\n", file);
+                return EXIT_FAILURE;
             }
         }
         
-        // put the members into the archive
-        sp::archive archive;
-        archive.load_members_from(std::span{filebufs.cbegin(), filebufs.cend()});
+        const auto patch = sp::archive_patch::diff(from, to);
+        const auto names = names_for_count(std::max(from.member_count(), to.member_count()));
+        const auto name_of = [&] (const std::size_t index) {
+            return index < names.size() ? names[index] : "-";
+        };
+        for (const auto& change : patch.changes)
+        {
+            std::printf("%s %u %s %zu\n", 
+                change.index < patch.old_count ? "changed" : "added",
+                change.index, name_of(change.index), change.data.size());
+        }
+        for (std::size_t i = patch.new_count; i < patch.old_count; ++i)
+            std::printf("removed %zu %s\n", i, name_of(i));
+        
+        if (args.size() == 3 && !patch.write_to_file(args[2]))
+        {
+            std::printf("%s: failed (could not write file)\n", args[2]);
+            return EXIT_FAILURE;
+        }
+        
+        return EXIT_SUCCESS;
+    }
+    
+    int apply_patch(std::span<char* const> args)
+    {
+        namespace sp = shader_packager;
         
-        // write output file
-        const auto result = archive.flush_to_file(op.file);
+        if (args.size() != 3)
+        {
+            std::puts("invalid use\n");
+            print_usage();
+            return EXIT_FAILURE;
+        }
         
-        switch (result)
+        sp::archive from;
+        switch (from.read_from_file(args[0]))
         {
-        case sp::archive::write_error::success:
+        case sp::archive::read_error::success:
             break;
-        case sp::archive::write_error::no_data_to_write:
-            return "no data to write";
-        case sp::archive::write_error::could_not_open_file:
-            return "could not open output file for writing";
+        case sp::archive::read_error::could_not_open_file:
+            std::printf("%s: failed (could not open file)\n", args[0]);
+            return EXIT_FAILURE;
         default:
-            return "unknown archive::write_error";
+            std::printf("%s: failed (archive is corrupt)\n", args[0]);
+            return EXIT_FAILURE;
+        }
+        
+        const auto patch = sp::archive_patch::read_from_file(args[1]);
+        if (!patch)
+        {
+            std::printf("%s: failed (not a valid patch)\n", args[1]);
+            return EXIT_FAILURE;
+        }
+        
+        switch (patch->apply(from, args[2]))
+        {
+        case sp::archive_patch::apply_error::success:
+            return EXIT_SUCCESS;
+        case sp::archive_patch::apply_error::wrong_archive:
+            std::printf("%s: failed (patch is not for %s)\n", args[1], args[0]);
+            break;
+        case sp::archive_patch::apply_error::could_not_write:
+            std::printf("%s: failed (could not write file)\n", args[2]);
+            break;
+        case sp::archive_patch::apply_error::digest_mismatch:
+            std::printf("%s: failed (md5 did not match the patch)\n", args[2]);
+            break;
         }
         
-        return nullptr;
+        return EXIT_FAILURE;
+    }
+    
+    // Prints s as a JSON string.
+    void print_json_string(std::string_view s)
+    {
+        std::putchar('"');
+        for (const char c : s)
+        {
+            if (c == '"' || c == '\\')
+                std::printf("\\%c", c);
+            else if (static_cast<unsigned char>(c) < 0x20)
+                std::printf("\\u%04x", static_cast<unsigned>(c));
+            else
+                std::putchar(c);
+        }
+        std::putchar('"');
     }
     
-    const char* perform_operation(const operation_context& op)
+    int list_archive(std::span<char* const> args)
     {
-        assert(op.mode != operation_mode::unspecified);
-        assert(op.client != client_version::unspecified);
-        assert(op.type != archive_type::unspecified);
-        assert(op.file != nullptr);
-        assert(op.prefix != nullptr);
+        using namespace std::literals::string_view_literals;
+        namespace sp = shader_packager;
+        
+        const char* file    = nullptr;
+        bool        json    = false;
+        bool        hash    = false;
+        std::size_t threads = 1;
+        for (auto it = args.begin(); it != args.end(); ++it)
+        {
+            if (*it == "--json"sv)
+                json = true;
+            else if (*it == "--hash"sv)
+                hash = true;
+            else if (*it == "-j"sv && std::next(it) != args.end() && parse_thread_count(*std::next(it), threads))
+                ++it;
+            else if (file == nullptr && **it != '-')
+                file = *it;
+            else
+            {
+                std::printf("invalid list option %s\n", *it);
+                return EXIT_FAILURE;
+            }
+        }
+        if (file == nullptr)
+        {
+            std::puts("invalid use\n");
+            print_usage();
+            return EXIT_FAILURE;
+        }
         
-        switch (op.mode)
+        // the headers lie at data-dependent offsets, so the whole archive 
+        // is decrypted, though nothing is written
+        sp::archive archive;
+        auto error = archive.open_mapped(file, threads);
+        if (error == sp::archive::read_error::could_not_open_file)
+            error = archive.read_from_file(file, threads);
+        switch (error)
         {
-        case operation_mode::unpack:
-            return perform_unpack_operation(op);
-        case operation_mode::pack:
-            return perform_pack_operation(op);
+        case sp::archive::read_error::success:
+            break;
+        case sp::archive::read_error::could_not_open_file:
+            std::printf("%s: failed (could not open file)\n", file);
+            return EXIT_FAILURE;
         default:
-            return "unsupported operation mode";
+            std::printf("%s: failed (archive is corrupt)\n", file);
+            return EXIT_FAILURE;
         }
+        
+        const std::size_t count = archive.member_count();
+        const auto names = names_for_count(count);
+        std::vector<std::size_t> indices(count);
+        std::iota(indices.begin(), indices.end(), std::size_t{0});
+        const auto digests = hash ? hash_members(archive, indices, threads)
+                                  : std::vector<std::array<char, 33>>{};
+        
+        // offsets are those of the size headers, from the start of the file
+        const std::byte* base = count != 0 
+            ? archive.member(0)->data() - sizeof(std::uint32_t) : nullptr;
+        const auto offset_of = [base] (const std::span<std::byte> member) {
+            return static_cast<std::size_t>(member.data() - base) - sizeof(std::uint32_t);
+        };
+        
+        if (json)
+        {
+            std::printf("{\n  \"file\": ");
+            print_json_string(file);
+            std::printf(",\n  \"digest\": \"%.32s\",\n  \"members\": [", 
+                archive.digest().data());
+            const char* separator = "\n";
+            for (const std::size_t i : indices)
+            {
+                const auto member = *archive.member(i);
+                std::printf("%s    {\"index\": %zu, \"name\": ", separator, i);
+                if (i < names.size())
+                    print_json_string(names[i]);
+                else
+                    std::printf("null");
+                std::printf(", \"offset\": %zu, \"size\": %zu", offset_of(member), member.size());
+                if (hash)
+                    std::printf(", \"md5\": \"%.32s\"", digests[i].data());
+                std::printf("}");
+                separator = ",\n";
+            }
+            std::printf("\n  ]\n}\n");
+            return EXIT_SUCCESS;
+        }
+        
+        std::printf("%5s %10s %10s %s%s\n", 
+            "index", "offset", "size", hash ? "md5                              " : "", "name");
+        for (const std::size_t i : indices)
+        {
+            const auto member = *archive.member(i);
+            std::printf("%5zu %10zu %10zu ", i, offset_of(member), member.size());
+            if (hash)
+                std::printf("%.32s ", digests[i].data());
+            std::printf("%s\n", i < names.size() ? names[i] : "-");
+        }
+        std::printf("%zu members, stored digest %.32s\n", count, archive.digest().data());
+        
+        return EXIT_SUCCESS;
+    }
+    
+    void print_usage()
+    {
+        std::printf(
+R"(
+USAGE
+  %s {-h|--help}
+  %s {-u|--unpack} {-pc|-ce} {-fx|-vsh} INPUT_FILE [PREFIX] 
+    Unpack the shader archive INPUT_FILE by writing each member to files prefixed with PREFIX.
+    An INPUT_FILE of - reads the archive from standard input as it arrives.
+  %s {-p|--pack} {-pc|-ce} {-fx|-vsh} OUTPUT_FILE [PREFIX]
+    Creates a shader archive OUTPUT_FILE by packing members located via PREFIX.
+    An OUTPUT_FILE of - writes the archive to standard output as it is packed;
+    the messages of every operation then go to standard error.
+  %s --batch JOB_FILE [OPTIONS]
+    Performs the operations listed in JOB_FILE, one per line.
+  %s --pack-all OUTDIR [OPTIONS]
+    Packs all four archives, OUTDIR/{pc,ce}/{fx,vsh}.bin, from fx/ and vsh/
+    concurrently, reading each member file once for all of them.
+  %s {-v|--verify} FILE...
+    Checks that each shader archive FILE is intact, as Halo would.
+  %s --digest FILE...
+    Prints the MD5 digest stored in each shader archive FILE, unchecked.
+  %s --list FILE [--json] [--hash] [-j N]
+    Lists the index, offset, size and name of each member of the shader
+    archive FILE, and its stored digest; --hash adds the MD5 digest of each
+    member, computed across -j threads, and --json prints it all as JSON.
+  %s --diff OLD NEW [PATCH]
+    Lists the members of the shader archive NEW that differ from those of OLD,
+    by index and name; if PATCH is given, writes a patch holding just those.
+  %s --apply OLD PATCH OUT
+    Writes the shader archive OUT that results from applying PATCH to OLD,
+    copying the unchanged members from OLD.
+  %s --serve SOCKET [--jobs N] [--cache N] [-j N]
+    Serves requests for archive members on the Unix domain socket SOCKET,
+    keeping the archives requested decrypted in memory.
+  
+  Several operations may also be given on one command line, one after the
+  other; they are performed concurrently and must not depend on each other.
+  
+  OPTIONS
+     -pc indicates that the shader archive is for the retail client.
+     -ce indicates that the shader archive is for the Custom Edition client.
+     -fx indicates that the shader archive is an effects archive.
+        PREFIX defaults to "fx/".
+     -vsh indicates that the shader archive is a vertex shaders archive.
+        PREFIX defaults to "vsh/".
+     --profile PROFILE reads the archive format from the profile file
+        PROFILE: its member names, their file extension and default PREFIX
+        and its cipher key. Operations may then leave out {-pc|-ce}
+        {-fx|-vsh}, as in -u --profile mod.profile INPUT_FILE [PREFIX].
+     -j N encrypts/decrypts the archive using up to N threads.
+        0 uses one thread per hardware thread. Defaults to 1.
+     --io-jobs N reads or writes up to N member files concurrently.
+        0 uses one per hardware thread. Defaults to 8.
+     --incremental records the packed members in OUTPUT_FILE.manifest and,
+        if that manifest and OUTPUT_FILE are already present, only re-reads
+        the member files that changed since and only re-encrypts the archive
+        from the first changed member onwards.
+     --only NAME[,NAME...] unpacks only the named members. Each NAME may be
+        a glob pattern, where * matches any run of characters and ? matches
+        any single character, e.g. environment_texture_*.
+     --cas DIR stores each unpacked member once in the content store DIR,
+        by its MD5 digest, and makes the member files links to it. Packing
+        with --cas DIR reads the member files that are unchanged since from
+        the store instead.
+     --direct-io writes the unpacked members with O_DIRECT (unbuffered on
+        Windows) where their alignment allows, bypassing the page cache.
+     --dedupe, when unpacking, hashes the members across -j threads and
+        writes each distinct member once; the files of members with the
+        same data are links to the first one's file, as with --cas, and are
+        listed as duplicates.
+     --atomic, when unpacking from standard input, writes each member to
+        a .partial file and only renames them to the member files once the
+        whole archive has checked out; otherwise the members are written as
+        they arrive and left in place if the archive turns out corrupt.
+     --batch JOB_FILE reads the operations from JOB_FILE. Each line holds
+        one operation and its own options, as on the command line; options
+        given with --batch apply to every line. Empty lines and lines
+        starting with # are ignored, and "..." quotes an argument.
+     --jobs N performs up to N operations concurrently. 0 uses one per
+        hardware thread. Defaults to 0.
+     --stats[=json] prints the bytes handled and the wall and CPU time
+        spent in each stage, per member and in total, once the operations
+        are done. Requires a build with H1SP_ENABLE_STATS.
+  
+  SERVER
+     Each request is a line of arguments, quoted as in a JOB_FILE:
+       get {-pc|-ce} {-fx|-vsh} FILE NAME   replies with member NAME of FILE.
+       map {-pc|-ce} {-fx|-vsh} FILE NAME   passes a descriptor of sealed,
+         read-only shared memory holding the decrypted FILE (Linux only),
+         replying with the offset and size of member NAME in it.
+       list {-pc|-ce} {-fx|-vsh} FILE       replies with the name and size
+         of each member, one per line.
+       pack {-pc|-ce} {-fx|-vsh} FILE [PREFIX] [OPTIONS]  packs FILE as -p
+         would, printing nothing; FILE cannot be -.
+       shutdown                             stops the server.
+     Each reply is a line "ok SIZE [OFFSET SIZE]" followed by SIZE bytes,
+     or a line "error REASON". An archive is reloaded once its file
+     changes. --jobs N handles up to N requests at once (0 uses one per
+     hardware thread, the default), --cache N keeps up to N archives
+     loaded (16 by default) and -j N decrypts each with up to N threads.
+)",
+            binpath,
+            binpath,
+            binpath,
+            binpath,
+            binpath,
+            binpath,
+            binpath,
+            binpath,
+            binpath,
+            binpath,
+            binpath
+        );
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/manifest.hpp>
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace shader_packager
+{
+    namespace
+    {
+        struct file_closer
+        {
+            void operator()(std::FILE* fp) const noexcept { std::fclose(fp); }
+        };
+
+        using file_ptr = std::unique_ptr<std::FILE, file_closer>;
+
+        constexpr const char* manifest_magic = "h1sp-manifest 1";
+    }
+
+    std::optional<file_stamp> stat_file(const char* file)
+    {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(file, ec);
+        if (ec)
+            return std::nullopt;
+
+        const auto mtime = std::filesystem::last_write_time(file, ec);
+        if (ec)
+            return std::nullopt;
+
+        return file_stamp {
+            .size  = static_cast<std::uint64_t>(size),
+            .mtime = static_cast<std::int64_t>(mtime.time_since_epoch().count())
+        };
+    }
+
+    std::optional<pack_manifest> pack_manifest::read_from_file(const char* file)
+    {
+        const file_ptr fp{std::fopen(file, "r")};
+        if (!fp)
+            return std::nullopt;
+
+        char magic[32] = {};
+        if (std::fscanf(fp.get(), "%31[^\n]\n", magic) != 1 ||
+            std::string_view{magic} != manifest_magic)
+            return std::nullopt;
+
+        pack_manifest result {};
+        char digest[33] = {};
+        if (std::fscanf(fp.get(), "archive %32s %" SCNu64 "\n",
+                digest, &result.archive_size) != 2)
+            return std::nullopt;
+        result.archive_digest = digest;
+
+        for (;;)
+        {
+            entry e {};
+            char hash[33] = {};
+            char name[256] = {};
+            const int fields = std::fscanf(fp.get(),
+                "%" SCNu64 " %" SCNd64 " %32s %" SCNu64 " %255s\n",
+                &e.stamp.size, &e.stamp.mtime, hash, &e.offset, name);
+            if (fields == EOF)
+                break;
+            if (fields != 5)
+                return std::nullopt;
+
+            e.hash = hash;
+            e.name = name;
+            result.entries.push_back(std::move(e));
+        }
+
+        return result;
+    }
+
+    bool pack_manifest::write_to_file(const char* file) const
+    {
+        // written beside the manifest and renamed over it, so that a failed
+        // write leaves the previous manifest as it was
+        const std::string partial = std::string{file} + ".partial";
+        file_ptr fp{std::fopen(partial.c_str(), "w")};
+        if (!fp)
+            return false;
+
+        std::fprintf(fp.get(), "%s\narchive %s %" PRIu64 "\n",
+            manifest_magic, archive_digest.c_str(), archive_size);
+
+        for (const auto& e : entries)
+        {
+            std::fprintf(fp.get(), "%" PRIu64 " %" PRId64 " %s %" PRIu64 " %s\n",
+                e.stamp.size, e.stamp.mtime, e.hash.c_str(), e.offset,
+                e.name.c_str());
+        }
+
+        const bool written = std::ferror(fp.get()) == 0;
+        std::error_code ec;
+        if (std::fclose(fp.release()) != 0 || !written)
+        {
+            std::filesystem::remove(partial, ec);
+            return false;
+        }
+
+        std::filesystem::rename(partial, file, ec);
+        if (ec)
+            std::filesystem::remove(partial, ec);
+        return !ec;
+    }
+}
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/mapped_file.hpp>
+
+#include <utility>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace shader_packager
+{
+    mapped_file::mapped_file(mapped_file&& other) noexcept
+        : ptr(std::exchange(other.ptr, nullptr))
+        , nbytes(std::exchange(other.nbytes, 0))
+        { }
+
+    mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+    {
+        if (this != &other)
+        {
+            mapped_file old{std::move(*this)};
+            ptr    = std::exchange(other.ptr, nullptr);
+            nbytes = std::exchange(other.nbytes, 0);
+        }
+        return *this;
+    }
+
+#if defined(_WIN32)
+    mapped_file::~mapped_file()
+    {
+        if (ptr != nullptr)
+            UnmapViewOfFile(ptr);
+    }
+
+    mapped_file mapped_file::map_copy_on_write(const char* file)
+    {
+        mapped_file result;
+
+        const HANDLE fh = CreateFileA(
+            file, GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (fh == INVALID_HANDLE_VALUE)
+            return result;
+
+        LARGE_INTEGER size {};
+        if (!GetFileSizeEx(fh, &size) || size.QuadPart <= 0)
+        {
+            CloseHandle(fh);
+            return result;
+        }
+
+        const HANDLE mh = CreateFileMappingA(
+            fh, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        CloseHandle(fh);
+        if (mh == nullptr)
+            return result;
+
+        // the view keeps the mapping object alive
+        void* view = MapViewOfFile(mh, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mh);
+        if (view == nullptr)
+            return result;
+
+        result.ptr    = static_cast<std::byte*>(view);
+        result.nbytes = static_cast<std::size_t>(size.QuadPart);
+        return result;
+    }
+#else
+    mapped_file::~mapped_file()
+    {
+        if (ptr != nullptr)
+            ::munmap(ptr, nbytes);
+    }
+
+    mapped_file mapped_file::map_copy_on_write(const char* file)
+    {
+        mapped_file result;
+
+        const int fd = ::open(file, O_RDONLY);
+        if (fd == -1)
+            return result;
+
+        struct stat st {};
+        if (::fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        {
+            ::close(fd);
+            return result;
+        }
+
+        const auto size = static_cast<std::size_t>(st.st_size);
+        void* view = ::mmap(
+            nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file alive
+        if (view == MAP_FAILED)
+            return result;
+
+        (void)::madvise(view, size, MADV_SEQUENTIAL);
+
+        result.ptr    = static_cast<std::byte*>(view);
+        result.nbytes = size;
+        return result;
+    }
+#endif
+}
@@ -0,0 +1,536 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/crypt.hpp>
+#include <h1sp/io.hpp>
+#include <h1sp/stats.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <new>
+#include <optional>
+#include <stdexcept>
+
+#if !defined(H1SP_BUILTIN_MD5)
+    #include <openssl/evp.h>
+#endif
+
+#if defined(__GNUC__)
+    // The multi-buffer kernels use GCC vector extensions; the per-ISA entry
+    // points are compiled for their target and the rounds inlined into them.
+    #define H1SP_MD5_INLINE [[gnu::always_inline]] inline
+    #define H1SP_MD5_LANES 1
+    #if defined(__x86_64__) || defined(__i386__)
+        #define H1SP_MD5_X86_DISPATCH 1
+    #endif
+#else
+    #define H1SP_MD5_INLINE inline
+#endif
+
+namespace shader_packager
+{
+
+namespace
+{
+    constexpr std::size_t md5_digest_size = 16;
+
+    void encode_hex(
+        const unsigned char (&digest)[md5_digest_size],
+        std::array<char, 33>& hex) noexcept
+    {
+        constexpr char digits[] = "0123456789abcdef";
+
+        for (std::size_t i = 0; i < md5_digest_size; ++i)
+        {
+            hex[2 * i]     = digits[digest[i] >> 4];
+            hex[2 * i + 1] = digits[digest[i] & 0xF];
+        }
+        hex.back() = '\0';
+    }
+
+    constexpr std::uint32_t md5_iv[4] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+    };
+
+    // RFC 1321, with the rounds unrolled. Word is either std::uint32_t or a
+    // vector of them, holding one independent stream per lane.
+    template<typename Word>
+    H1SP_MD5_INLINE void md5_rounds(Word (&h)[4], const Word (&m)[16]) noexcept
+    {
+        Word a = h[0];
+        Word b = h[1];
+        Word c = h[2];
+        Word d = h[3];
+
+        #define H1SP_MD5_STEP(f, a, b, c, d, x, t, s) \
+            a += f(b, c, d) + (x) + (t);              \
+            a = ((a << s) | (a >> (32 - s))) + b;
+
+        #define H1SP_MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+        #define H1SP_MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+        #define H1SP_MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+        #define H1SP_MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+        H1SP_MD5_STEP(H1SP_MD5_F, a, b, c, d, m[ 0], 0xd76aa478,  7)
+        H1SP_MD5_STEP(H1SP_MD5_F, d, a, b, c, m[ 1], 0xe8c7b756, 12)
+        H1SP_MD5_STEP(H1SP_MD5_F, c, d, a, b, m[ 2], 0x242070db, 17)
+        H1SP_MD5_STEP(H1SP_MD5_F, b, c, d, a, m[ 3], 0xc1bdceee, 22)
+        H1SP_MD5_STEP(H1SP_MD5_F, a, b, c, d, m[ 4], 0xf57c0faf,  7)
+        H1SP_MD5_STEP(H1SP_MD5_F, d, a, b, c, m[ 5], 0x4787c62a, 12)
+        H1SP_MD5_STEP(H1SP_MD5_F, c, d, a, b, m[ 6], 0xa8304613, 17)
+        H1SP_MD5_STEP(H1SP_MD5_F, b, c, d, a, m[ 7], 0xfd469501, 22)
+        H1SP_MD5_STEP(H1SP_MD5_F, a, b, c, d, m[ 8], 0x698098d8,  7)
+        H1SP_MD5_STEP(H1SP_MD5_F, d, a, b, c, m[ 9], 0x8b44f7af, 12)
+        H1SP_MD5_STEP(H1SP_MD5_F, c, d, a, b, m[10], 0xffff5bb1, 17)
+        H1SP_MD5_STEP(H1SP_MD5_F, b, c, d, a, m[11], 0x895cd7be, 22)
+        H1SP_MD5_STEP(H1SP_MD5_F, a, b, c, d, m[12], 0x6b901122,  7)
+        H1SP_MD5_STEP(H1SP_MD5_F, d, a, b, c, m[13], 0xfd987193, 12)
+        H1SP_MD5_STEP(H1SP_MD5_F, c, d, a, b, m[14], 0xa679438e, 17)
+        H1SP_MD5_STEP(H1SP_MD5_F, b, c, d, a, m[15], 0x49b40821, 22)
+
+        H1SP_MD5_STEP(H1SP_MD5_G, a, b, c, d, m[ 1], 0xf61e2562,  5)
+        H1SP_MD5_STEP(H1SP_MD5_G, d, a, b, c, m[ 6], 0xc040b340,  9)
+        H1SP_MD5_STEP(H1SP_MD5_G, c, d, a, b, m[11], 0x265e5a51, 14)
+        H1SP_MD5_STEP(H1SP_MD5_G, b, c, d, a, m[ 0], 0xe9b6c7aa, 20)
+        H1SP_MD5_STEP(H1SP_MD5_G, a, b, c, d, m[ 5], 0xd62f105d,  5)
+        H1SP_MD5_STEP(H1SP_MD5_G, d, a, b, c, m[10], 0x02441453,  9)
+        H1SP_MD5_STEP(H1SP_MD5_G, c, d, a, b, m[15], 0xd8a1e681, 14)
+        H1SP_MD5_STEP(H1SP_MD5_G, b, c, d, a, m[ 4], 0xe7d3fbc8, 20)
+        H1SP_MD5_STEP(H1SP_MD5_G, a, b, c, d, m[ 9], 0x21e1cde6,  5)
+        H1SP_MD5_STEP(H1SP_MD5_G, d, a, b, c, m[14], 0xc33707d6,  9)
+        H1SP_MD5_STEP(H1SP_MD5_G, c, d, a, b, m[ 3], 0xf4d50d87, 14)
+        H1SP_MD5_STEP(H1SP_MD5_G, b, c, d, a, m[ 8], 0x455a14ed, 20)
+        H1SP_MD5_STEP(H1SP_MD5_G, a, b, c, d, m[13], 0xa9e3e905,  5)
+        H1SP_MD5_STEP(H1SP_MD5_G, d, a, b, c, m[ 2], 0xfcefa3f8,  9)
+        H1SP_MD5_STEP(H1SP_MD5_G, c, d, a, b, m[ 7], 0x676f02d9, 14)
+        H1SP_MD5_STEP(H1SP_MD5_G, b, c, d, a, m[12], 0x8d2a4c8a, 20)
+
+        H1SP_MD5_STEP(H1SP_MD5_H, a, b, c, d, m[ 5], 0xfffa3942,  4)
+        H1SP_MD5_STEP(H1SP_MD5_H, d, a, b, c, m[ 8], 0x8771f681, 11)
+        H1SP_MD5_STEP(H1SP_MD5_H, c, d, a, b, m[11], 0x6d9d6122, 16)
+        H1SP_MD5_STEP(H1SP_MD5_H, b, c, d, a, m[14], 0xfde5380c, 23)
+        H1SP_MD5_STEP(H1SP_MD5_H, a, b, c, d, m[ 1], 0xa4beea44,  4)
+        H1SP_MD5_STEP(H1SP_MD5_H, d, a, b, c, m[ 4], 0x4bdecfa9, 11)
+        H1SP_MD5_STEP(H1SP_MD5_H, c, d, a, b, m[ 7], 0xf6bb4b60, 16)
+        H1SP_MD5_STEP(H1SP_MD5_H, b, c, d, a, m[10], 0xbebfbc70, 23)
+        H1SP_MD5_STEP(H1SP_MD5_H, a, b, c, d, m[13], 0x289b7ec6,  4)
+        H1SP_MD5_STEP(H1SP_MD5_H, d, a, b, c, m[ 0], 0xeaa127fa, 11)
+        H1SP_MD5_STEP(H1SP_MD5_H, c, d, a, b, m[ 3], 0xd4ef3085, 16)
+        H1SP_MD5_STEP(H1SP_MD5_H, b, c, d, a, m[ 6], 0x04881d05, 23)
+        H1SP_MD5_STEP(H1SP_MD5_H, a, b, c, d, m[ 9], 0xd9d4d039,  4)
+        H1SP_MD5_STEP(H1SP_MD5_H, d, a, b, c, m[12], 0xe6db99e5, 11)
+        H1SP_MD5_STEP(H1SP_MD5_H, c, d, a, b, m[15], 0x1fa27cf8, 16)
+        H1SP_MD5_STEP(H1SP_MD5_H, b, c, d, a, m[ 2], 0xc4ac5665, 23)
+
+        H1SP_MD5_STEP(H1SP_MD5_I, a, b, c, d, m[ 0], 0xf4292244,  6)
+        H1SP_MD5_STEP(H1SP_MD5_I, d, a, b, c, m[ 7], 0x432aff97, 10)
+        H1SP_MD5_STEP(H1SP_MD5_I, c, d, a, b, m[14], 0xab9423a7, 15)
+        H1SP_MD5_STEP(H1SP_MD5_I, b, c, d, a, m[ 5], 0xfc93a039, 21)
+        H1SP_MD5_STEP(H1SP_MD5_I, a, b, c, d, m[12], 0x655b59c3,  6)
+        H1SP_MD5_STEP(H1SP_MD5_I, d, a, b, c, m[ 3], 0x8f0ccc92, 10)
+        H1SP_MD5_STEP(H1SP_MD5_I, c, d, a, b, m[10], 0xffeff47d, 15)
+        H1SP_MD5_STEP(H1SP_MD5_I, b, c, d, a, m[ 1], 0x85845dd1, 21)
+        H1SP_MD5_STEP(H1SP_MD5_I, a, b, c, d, m[ 8], 0x6fa87e4f,  6)
+        H1SP_MD5_STEP(H1SP_MD5_I, d, a, b, c, m[15], 0xfe2ce6e0, 10)
+        H1SP_MD5_STEP(H1SP_MD5_I, c, d, a, b, m[ 6], 0xa3014314, 15)
+        H1SP_MD5_STEP(H1SP_MD5_I, b, c, d, a, m[13], 0x4e0811a1, 21)
+        H1SP_MD5_STEP(H1SP_MD5_I, a, b, c, d, m[ 4], 0xf7537e82,  6)
+        H1SP_MD5_STEP(H1SP_MD5_I, d, a, b, c, m[11], 0xbd3af235, 10)
+        H1SP_MD5_STEP(H1SP_MD5_I, c, d, a, b, m[ 2], 0x2ad7d2bb, 15)
+        H1SP_MD5_STEP(H1SP_MD5_I, b, c, d, a, m[ 9], 0xeb86d391, 21)
+
+        #undef H1SP_MD5_I
+        #undef H1SP_MD5_H
+        #undef H1SP_MD5_G
+        #undef H1SP_MD5_F
+        #undef H1SP_MD5_STEP
+
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+    }
+
+    void md5_compress(std::uint32_t (&h)[4], const unsigned char* block) noexcept
+    {
+        std::uint32_t m[16];
+        for (int i = 0; i < 16; ++i)
+        {
+            m[i] = deserialize<std::uint32_t, std::endian::little>(
+                reinterpret_cast<const std::byte*>(block) + 4 * i);
+        }
+
+        md5_rounds(h, m);
+    }
+
+    /**
+     * \brief Pads and hashes the last \a tail_size (< 64) bytes of a stream
+     *        of \a length bytes, then writes the digest.
+     */
+    void md5_finish_tail(
+        std::uint32_t (&h)[4],
+        const unsigned char*  tail,
+        std::size_t           tail_size,
+        std::uint64_t         length,
+        unsigned char (&digest)[md5_digest_size]) noexcept
+    {
+        // pad with 0x80, then zeros up to 56 mod 64, then the bit length
+        unsigned char block[64];
+        std::memcpy(block, tail, tail_size);
+        std::size_t fill = tail_size;
+        block[fill++] = 0x80;
+        if (fill > sizeof(block) - sizeof(length))
+        {
+            std::memset(block + fill, 0, sizeof(block) - fill);
+            md5_compress(h, block);
+            fill = 0;
+        }
+        std::memset(block + fill, 0, sizeof(block) - sizeof(length) - fill);
+        serialize<std::endian::little>(length * 8,
+            reinterpret_cast<std::byte*>(block) + sizeof(block) - sizeof(length));
+        md5_compress(h, block);
+
+        for (std::size_t i = 0; i < 4; ++i)
+            serialize<std::endian::little>(h[i], reinterpret_cast<std::byte*>(digest) + 4 * i);
+    }
+
+#if H1SP_MD5_LANES
+    /**
+     * \brief Hashes \a bufs, \c Lanes streams at a time, one per lane of 
+     *        \a Vector.
+     *
+     * Each lane hashes the whole blocks of its stream; when they run out, 
+     * the lane's state is finished with the scalar code and the lane moves
+     * on to the next stream. Lanes without a stream hash a dummy block.
+     */
+    template<typename Vector, std::size_t Lanes>
+    H1SP_MD5_INLINE void md5_lanes(
+        std::span<const std::span<const std::byte>> bufs,
+        std::span<std::array<char, 33>>             digests) noexcept
+    {
+        constexpr std::size_t none = static_cast<std::size_t>(-1);
+        static constexpr unsigned char idle_block[64] = {};
+
+        Vector h[4];
+        std::size_t          stream[Lanes];
+        const unsigned char* next_block[Lanes];
+        std::size_t          blocks_left[Lanes];
+
+        std::size_t next_stream = 0;
+        std::size_t busy_lanes  = 0;
+
+        // Moves lane l on to the next stream with whole blocks, finishing
+        // the ones without any right away.
+        auto refill = [&] (std::size_t l) noexcept {
+            stream[l]     = none;
+            next_block[l] = idle_block;
+            for (; next_stream < bufs.size(); ++next_stream)
+            {
+                const auto& buf  = bufs[next_stream];
+                const auto  data = reinterpret_cast<const unsigned char*>(buf.data());
+                if (buf.size() < 64)
+                {
+                    std::uint32_t state[4] = {md5_iv[0], md5_iv[1], md5_iv[2], md5_iv[3]};
+                    unsigned char digest[md5_digest_size];
+                    md5_finish_tail(state, data, buf.size(), buf.size(), digest);
+                    encode_hex(digest, digests[next_stream]);
+                    continue;
+                }
+
+                stream[l]      = next_stream++;
+                next_block[l]  = data;
+                blocks_left[l] = buf.size() / 64;
+                ++busy_lanes;
+                break;
+            }
+        };
+
+        for (int i = 0; i < 4; ++i)
+            h[i] = Vector{} + md5_iv[i];
+        for (std::size_t l = 0; l < Lanes; ++l)
+            refill(l);
+
+        while (busy_lanes != 0)
+        {
+            Vector m[16];
+            for (int i = 0; i < 16; ++i)
+            {
+                for (std::size_t l = 0; l < Lanes; ++l)
+                {
+                    m[i][l] = deserialize<std::uint32_t, std::endian::little>(
+                        reinterpret_cast<const std::byte*>(next_block[l]) + 4 * i);
+                }
+            }
+
+            md5_rounds(h, m);
+
+            for (std::size_t l = 0; l < Lanes; ++l)
+            {
+                if (stream[l] == none)
+                    continue;
+
+                next_block[l] += 64;
+                if (--blocks_left[l] != 0)
+                    continue;
+
+                const auto& buf = bufs[stream[l]];
+                std::uint32_t state[4] = {h[0][l], h[1][l], h[2][l], h[3][l]};
+                unsigned char digest[md5_digest_size];
+                md5_finish_tail(state, next_block[l], buf.size() % 64, buf.size(), digest);
+                encode_hex(digest, digests[stream[l]]);
+
+                --busy_lanes;
+                refill(l);
+                for (int i = 0; i < 4; ++i)
+                    h[i][l] = md5_iv[i];
+            }
+        }
+    }
+
+    using md5_vector4 = std::uint32_t __attribute__((vector_size(16)));
+
+    void md5_lanes4(
+        std::span<const std::span<const std::byte>> bufs,
+        std::span<std::array<char, 33>>             digests) noexcept
+    {
+        md5_lanes<md5_vector4, 4>(bufs, digests);
+    }
+#endif // H1SP_MD5_LANES
+
+#if H1SP_MD5_X86_DISPATCH
+    using md5_vector8  = std::uint32_t __attribute__((vector_size(32)));
+    using md5_vector16 = std::uint32_t __attribute__((vector_size(64)));
+
+    __attribute__((target("avx2")))
+    void md5_lanes8(
+        std::span<const std::span<const std::byte>> bufs,
+        std::span<std::array<char, 33>>             digests) noexcept
+    {
+        md5_lanes<md5_vector8, 8>(bufs, digests);
+    }
+
+    __attribute__((target("avx512f")))
+    void md5_lanes16(
+        std::span<const std::span<const std::byte>> bufs,
+        std::span<std::array<char, 33>>             digests) noexcept
+    {
+        md5_lanes<md5_vector16, 16>(bufs, digests);
+    }
+#endif // H1SP_MD5_X86_DISPATCH
+
+#if defined(H1SP_BUILTIN_MD5)
+    struct md5_state
+    {
+        std::uint32_t h[4];
+        std::uint64_t length;    ///< Bytes hashed so far.
+        unsigned char block[64]; ///< The partial block of the last update.
+    };
+
+    static_assert(sizeof(md5_state) <= sizeof(md5_context));
+
+    md5_state* get_md5_state(unsigned char* state) noexcept
+    {
+        return reinterpret_cast<md5_state*>(state);
+    }
+#else
+    static_assert(sizeof(EVP_MD_CTX*) <= sizeof(md5_context));
+
+    EVP_MD_CTX*& get_md5_ctx(unsigned char* state) noexcept
+    {
+        return *reinterpret_cast<EVP_MD_CTX**>(state);
+    }
+
+    EVP_MD_CTX* get_md5_ctx(const unsigned char* state) noexcept
+    {
+        return *reinterpret_cast<EVP_MD_CTX* const*>(state);
+    }
+#endif
+}
+
+#if defined(H1SP_BUILTIN_MD5)
+md5_context::md5_context()
+{
+    ::new (static_cast<void*>(state)) md5_state {
+        .h      = {md5_iv[0], md5_iv[1], md5_iv[2], md5_iv[3]},
+        .length = 0,
+        .block  = {}
+    };
+}
+
+md5_context::md5_context(const md5_context& other)
+{
+    std::memcpy(state, other.state, sizeof(md5_state));
+}
+
+md5_context& md5_context::operator=(const md5_context& other)
+{
+    std::memcpy(state, other.state, sizeof(md5_state));
+    return *this;
+}
+
+md5_context::~md5_context() = default;
+
+void md5_context::update(std::span<const std::byte> buf) noexcept
+{
+    H1SP_STATS_SCOPE(md5, buf.size());
+
+    auto& s = *get_md5_state(state);
+    auto data = reinterpret_cast<const unsigned char*>(buf.data());
+    auto size = buf.size();
+
+    std::size_t fill = s.length % sizeof(s.block);
+    s.length += size;
+
+    if (fill != 0)
+    {
+        const std::size_t n = std::min(size, sizeof(s.block) - fill);
+        std::memcpy(s.block + fill, data, n);
+        data += n;
+        size -= n;
+        fill += n;
+        if (fill < sizeof(s.block))
+            return;
+
+        md5_compress(s.h, s.block);
+    }
+
+    for (; size >= sizeof(s.block); data += sizeof(s.block), size -= sizeof(s.block))
+        md5_compress(s.h, data);
+
+    std::memcpy(s.block, data, size);
+}
+
+void md5_context::finish(std::array<char, 33>& hex) noexcept
+{
+    auto& s = *get_md5_state(state);
+
+    unsigned char digest[md5_digest_size];
+    md5_finish_tail(s.h, s.block, s.length % sizeof(s.block), s.length, digest);
+    encode_hex(digest, hex);
+}
+#else
+md5_context::md5_context()
+{
+    auto& ctx = get_md5_ctx(state);
+    ctx = EVP_MD_CTX_new();
+    if (ctx == nullptr || EVP_DigestInit_ex(ctx, EVP_md5(), nullptr) != 1)
+    {
+        EVP_MD_CTX_free(ctx);
+        throw std::bad_alloc{};
+    }
+}
+
+md5_context::md5_context(const md5_context& other)
+{
+    auto& ctx = get_md5_ctx(state);
+    ctx = EVP_MD_CTX_new();
+    if (ctx == nullptr || EVP_MD_CTX_copy_ex(ctx, get_md5_ctx(other.state)) != 1)
+    {
+        EVP_MD_CTX_free(ctx);
+        throw std::bad_alloc{};
+    }
+}
+
+md5_context& md5_context::operator=(const md5_context& other)
+{
+    if (this != &other && EVP_MD_CTX_copy_ex(get_md5_ctx(state), get_md5_ctx(other.state)) != 1)
+        throw std::bad_alloc{};
+
+    return *this;
+}
+
+md5_context::~md5_context()
+{
+    EVP_MD_CTX_free(get_md5_ctx(state));
+}
+
+void md5_context::update(std::span<const std::byte> buf) noexcept
+{
+    H1SP_STATS_SCOPE(md5, buf.size());
+
+    (void)EVP_DigestUpdate(get_md5_ctx(state), buf.data(), buf.size());
+}
+
+void md5_context::finish(std::array<char, 33>& hex) noexcept
+{
+    unsigned char digest[md5_digest_size] = {};
+    (void)EVP_DigestFinal_ex(get_md5_ctx(state), digest, nullptr);
+
+    encode_hex(digest, hex);
+}
+#endif
+
+std::string md5_context::finish()
+{
+    std::array<char, 33> hex;
+    finish(hex);
+    return std::string{hex.data(), hex.size() - 1};
+}
+
+std::size_t md5_lane_count() noexcept
+{
+#if H1SP_MD5_X86_DISPATCH
+    switch (detect_simd_isa())
+    {
+    case simd_isa::avx512: return 16;
+    case simd_isa::avx2:   return 8;
+    default:               break;
+    }
+#endif
+#if H1SP_MD5_LANES
+    return 4;
+#else
+    return 1;
+#endif
+}
+
+void compute_md5_digests(
+    std::span<const std::span<const std::byte>> bufs,
+    std::span<std::array<char, 33>>             digests) noexcept
+{
+#if H1SP_ENABLE_STATS
+    // the single-lane fallback is counted by md5_context::update
+    std::uint64_t total = 0;
+    for (const auto& buf : bufs)
+        total += buf.size();
+    std::optional<stat_scope> scope;
+    if (md5_lane_count() != 1)
+        scope.emplace(stat_stage::md5, total);
+#endif
+
+    switch (md5_lane_count())
+    {
+#if H1SP_MD5_X86_DISPATCH
+    case 16: md5_lanes16(bufs, digests); return;
+    case 8:  md5_lanes8(bufs, digests);  return;
+#endif
+#if H1SP_MD5_LANES
+    case 4:  md5_lanes4(bufs, digests);  return;
+#endif
+    default:
+        break;
+    }
+
+    for (std::size_t i = 0; i < bufs.size(); ++i)
+    {
+        md5_context md5;
+        md5.update(bufs[i]);
+        md5.finish(digests[i]);
+    }
+}
+
+std::string compute_md5_digest(std::span<const std::byte> buf)
+{
+    const auto len = buf.size();
+    if (len > std::numeric_limits<unsigned long>::max())
+        throw std::range_error("buffer length could not be represented as ulong");
+
+    md5_context md5;
+    md5.update(buf);
+    return md5.finish();
+}
+
+} // namespace shader_packager
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "member_file_cache.hpp"
+
+#include <h1sp/io.hpp>
+
+namespace h1sp
+{
+    std::shared_ptr<const shader_packager::byte_buffer> 
+    member_file_cache::read(const std::string& path)
+    {
+        std::promise<std::shared_ptr<const shader_packager::byte_buffer>> promise;
+        std::shared_future<std::shared_ptr<const shader_packager::byte_buffer>> file;
+        bool reader = false;
+        {
+            std::lock_guard lock{mutex};
+            auto [it, inserted] = files.try_emplace(path);
+            if (inserted)
+            {
+                it->second = promise.get_future().share();
+                reader = true;
+            }
+            file = it->second;
+        }
+
+        if (reader)
+        {
+            promise.set_value(std::make_shared<const shader_packager::byte_buffer>(
+                shader_packager::read_file(path.c_str())));
+        }
+
+        return file.get();
+    }
+}
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_MEMBER_FILE_CACHE_HPP
+#define H1SP_MEMBER_FILE_CACHE_HPP
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <h1sp/core.hpp>
+
+namespace h1sp
+{
+    /**
+     * \brief Shares the contents of member files between the operations of 
+     *        a batch, so that each file is read at most once.
+     */
+    class member_file_cache
+    {
+        using file_future = 
+            std::shared_future<std::shared_ptr<const shader_packager::byte_buffer>>;
+
+        std::mutex                         mutex;
+        std::map<std::string, file_future> files;
+
+    public:
+        /**
+         * \brief Gets the contents of \a path, reading it on first use.
+         *
+         * \return The contents; the buffer tests \c false on failure.
+         */
+        std::shared_ptr<const shader_packager::byte_buffer> 
+        read(const std::string& path);
+    };
+}
+
+#endif // H1SP_MEMBER_FILE_CACHE_HPP
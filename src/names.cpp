@@ -2,9 +2,14 @@
 
 #include <h1sp/names.hpp>
 
+#include <cstdint>
+
+#include <algorithm>
+#include <bit>
+
 namespace shader_packager
 {
-    const std::array<const char*, 122> retail_fx_names
+    constexpr std::array<const char*, 122> retail_fx_names
     {
         "environment_lightmap_normal",
         "environment_lightmap_no_lightmap",
@@ -130,7 +135,7 @@ namespace shader_packager
         "model_mask_none"
     };
     
-    const std::array<const char*, 120> custom_fx_names
+    constexpr std::array<const char*, 120> custom_fx_names
     {
         "environment_lightmap_normal",
         "environment_lightmap_no_lightmap",
@@ -254,7 +259,7 @@ namespace shader_packager
         "model_mask_none"
     };
     
-    const std::array<const char*, 64>  vs_names
+    constexpr std::array<const char*, 64>  vs_names
     {
         "convolution",
         "debug",
@@ -321,4 +326,102 @@ namespace shader_packager
         "transparent_water_reflection",
         "transparent_water_reflection_m"
     };
-}
\ No newline at end of file
+    
+    namespace
+    {
+        constexpr std::uint32_t hash_name(
+            const std::string_view name, 
+            const std::uint32_t    seed) noexcept
+        {
+            // FNV-1a, with a final mix so that the low bits used for the 
+            // slot depend on every character
+            std::uint32_t h = 2166136261u ^ seed;
+            for (const char c : name)
+            {
+                h ^= static_cast<unsigned char>(c);
+                h *= 16777619u;
+            }
+            h ^= h >> 16;
+            h *= 0x7FEB352Du;
+            h ^= h >> 15;
+            return h;
+        }
+        
+        /**
+         * \brief A collision-free hash table mapping each name of a list to 
+         *        its index in the list.
+         */
+        template<std::size_t N>
+        struct perfect_hash_table
+        {
+            static_assert(N < 255, "slots store indices as uint8");
+            
+            // Sized so that a collision-free seed is found in a few tries.
+            static constexpr std::size_t size = std::bit_ceil(N * N / 4 + 1);
+            
+            std::uint32_t                     seed = 0;
+            std::array<std::uint8_t, size>    slots{}; ///< index + 1, or 0.
+            
+            constexpr std::size_t slot_of(std::string_view name) const noexcept
+            {
+                return hash_name(name, seed) & (size - 1);
+            }
+            
+            std::size_t find(
+                const std::array<const char*, N>& names, 
+                const std::string_view            name) const noexcept
+            {
+                const std::size_t slot = slots[slot_of(name)];
+                if (slot == 0 || names[slot - 1] != name)
+                    return N;
+                return slot - 1;
+            }
+        };
+        
+        template<std::size_t N>
+        consteval perfect_hash_table<N> make_perfect_hash_table(
+            const std::array<const char*, N>& names)
+        {
+            perfect_hash_table<N> table;
+            for (;; ++table.seed)
+            {
+                std::fill(table.slots.begin(), table.slots.end(), 0);
+                
+                bool collision = false;
+                for (std::size_t i = 0; i < N && !collision; ++i)
+                {
+                    auto& slot = table.slots[table.slot_of(names[i])];
+                    collision = slot != 0;
+                    slot = static_cast<std::uint8_t>(i + 1);
+                }
+                
+                if (!collision)
+                    return table;
+            }
+        }
+        
+        constexpr auto retail_fx_table = make_perfect_hash_table(retail_fx_names);
+        constexpr auto custom_fx_table = make_perfect_hash_table(custom_fx_names);
+        constexpr auto vs_table        = make_perfect_hash_table(vs_names);
+    }
+    
+    std::size_t find_name(
+        const std::span<const char* const> names, 
+        const std::string_view             name) noexcept
+    {
+        if (names.data() == retail_fx_names.data() && 
+            names.size() == retail_fx_names.size())
+            return retail_fx_table.find(retail_fx_names, name);
+        
+        if (names.data() == custom_fx_names.data() && 
+            names.size() == custom_fx_names.size())
+            return custom_fx_table.find(custom_fx_names, name);
+        
+        if (names.data() == vs_names.data() && 
+            names.size() == vs_names.size())
+            return vs_table.find(vs_names, name);
+        
+        return static_cast<std::size_t>(
+            std::find(names.begin(), names.end(), name) - names.begin());
+    }
+}
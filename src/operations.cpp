@@ -0,0 +1,1119 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "operations.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <filesystem>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <h1sp/archive.hpp>
+#include <h1sp/batch_io.hpp>
+#include <h1sp/content_store.hpp>
+#include <h1sp/core.hpp>
+#include <h1sp/io.hpp>
+#include <h1sp/manifest.hpp>
+#include <h1sp/stats.hpp>
+#include <h1sp/thread_pool.hpp>
+
+#if defined(_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+namespace h1sp
+{
+    namespace
+    {
+        /**
+         * \brief Matches \a name against a glob \a pattern, where `*` matches 
+         *        any run of characters and `?` matches any single character.
+         */
+        bool glob_match(std::string_view pattern, std::string_view name) noexcept
+        {
+            std::size_t p = 0, n = 0;
+            std::size_t star = pattern.npos, star_n = 0;
+
+            while (n < name.size())
+            {
+                if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+                {
+                    ++p;
+                    ++n;
+                } else if (p < pattern.size() && pattern[p] == '*')
+                {
+                    star   = p++;
+                    star_n = n;
+                } else if (star != pattern.npos)
+                {
+                    // let the last * absorb one more character and retry
+                    p = star + 1;
+                    n = ++star_n;
+                } else
+                {
+                    return false;
+                }
+            }
+
+            while (p < pattern.size() && pattern[p] == '*')
+                ++p;
+
+            return p == pattern.size();
+        }
+
+        bool matches_any(
+            const std::vector<std::string_view>& patterns, 
+            const std::string_view               name) noexcept
+        {
+            return std::any_of(patterns.begin(), patterns.end(), 
+                [name] (std::string_view pattern) { 
+                    return glob_match(pattern, name); 
+                });
+        }
+
+        // Gets the path of the content index written next to the member files
+        // of op when unpacking into a content store.
+        std::string content_index_path(const operation_context& op)
+        {
+            return std::string{op.prefix} + "h1sp-cas.index";
+        }
+
+        // Finds the members at indices whose data is the same as that of an 
+        // earlier one. Returns, for each position in indices, the position of 
+        // the first member with the same data, which is its own for a member 
+        // that is not a duplicate.
+        std::vector<std::size_t> find_duplicates(
+            const operation_context&        op, 
+            const shader_packager::archive& archive,
+            std::span<const std::size_t>    indices)
+        {
+            const auto digests = hash_members(archive, indices, op.threads);
+
+            // a digest match is confirmed byte for byte before it is trusted
+            std::vector<std::size_t> original(indices.size());
+            std::unordered_map<std::string_view, std::size_t> first_with;
+            for (std::size_t k = 0; k < indices.size(); ++k)
+            {
+                const auto [it, added] = first_with.try_emplace(
+                    std::string_view{digests[k].data(), 32}, k);
+                const auto member = *archive.member(indices[k]);
+                const auto first  = *archive.member(indices[it->second]);
+                original[k] = !added && std::equal(member.begin(), member.end(), 
+                                                   first.begin(), first.end()) 
+                            ? it->second : k;
+            }
+
+            return original;
+        }
+
+        // Writes the members of archive at the given indices to their files, 
+        // using up to op.io_jobs concurrent writes.
+        // Returns nullptr on success, otherwise returns an error string
+        const char* write_members(
+            const operation_context&        op, 
+            const shader_packager::archive& archive,
+            std::span<const std::size_t>    indices)
+        {
+            const char* extension = op.profile->extension.c_str();
+            const auto names = op.profile->names;
+
+            // With a content store, each member is stored once by its digest 
+            // and its file becomes a link to it; the index records the links.
+            std::optional<shader_packager::content_store> store;
+            std::optional<shader_packager::content_index> index;
+            if (op.cas != nullptr)
+            {
+                store.emplace(op.cas);
+                index = shader_packager::content_index::read_from_file(
+                    content_index_path(op).c_str());
+                if (!index)
+                    index.emplace();
+            } else
+            {
+                // Otherwise the members are written straight from the archive, 
+                // submitted together through the platform's batch I/O. With 
+                // --dedupe, only the first of the members with the same data is
+                // written, and the files of the others are links to its file.
+                std::vector<std::size_t> original(indices.size());
+                if (op.dedupe)
+                    original = find_duplicates(op, archive, indices);
+                else
+                    std::iota(original.begin(), original.end(), std::size_t{0});
+
+                std::vector<std::string> paths;
+                paths.reserve(indices.size());
+                std::vector<shader_packager::file_write> writes;
+                writes.reserve(indices.size());
+                std::vector<std::size_t> written;
+                written.reserve(indices.size());
+                for (std::size_t k = 0; k < indices.size(); ++k)
+                {
+                    char dstname[1024];
+                    std::snprintf(dstname, std::size(dstname), "%s%s.%s",
+                        op.prefix, names[indices[k]], extension
+                    );
+                    paths.emplace_back(dstname);
+                    if (original[k] == k)
+                    {
+                        writes.push_back({nullptr, *archive.member(indices[k])});
+                        written.push_back(k);
+                    }
+                }
+                // A member file left by an unpack with --cas may be a 
+                // read-only link to a store object; it is replaced rather 
+                // than written through.
+                std::error_code ec;
+                for (std::size_t w = 0; w < writes.size(); ++w)
+                {
+                    writes[w].path = paths[written[w]].c_str();
+                    std::filesystem::remove(paths[written[w]], ec);
+                }
+
+                const std::size_t failed = shader_packager::write_files(writes, {
+                    .direct = op.direct_io,
+                    .jobs   = op.io_jobs
+                });
+                if (failed != writes.size())
+                {
+                    std::fprintf(op.messages, "failed to write member %s\n", names[indices[written[failed]]]);
+                    return "failed to write member to corresponding file";
+                }
+
+                std::size_t linked_bytes = 0;
+                for (std::size_t k = 0; k < indices.size(); ++k)
+                {
+                    if (original[k] == k)
+                        continue;
+
+                    if (!shader_packager::link_file(paths[original[k]], paths[k]))
+                    {
+                        std::fprintf(op.messages, "failed to write member %s\n", names[indices[k]]);
+                        return "failed to write member to corresponding file";
+                    }
+
+                    linked_bytes += archive.member(indices[k])->size();
+                    std::fprintf(op.messages, "duplicate %s of %s\n", 
+                        names[indices[k]], names[indices[original[k]]]);
+                }
+                if (op.dedupe)
+                {
+                    std::fprintf(op.messages, "linked %zu duplicate members (%zu bytes) to their first copy\n",
+                        indices.size() - writes.size(), linked_bytes);
+                }
+
+                std::fprintf(op.messages, "unpacked %d archive members prefixed with %s\n",
+                    (int)indices.size(), op.prefix);
+                return nullptr;
+            }
+
+            std::vector<std::future<std::optional<shader_packager::content_index::entry>>> written;
+            written.reserve(indices.size());
+
+            // the pool waits for queued writes before it is destroyed
+            shader_packager::thread_pool pool{op.io_jobs};
+            for (const std::size_t i : indices)
+            {
+                written.push_back(pool.submit([&op, &archive, &store, extension, names, i] {
+                    H1SP_STATS_MEMBER_SCOPE(member_write, archive.member(i)->size(), names[i]);
+
+                    char dstname[1024];
+                    std::snprintf(dstname, std::size(dstname), "%s%s.%s",
+                        op.prefix, names[i], extension
+                    );
+
+                    shader_packager::content_index::entry entry {};
+                    const auto member = *archive.member(i);
+                    entry.name = std::string{dstname + std::strlen(op.prefix)};
+                    entry.hash = shader_packager::compute_md5_digest(member);
+                    if (!store->put(entry.hash, member) || !store->link(entry.hash, dstname))
+                        return std::optional<shader_packager::content_index::entry>{};
+
+                    const auto stamp = shader_packager::stat_file(dstname);
+                    if (!stamp)
+                        return std::optional<shader_packager::content_index::entry>{};
+                    entry.stamp = *stamp;
+                    return std::optional{std::move(entry)};
+                }));
+            }
+
+            // report the first failure in member order
+            for (std::size_t k = 0; k < written.size(); ++k)
+            {
+                auto entry = written[k].get();
+                if (!entry)
+                {
+                    std::fprintf(op.messages, "failed to write member %s\n", names[indices[k]]);
+                    return "failed to write member to corresponding file";
+                }
+                index->assign(std::move(*entry));
+            }
+
+            if (!index->write_to_file(content_index_path(op).c_str()))
+                return "could not write the content index";
+
+            std::fprintf(op.messages, "unpacked %d archive members prefixed with %s\n",
+                (int)indices.size(), op.prefix);
+            return nullptr;
+        }
+
+        // Writes the members of archive selected by op.only to their files.
+        // Returns nullptr on success, otherwise returns an error string
+        const char* unpack_selected_members(
+            const operation_context&        op, 
+            const shader_packager::archive& archive)
+        {
+            const auto names = op.profile->names;
+
+            // a pattern that selects nothing is most likely a typo
+            for (const auto pattern : op.only)
+            {
+                const bool any = std::any_of(names.begin(), names.end(), 
+                    [pattern] (const char* name) { return glob_match(pattern, name); });
+                if (!any)
+                {
+                    std::fprintf(op.messages, "no member matches %.*s\n", 
+                        (int)pattern.size(), pattern.data());
+                    return "--only selected a member that does not exist";
+                }
+            }
+
+            std::vector<std::size_t> selected;
+            for (std::size_t i = 0; i < names.size(); ++i)
+            {
+                if (!matches_any(op.only, names[i]))
+                    continue;
+
+                if (i >= archive.member_count())
+                {
+                    std::fprintf(op.messages, "archive has no member %s\n", names[i]);
+                    return "loaded archive has missing members";
+                }
+
+                selected.push_back(i);
+            }
+
+            return write_members(op, archive, selected);
+        }
+
+        // Returns nullptr on success, otherwise returns an error string
+        const char* perform_unpack_operation(const operation_context& op)
+        {
+            using enum shader_packager::archive::read_error;
+
+            // load the archive and check for errors
+            shader_packager::archive archive;
+            archive.set_cipher(op.profile->cipher);
+            {
+                // Prefer mapping the file; fall back to reading it, which also 
+                // reports why the file could not be opened.
+                auto error = archive.open_mapped(op.file, op.threads);
+                if (error == could_not_open_file)
+                    error = archive.read_from_file(op.file, op.threads);
+
+                switch (error)
+                {
+                case success:
+                    break; // continue processing
+                case could_not_open_file:
+                    return "could not open file";
+                case archive_data_is_corrupt:
+                    return "archive is corrupt";
+                default:
+                    return "unknown read error";
+                }
+            }
+
+            if (!op.only.empty())
+                return unpack_selected_members(op, archive);
+
+            // write each archive member to its own file; members beyond the 
+            // known names are ignored, as Halo does not treat them as an error
+            const auto names = op.profile->names;
+            std::vector<std::size_t> members(std::min(archive.member_count(), names.size()));
+            std::iota(members.begin(), members.end(), std::size_t{0});
+
+            return write_members(op, archive, members);
+        }
+
+        // Unpacks an archive read from standard input as it arrives, holding no 
+        // more than a window of it in memory at once. The members are written 
+        // before the digest is known, to their .partial files with --atomic.
+        // Returns nullptr on success, otherwise returns an error string
+        const char* perform_stream_unpack_operation(const operation_context& op)
+        {
+            namespace sp = shader_packager;
+
+            if (op.cas != nullptr)
+                return "--cas cannot be used when unpacking from standard input";
+
+            if (op.dedupe)
+                return "--dedupe cannot be used when unpacking from standard input";
+
+            const auto names = op.profile->names;
+            const char* extension = op.profile->extension.c_str();
+
+            // a pattern that selects nothing is most likely a typo
+            for (const auto pattern : op.only)
+            {
+                const bool any = std::any_of(names.begin(), names.end(), 
+                    [pattern] (const char* name) { return glob_match(pattern, name); });
+                if (!any)
+                {
+                    std::fprintf(op.messages, "no member matches %.*s\n", 
+                        (int)pattern.size(), pattern.data());
+                    return "--only selected a member that does not exist";
+                }
+            }
+
+            // Member data arrives in pieces of any size: the splitter collects 
+            // each size header, then passes the member's bytes to its file.
+            // Members beyond the known names are ignored, as when unpacking a file.
+            struct
+            {
+                std::array<std::byte, 4> header      = {};
+                std::size_t              header_fill = 0;
+                std::uint64_t            remaining   = 0;
+                std::size_t              index       = 0;
+                std::unique_ptr<std::FILE, decltype(&std::fclose)> out {nullptr, &std::fclose};
+            } member;
+            std::vector<std::string> written;   // the files written, in order
+            std::vector<std::size_t> unpacked;  // the members they hold
+            bool write_failed = false;
+
+            const auto end_member = [&] {
+                if (member.out && std::fclose(member.out.release()) != 0)
+                    write_failed = true;
+                ++member.index;
+            };
+            const auto begin_member = [&] (const std::uint64_t size) {
+                member.remaining = size;
+                const std::size_t i = member.index;
+                const bool selected = 
+                    i < names.size() && (op.only.empty() || matches_any(op.only, names[i]));
+                if (selected && !write_failed)
+                {
+                    char dstname[1024];
+                    std::snprintf(dstname, std::size(dstname), "%s%s.%s%s",
+                        op.prefix, names[i], extension, op.atomic ? ".partial" : "");
+                    std::error_code ec;
+                    std::filesystem::remove(dstname, ec);
+                    member.out.reset(std::fopen(dstname, "wb"));
+                    if (!member.out)
+                    {
+                        std::fprintf(op.messages, "failed to write member %s\n", names[i]);
+                        write_failed = true;
+                    } else
+                    {
+                        written.emplace_back(dstname);
+                        unpacked.push_back(i);
+                    }
+                }
+                if (size == 0)
+                    end_member();
+            };
+            const auto on_data = [&] (std::span<const std::byte> data) {
+                while (!data.empty())
+                {
+                    if (member.remaining == 0)
+                    {
+                        const std::size_t n = std::min(
+                            data.size(), member.header.size() - member.header_fill);
+                        std::copy_n(data.begin(), n, member.header.begin() + member.header_fill);
+                        member.header_fill += n;
+                        data = data.subspan(n);
+                        if (member.header_fill == member.header.size())
+                        {
+                            member.header_fill = 0;
+                            begin_member(sp::deserialize<std::uint32_t, std::endian::little>(
+                                member.header.data()));
+                        }
+                        continue;
+                    }
+
+                    const std::size_t n = static_cast<std::size_t>(
+                        std::min<std::uint64_t>(data.size(), member.remaining));
+                    if (member.out && 
+                        std::fwrite(data.data(), sizeof(std::byte), n, member.out.get()) != n)
+                    {
+                        std::fprintf(op.messages, "failed to write member %s\n", names[unpacked.back()]);
+                        member.out.reset();
+                        write_failed = true;
+                    }
+                    member.remaining -= n;
+                    data = data.subspan(n);
+                    if (member.remaining == 0)
+                        end_member();
+                }
+            };
+
+#if defined(_WIN32)
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            // with --atomic, a failed unpack leaves no .partial files behind
+            const auto discard = [&] {
+                member.out.reset();
+                if (op.atomic)
+                {
+                    for (const auto& file : written)
+                        std::remove(file.c_str());
+                }
+            };
+
+            sp::archive_decoder decoder{op.profile->cipher};
+            {
+                std::vector<std::byte> buf(64 * 1024);
+                std::size_t n;
+                while ((n = std::fread(buf.data(), sizeof(std::byte), buf.size(), stdin)) != 0)
+                    decoder.update(std::span{buf}.first(n), on_data);
+                if (std::ferror(stdin))
+                {
+                    discard();
+                    return "could not read standard input";
+                }
+            }
+            sp::archive_summary summary;
+            const auto verdict = decoder.finish(&summary, on_data);
+            member.out.reset(); // a member cut short by the end of the archive
+
+            switch (verdict)
+            {
+            case sp::core_error::success:
+                break;
+            case sp::core_error::digest_mismatch:
+                std::fprintf(stderr, 
+                    "md5 did not match\n"
+                    "\tcomputed %.32s\n"
+                    "\tneeded %.32s\n",
+                    summary.computed.data(),
+                    summary.digest.data());
+                discard();
+                return "archive is corrupt";
+            case sp::core_error::corrupt_member:
+                std::fprintf(stderr, "error at archive member %ld\n", 
+                    static_cast<long>(summary.member_count));
+                discard();
+                return "archive is corrupt";
+            default:
+                discard();
+                return "archive is corrupt";
+            }
+
+            if (write_failed)
+            {
+                discard();
+                return "failed to write member to corresponding file";
+            }
+
+            if (!op.only.empty())
+            {
+                for (std::size_t i = summary.member_count; i < names.size(); ++i)
+                {
+                    if (matches_any(op.only, names[i]))
+                    {
+                        std::fprintf(op.messages, "archive has no member %s\n", names[i]);
+                        discard();
+                        return "loaded archive has missing members";
+                    }
+                }
+            }
+
+            // the digest matches: commit the members
+            if (op.atomic)
+            {
+                for (std::size_t k = 0; k < written.size(); ++k)
+                {
+                    const auto& partial = written[k];
+                    std::error_code ec;
+                    std::filesystem::rename(partial, partial.substr(0, partial.size() - 8), ec);
+                    if (ec)
+                    {
+                        std::fprintf(op.messages, "failed to write member %s\n", names[unpacked[k]]);
+                        return "failed to write member to corresponding file";
+                    }
+                }
+            }
+
+            std::fprintf(op.messages, "unpacked %d archive members prefixed with %s\n",
+                (int)written.size(), op.prefix);
+            return nullptr;
+        }
+
+        // Packs like perform_pack_operation, but reuses what it can from the 
+        // archive previously written to op.file, as recorded by its manifest.
+        // Returns nullptr on success, otherwise returns an error string
+        const char* perform_incremental_pack_operation(const operation_context& op)
+        {
+            namespace sp = shader_packager;
+
+            const auto names = op.profile->names;
+            const char* extension = op.profile->extension.c_str();
+            const std::string manifest_path = std::string{op.file} + ".manifest";
+
+            auto member_path = [&op, extension] (const char* name) {
+                char filepath[1024];
+                std::snprintf(filepath, std::size(filepath), "%s%s.%s",
+                    op.prefix, name, extension);
+                return std::string{filepath};
+            };
+
+            // The previous archive is the cached plaintext image; it is only 
+            // trusted if it is the one the manifest describes.
+            sp::archive previous;
+            previous.set_cipher(op.profile->cipher);
+            auto manifest = sp::pack_manifest::read_from_file(manifest_path.c_str());
+            const bool cached = [&] {
+                if (!manifest || manifest->entries.size() != names.size())
+                    return false;
+                for (std::size_t i = 0; i < names.size(); ++i)
+                {
+                    if (manifest->entries[i].name != names[i])
+                        return false;
+                }
+                const auto stamp = sp::stat_file(op.file);
+                if (!stamp || stamp->size != manifest->archive_size)
+                    return false;
+                if (previous.open_mapped(op.file, op.threads) != 
+                    sp::archive::read_error::success)
+                    return false;
+                return previous.member_count() == names.size() &&
+                       previous.digest() == manifest->archive_digest;
+            }();
+
+            // Work out which members changed: an unchanged stamp means the 
+            // member is reused without reading it; otherwise the file is read 
+            // and only counts as changed if its contents differ.
+            struct member_source
+            {
+                sp::byte_buffer            fresh;   ///< Contents read from disk.
+                std::span<const std::byte> bytes;   ///< The member data to pack.
+                sp::pack_manifest::entry   entry;
+                bool                       changed;
+            };
+            std::vector<member_source> members(names.size());
+            {
+                std::vector<std::future<sp::byte_buffer>> reads(names.size());
+                sp::thread_pool pool{op.io_jobs};
+
+                for (std::size_t i = 0; i < names.size(); ++i)
+                {
+                    const auto path = member_path(names[i]);
+                    const auto stamp = sp::stat_file(path.c_str());
+                    auto& m = members[i];
+                    m.entry.name = names[i];
+
+                    if (cached && stamp && *stamp == manifest->entries[i].stamp)
+                    {
+                        m.entry   = manifest->entries[i];
+                        m.bytes   = *previous.member(i);
+                        m.changed = false;
+                        continue;
+                    }
+
+                    if (stamp)
+                        m.entry.stamp = *stamp;
+                    reads[i] = pool.submit([path] { 
+                        return sp::read_file(path.c_str()); 
+                    });
+                }
+
+                for (std::size_t i = 0; i < names.size(); ++i)
+                {
+                    if (!reads[i].valid())
+                        continue;
+
+                    auto& m = members[i];
+                    m.fresh = reads[i].get();
+                    if (!m.fresh || m.fresh.nbytes > std::numeric_limits<std::uint32_t>::max())
+                    {
+                        std::fprintf(stderr, "on file %s: \n", member_path(names[i]).c_str());
+                        return m.fresh ? "member file is too large" 
+                                       : "failed to read member file";
+                    }
+
+                    m.bytes = m.fresh.range();
+                    const auto md5 = sp::compute_md5_digest(m.bytes);
+                    m.changed = !cached 
+                             || manifest->entries[i].hash != md5
+                             || manifest->entries[i].stamp.size != m.bytes.size();
+                    m.entry.hash = md5;
+                }
+            }
+
+            // Lay out the new plaintext image, noting where it first differs 
+            // from the previous one.
+            std::size_t data_size    = 0;
+            std::size_t first_change = 0;
+            bool        any_change   = false;
+            for (auto& m : members)
+            {
+                m.entry.offset = data_size;
+                if (m.changed && !any_change)
+                {
+                    any_change   = true;
+                    first_change = data_size;
+                }
+                data_size += sizeof(std::uint32_t) + m.bytes.size();
+            }
+            if (!any_change)
+                first_change = data_size;
+            if (!cached)
+                first_change = 0;
+
+            sp::pack_manifest next {
+                .archive_digest = {},
+                .archive_size   = data_size + 33,
+                .entries        = {}
+            };
+
+            if (cached && !any_change)
+            {
+                // same contents, only refresh the stamps
+                next.archive_digest = std::string{previous.digest()};
+                for (auto& m : members)
+                    next.entries.push_back(std::move(m.entry));
+                if (!next.write_to_file(manifest_path.c_str()))
+                    return "could not write the pack manifest";
+
+                std::fprintf(op.messages, "%s is up to date\n", op.file);
+                return nullptr;
+            }
+
+            sp::byte_buffer image {
+                .buffer = std::unique_ptr<std::byte[]>(new std::byte[data_size + 33]),
+                .nbytes = data_size + 33
+            };
+            {
+                std::byte* cursor = image.buffer.get();
+                for (const auto& m : members)
+                {
+                    cursor = sp::serialize<std::endian::little>(
+                        static_cast<std::uint32_t>(m.bytes.size()), cursor);
+                    cursor = std::copy(m.bytes.begin(), m.bytes.end(), cursor);
+                }
+
+                const auto md5 = sp::compute_md5_digest(image.range().first(data_size));
+                std::copy_n(reinterpret_cast<const std::byte*>(md5.c_str()), 33, cursor);
+                next.archive_digest = md5;
+            }
+            for (auto& m : members)
+                next.entries.push_back(std::move(m.entry));
+
+            // TEA chunks do not chain, so every chunk before the first change 
+            // already holds the right ciphertext in the previous archive.
+            const auto chunk_size = op.profile->cipher.chunk_size;
+            const std::size_t keep = first_change - (first_change % chunk_size);
+            op.profile->cipher.encrypt(image.range().subspan(keep), op.threads);
+
+            members.clear();
+            previous = sp::archive{}; // unmap before rewriting the file
+
+            // The new archive is made in a .partial file beside op.file, from a 
+            // copy of the previous one when its leading chunks are kept, and 
+            // only renamed over op.file once it is whole; the manifest follows.
+            // A failed pack leaves the previous archive and manifest as they were.
+            {
+                const std::string partial = std::string{op.file} + ".partial";
+                std::error_code ec;
+                auto discard = [&] (const char* error) {
+                    std::filesystem::remove(partial, ec);
+                    return error;
+                };
+
+                if (keep > 0)
+                {
+                    std::filesystem::copy_file(op.file, partial, 
+                        std::filesystem::copy_options::overwrite_existing, ec);
+                    if (ec)
+                        return discard("could not write output file");
+                }
+
+                std::FILE* fp = std::fopen(partial.c_str(), keep > 0 ? "r+b" : "wb");
+                if (fp == nullptr)
+                    return discard("could not open output file for writing");
+                const std::size_t size = image.nbytes - keep;
+                const bool written = 
+                    std::fseek(fp, static_cast<long>(keep), SEEK_SET) == 0 &&
+                    std::fwrite(image.buffer.get() + keep, sizeof(std::byte), size, fp) == size;
+                if (std::fclose(fp) != 0 || !written)
+                    return discard("could not write output file");
+
+                std::filesystem::resize_file(partial, image.nbytes, ec);
+                if (ec)
+                    return discard("could not resize output file");
+                std::filesystem::rename(partial, op.file, ec);
+                if (ec)
+                    return discard("could not replace output file");
+            }
+
+            if (!next.write_to_file(manifest_path.c_str()))
+                return "could not write the pack manifest";
+
+            std::fprintf(op.messages, "re-encrypted %zu of %zu archive bytes\n", 
+                image.nbytes - keep, image.nbytes);
+            return nullptr;
+        }
+
+        // Gets the file each member of op is read from: its member file, or the
+        // content store object it was linked from, while it is unchanged since.
+        std::vector<std::string> member_sources(const operation_context& op)
+        {
+            namespace sp = shader_packager;
+
+            const auto names = op.profile->names;
+            const char* extension = op.profile->extension.c_str();
+
+            // Member files still as they were linked from a content store are 
+            // read from their objects instead, so that a batch reads each 
+            // distinct member once.
+            std::optional<sp::content_store> store;
+            std::optional<sp::content_index> index;
+            if (op.cas != nullptr)
+            {
+                store.emplace(op.cas);
+                index = sp::content_index::read_from_file(content_index_path(op).c_str());
+            }
+
+            std::vector<std::string> sources;
+            sources.reserve(names.size());
+            for (const char* name : names)
+            {
+                char filepath[1024];
+                std::snprintf(filepath, std::size(filepath), "%s%s.%s",
+                    op.prefix, name, extension);
+
+                const auto* entry = index ? index->find(filepath + std::strlen(op.prefix)) 
+                                          : nullptr;
+                if (entry != nullptr && sp::stat_file(filepath) == entry->stamp)
+                    sources.push_back(store->object_path(entry->hash).string());
+                else
+                    sources.push_back(filepath);
+            }
+
+            return sources;
+        }
+
+        const char* perform_pack_operation(const operation_context& op)
+        {
+            namespace sp = shader_packager;
+
+            const auto names = op.profile->names;
+            const char* extension = op.profile->extension.c_str();
+            const auto sources = member_sources(op);
+
+            auto member_error = [&] (const std::size_t i, const char* error) {
+                char filepath[1024];
+                std::snprintf(filepath, std::size(filepath), "%s%s.%s",
+                    op.prefix, names[i], extension);
+                std::fprintf(stderr, "on file %s: \n", filepath);
+                return error;
+            };
+
+            // Lay out the whole archive from the member file sizes, so that it 
+            // takes a single allocation and each member is read straight into 
+            // its slot after its size header.
+            std::vector<std::size_t> sizes(names.size());
+            std::size_t archive_size = 33;
+            for (std::size_t i = 0; i < names.size(); ++i)
+            {
+                const auto stamp = sp::stat_file(sources[i].c_str());
+                if (!stamp)
+                    return member_error(i, "failed to read member file");
+                if (stamp->size > std::numeric_limits<std::uint32_t>::max())
+                    return member_error(i, "member file is too large");
+
+                sizes[i] = static_cast<std::size_t>(stamp->size);
+                archive_size += sizeof(std::uint32_t) + sizes[i];
+            }
+            if (names.empty())
+                return "no data to write";
+
+            sp::byte_buffer image {
+                .buffer = std::unique_ptr<std::byte[]>(new std::byte[archive_size]),
+                .nbytes = archive_size
+            };
+            std::vector<std::span<std::byte>> slots;
+            slots.reserve(names.size());
+            {
+                std::byte* cursor = image.buffer.get();
+                for (const std::size_t size : sizes)
+                {
+                    cursor = sp::serialize<std::endian::little>(
+                        static_cast<std::uint32_t>(size), cursor);
+                    slots.emplace_back(cursor, size);
+                    cursor += size;
+                }
+            }
+
+            // The output is written a window at a time, as archive_writer 
+            // writes it: every whole chunk before the trailer is final once 
+            // hashed, so it is encrypted and written while later members are read.
+            const std::size_t chunk_size   = op.profile->cipher.chunk_size;
+            const std::size_t window_size  = sp::archive_window_size(op.threads);
+            const std::size_t data_size    = archive_size - 33;
+            const std::size_t final_chunks = data_size - data_size % chunk_size;
+
+            // The windows go to a .partial file beside op.file, which is only 
+            // renamed over it once the whole archive is written, so a failed 
+            // pack leaves the previous archive as it was.
+            const std::string partial = std::string{op.file} + ".partial";
+            std::unique_ptr<std::FILE, decltype(&std::fclose)> output{nullptr, &std::fclose};
+            auto discard = [&] (const char* error) {
+                if (output)
+                {
+                    output.reset();
+                    std::remove(partial.c_str());
+                }
+                return error;
+            };
+            const sp::archive_sink sink = [&] (const std::span<const std::byte> bytes) {
+                if (!output)
+                    output.reset(std::fopen(partial.c_str(), "wb"));
+                return output && 
+                    std::fwrite(bytes.data(), sizeof(std::byte), bytes.size(), output.get()) == bytes.size();
+            };
+
+            std::size_t flushed = 0;
+            auto flush = [&] (const std::size_t upto, const bool last) -> const char* {
+                const auto written = sp::flush_archive_windows(
+                    image.range().subspan(flushed, upto - flushed), last, 
+                    window_size, op.threads, op.profile->cipher, sink);
+                if (!written)
+                    return output ? "could not write output file" 
+                                  : "could not open output file for writing";
+                flushed += *written;
+                return nullptr;
+            };
+
+            // Read the member files concurrently, up to --io-jobs ahead of the 
+            // one being hashed. Files shared through the batch cache are copied 
+            // into their slot instead. The pool waits for queued reads before 
+            // it is destroyed, and so before the image is.
+            std::vector<std::future<bool>> reads;
+            reads.reserve(names.size());
+            {
+                sp::thread_pool pool{op.io_jobs};
+                for (std::size_t i = 0; i < names.size(); ++i)
+                {
+                    reads.push_back(pool.submit([&op, &sources, &slots, names, i] {
+                        const auto slot = slots[i];
+                        H1SP_STATS_MEMBER_SCOPE(member_read, slot.size(), names[i]);
+
+                        if (op.cache == nullptr)
+                            return static_cast<bool>(sp::read_file(sources[i].c_str(), slot));
+
+                        const auto filebuf = op.cache->read(sources[i]);
+                        if (!*filebuf || filebuf->nbytes != slot.size())
+                            return false;
+                        std::copy_n(filebuf->data(), slot.size(), slot.data());
+                        return true;
+                    }));
+                }
+
+                sp::md5_context md5;
+                std::size_t hashed = 0;
+                for (std::size_t i = 0; i < names.size(); ++i)
+                {
+                    if (!reads[i].get())
+                        return discard(member_error(i, "failed to read member file"));
+
+                    const std::size_t end = static_cast<std::size_t>(
+                        slots[i].data() + slots[i].size() - image.buffer.get());
+                    while (hashed < end)
+                    {
+                        const std::size_t n = std::min(window_size, end - hashed);
+                        md5.update(image.range().subspan(hashed, n));
+                        hashed += n;
+
+                        const std::size_t ready = std::min(hashed, final_chunks) 
+                                                / chunk_size * chunk_size;
+                        if (const char* error = flush(ready, false))
+                            return discard(error);
+                    }
+                }
+
+                std::array<char, 33> digest;
+                md5.finish(digest);
+                std::copy_n(
+                    reinterpret_cast<const std::byte*>(digest.data()), 
+                    digest.size(), 
+                    image.buffer.get() + data_size);
+            }
+
+            // the rest, including the tailing chunk
+            if (const char* error = flush(archive_size, true))
+                return discard(error);
+            if (std::fclose(output.release()) != 0)
+            {
+                std::remove(partial.c_str());
+                return "could not write output file";
+            }
+
+            std::error_code ec;
+            std::filesystem::rename(partial, op.file, ec);
+            if (ec)
+            {
+                std::remove(partial.c_str());
+                return "could not replace output file";
+            }
+
+            return nullptr;
+        }
+
+        // Packs to standard output a member at a time, holding no more than 
+        // --io-jobs member files and a window of the archive in memory at once.
+        // Returns nullptr on success, otherwise returns an error string
+        const char* perform_stream_pack_operation(const operation_context& op)
+        {
+            namespace sp = shader_packager;
+
+            if (op.incremental)
+                return "--incremental cannot be used when packing to standard output";
+
+            const auto names = op.profile->names;
+            const char* extension = op.profile->extension.c_str();
+            const auto sources = member_sources(op);
+            if (names.empty())
+                return "no data to write";
+
+            auto member_error = [&] (const std::size_t i, const char* error) {
+                char filepath[1024];
+                std::snprintf(filepath, std::size(filepath), "%s%s.%s",
+                    op.prefix, names[i], extension);
+                std::fprintf(stderr, "on file %s: \n", filepath);
+                return error;
+            };
+
+#if defined(_WIN32)
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            sp::archive_writer writer {
+                [] (const std::span<const std::byte> bytes) {
+                    return std::fwrite(bytes.data(), sizeof(std::byte), bytes.size(), stdout) 
+                        == bytes.size();
+                },
+                op.threads,
+                op.profile->cipher
+            };
+
+            // Each member file is read by the pool while the ones before it are
+            // written, and the next is queued as each is taken.
+            std::deque<std::future<std::optional<sp::byte_buffer>>> reads;
+            sp::thread_pool pool{op.io_jobs};
+            std::size_t queued = 0;
+            const auto queue_read = [&] {
+                reads.push_back(pool.submit([&sources, i = queued] {
+                    const auto stamp = sp::stat_file(sources[i].c_str());
+                    if (!stamp || stamp->size > std::numeric_limits<std::uint32_t>::max())
+                        return std::optional<sp::byte_buffer>{};
+
+                    const auto size = static_cast<std::size_t>(stamp->size);
+                    sp::byte_buffer buf {
+                        .buffer = std::unique_ptr<std::byte[]>(new std::byte[size]),
+                        .nbytes = size
+                    };
+                    if (!sp::read_file(sources[i].c_str(), buf.range()))
+                        return std::optional<sp::byte_buffer>{};
+                    return std::optional{std::move(buf)};
+                }));
+                ++queued;
+            };
+            while (queued < names.size() && queued < pool.size())
+                queue_read();
+
+            for (std::size_t i = 0; i < names.size(); ++i)
+            {
+                auto member = reads.front().get();
+                reads.pop_front();
+                if (queued < names.size())
+                    queue_read();
+
+                if (!member)
+                    return member_error(i, "failed to read member file");
+                if (!writer.add_member(member->range()))
+                    return "failed to write archive";
+            }
+
+            if (writer.finish() != sp::archive::write_error::success || std::fflush(stdout) != 0)
+                return "failed to write archive";
+
+            return nullptr;
+        }
+    }
+
+    std::vector<std::array<char, 33>> hash_members(
+        const shader_packager::archive& archive,
+        std::span<const std::size_t>    indices,
+        std::size_t                     threads)
+    {
+        namespace sp = shader_packager;
+
+        std::vector<std::array<char, 33>> digests(indices.size());
+        const std::size_t group_size = sp::md5_lane_count();
+        std::vector<std::future<void>> hashed;
+        sp::thread_pool pool{threads};
+        for (std::size_t first = 0; first < indices.size(); first += group_size)
+        {
+            hashed.push_back(pool.submit([&, first] {
+                const auto group = indices.subspan(
+                    first, std::min(group_size, indices.size() - first));
+                std::vector<std::span<const std::byte>> members;
+                for (const std::size_t i : group)
+                    members.push_back(*archive.member(i));
+                sp::compute_md5_digests(members, std::span{digests}.subspan(first));
+            }));
+        }
+        for (auto& h : hashed)
+            h.get();
+
+        return digests;
+    }
+
+    bool writes_stdout(const operation_context& op) noexcept
+    {
+        using namespace std::literals::string_view_literals;
+
+        return op.mode == operation_mode::pack && op.file == "-"sv;
+    }
+
+    const char* perform_operation(const operation_context& op)
+    {
+        using namespace std::literals::string_view_literals;
+
+        assert(op.mode != operation_mode::unspecified);
+        assert(op.profile != nullptr);
+        assert(op.file != nullptr);
+        assert(op.prefix != nullptr);
+
+        switch (op.mode)
+        {
+        case operation_mode::unpack:
+            return op.file == "-"sv ? perform_stream_unpack_operation(op)
+                                    : perform_unpack_operation(op);
+        case operation_mode::pack:
+            if (op.file == "-"sv)
+                return perform_stream_pack_operation(op);
+            return op.incremental ? perform_incremental_pack_operation(op)
+                                  : perform_pack_operation(op);
+        default:
+            return "unsupported operation mode";
+        }
+    }
+}
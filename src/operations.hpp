@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_OPERATIONS_HPP
+#define H1SP_OPERATIONS_HPP
+
+#include <cstddef>
+#include <cstdio>
+
+#include <array>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <h1sp/archive.hpp>
+#include <h1sp/profile.hpp>
+
+#include "member_file_cache.hpp"
+
+namespace h1sp
+{
+    enum class operation_mode {unspecified, unpack, pack};
+
+    struct operation_context
+    {
+        operation_mode mode;   ///< The operation to perform.
+        const shader_packager::format_profile* profile; ///< The archive format.
+        const char*    file;   ///< The file to operate on.
+        const char*    prefix; ///< A file prefix for the operation.
+        std::size_t    threads = 1; ///< Threads for the cipher pass.
+        std::size_t    io_jobs = 8; ///< Concurrent member file reads/writes.
+        std::vector<std::string_view> only; ///< If not empty, unpack only 
+                                            ///< the members matching these.
+        bool           incremental = false; ///< Repack using a manifest.
+        const char*    cas = nullptr; ///< Content store directory, if any.
+        bool           direct_io = false; ///< Unpack bypassing the page cache.
+        bool           atomic = false; ///< Commit streamed members once valid.
+        bool           dedupe = false; ///< Link members with the same data.
+        member_file_cache* cache = nullptr; ///< Shares member file reads.
+        std::FILE*     messages = stdout; ///< Receives the progress messages.
+    };
+
+    enum class unpack_error
+    {
+        success,
+        could_not_read,
+        corrupted_data
+    };
+
+    /**
+     * \brief Performs an archive operation using the given parameters.
+     *
+     * \return `nullptr` on success, or a null-terminated string on error that
+     *         indicates the reason for failure.
+     */
+    const char* perform_operation(const operation_context& op);
+
+    /**
+     * \brief Checks whether \a op writes its archive to standard output, so
+     *        that nothing else may be printed there.
+     */
+    bool writes_stdout(const operation_context& op) noexcept;
+
+    /**
+     * \brief Computes the MD5 digest of each member of \a archive at 
+     *        \a indices, a group of SIMD lanes at a time, with the groups 
+     *        spread over up to \a threads threads (0 for one per hardware 
+     *        thread).
+     */
+    std::vector<std::array<char, 33>> hash_members(
+        const shader_packager::archive& archive,
+        std::span<const std::size_t>    indices,
+        std::size_t                     threads);
+}
+
+#endif // H1SP_OPERATIONS_HPP
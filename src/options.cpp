@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "options.hpp"
+
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include <charconv>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <h1sp/profile.hpp>
+
+namespace h1sp
+{
+    const shader_packager::format_profile* fixed_profile(
+        const std::string_view client, 
+        const std::string_view type)
+    {
+        using namespace std::literals::string_view_literals;
+
+        if ((client != "-pc"sv && client != "-ce"sv) || (type != "-fx"sv && type != "-vsh"sv))
+            return nullptr;
+
+        std::string name{client.substr(1)};
+        name += '-';
+        name += type.substr(1);
+        return shader_packager::find_profile(name);
+    }
+
+    const shader_packager::format_profile* load_profile(const char* file)
+    {
+        using loaded_profile = std::optional<shader_packager::format_profile>;
+
+        static std::mutex mutex;
+        static std::map<std::string, loaded_profile, std::less<>> profiles;
+
+        const std::lock_guard lock{mutex};
+        auto found = profiles.find(std::string_view{file});
+        if (found == profiles.end())
+        {
+            found = profiles.emplace(
+                file, shader_packager::format_profile::read_from_file(file)).first;
+        }
+
+        return found->second ? &*found->second : nullptr;
+    }
+
+    bool parse_thread_count(const char* arg, std::size_t& threads)
+    {
+        const char* end = arg + std::strlen(arg);
+        const auto [ptr, ec] = std::from_chars(arg, end, threads);
+        return ec == std::errc{} && ptr == end;
+    }
+
+    void split_list(const char* list, std::vector<std::string_view>& out)
+    {
+        for (std::string_view rest = list; !rest.empty(); )
+        {
+            const auto comma = rest.find(',');
+            const auto entry = rest.substr(0, comma);
+            if (!entry.empty())
+                out.push_back(entry);
+            rest = comma == rest.npos ? std::string_view{} : rest.substr(comma + 1);
+        }
+    }
+
+    parse_status parse_operations(
+        std::span<char* const>          args,
+        operation_context&              defaults,
+        std::vector<operation_context>& ops,
+        const bool                      require_group)
+    {
+        using namespace std::literals::string_view_literals;
+
+        auto is_mode = [] (std::string_view arg) {
+            return arg == "-u"sv || arg == "--unpack"sv ||
+                   arg == "-p"sv || arg == "--pack"sv;
+        };
+
+        // options first, leaving the positional arguments
+        std::vector<char*> positional;
+        for (auto it = args.begin(); it != args.end(); ++it)
+        {
+            if (*it == "-j"sv && std::next(it) != args.end())
+            {
+                ++it;
+                if (!parse_thread_count(*it, defaults.threads))
+                {
+                    std::printf("invalid thread count %s\n", *it);
+                    return parse_status::invalid_option;
+                }
+            } else if (*it == "--io-jobs"sv && std::next(it) != args.end())
+            {
+                ++it;
+                if (!parse_thread_count(*it, defaults.io_jobs))
+                {
+                    std::printf("invalid I/O job count %s\n", *it);
+                    return parse_status::invalid_option;
+                }
+            } else if (*it == "--incremental"sv)
+            {
+                defaults.incremental = true;
+            } else if (*it == "--only"sv && std::next(it) != args.end())
+            {
+                split_list(*++it, defaults.only);
+            } else if (*it == "--cas"sv && std::next(it) != args.end())
+            {
+                defaults.cas = *++it;
+            } else if (*it == "--direct-io"sv)
+            {
+                defaults.direct_io = true;
+            } else if (*it == "--atomic"sv)
+            {
+                defaults.atomic = true;
+            } else if (*it == "--dedupe"sv)
+            {
+                defaults.dedupe = true;
+            } else if (*it == "--profile"sv && std::next(it) != args.end())
+            {
+                ++it;
+                defaults.profile = load_profile(*it);
+                if (defaults.profile == nullptr)
+                {
+                    std::printf("invalid profile file %s\n", *it);
+                    return parse_status::invalid_option;
+                }
+            } else
+            {
+                positional.push_back(*it);
+            }
+        }
+
+        if (positional.empty() && require_group)
+            return parse_status::invalid_use;
+
+        for (std::size_t i = 0; i < positional.size(); )
+        {
+            // a built-in format is selected by {-pc|-ce} {-fx|-vsh}, and 
+            // --profile's otherwise
+            const auto group = std::span{positional}.subspan(i);
+            const auto fixed = group.size() >= 3 ? fixed_profile(group[1], group[2]) : nullptr;
+            const std::size_t file_index = fixed != nullptr ? 3 : 1;
+            if (group.size() <= file_index                        ||
+                !is_mode(group[0])                                ||
+                (fixed == nullptr && defaults.profile == nullptr))
+                return parse_status::invalid_use;
+
+            operation_context op = defaults;
+            op.mode    = (group[0] == "-u"sv || group[0] == "--unpack"sv)
+                       ? operation_mode::unpack : operation_mode::pack;
+            op.profile = fixed != nullptr ? fixed : defaults.profile;
+            op.file    = group[file_index];
+            const bool has_prefix = 
+                group.size() > file_index + 1 && !is_mode(group[file_index + 1]);
+            op.prefix  = has_prefix ? group[file_index + 1] : op.profile->prefix.c_str();
+            i += file_index + (has_prefix ? 2 : 1);
+
+            if (op.mode != operation_mode::unpack && !op.only.empty())
+            {
+                std::puts("--only can only be used when unpacking\n");
+                return parse_status::invalid_option;
+            }
+
+            if (op.mode != operation_mode::pack && op.incremental)
+            {
+                std::puts("--incremental can only be used when packing\n");
+                return parse_status::invalid_option;
+            }
+
+            if ((op.mode != operation_mode::unpack || op.file != "-"sv) && op.atomic)
+            {
+                std::puts("--atomic can only be used when unpacking from standard input\n");
+                return parse_status::invalid_option;
+            }
+
+            if (op.mode != operation_mode::unpack && op.dedupe)
+            {
+                std::puts("--dedupe can only be used when unpacking\n");
+                return parse_status::invalid_option;
+            }
+
+            if (op.cas != nullptr && op.dedupe)
+            {
+                std::puts("--dedupe cannot be used with --cas, which stores each member once\n");
+                return parse_status::invalid_option;
+            }
+
+            ops.push_back(std::move(op));
+        }
+
+        return parse_status::success;
+    }
+
+    void split_arguments(std::string& line, std::vector<char*>& args)
+    {
+        for (std::size_t i = 0; i < line.size(); )
+        {
+            if (std::isspace(static_cast<unsigned char>(line[i])))
+            {
+                line[i++] = '\0';
+                continue;
+            }
+
+            if (args.empty() && line[i] == '#')
+                break;
+
+            const bool quoted = line[i] == '"';
+            if (quoted)
+                ++i;
+            args.push_back(line.data() + i);
+            while (i < line.size() && (quoted 
+                ? line[i] != '"' 
+                : !std::isspace(static_cast<unsigned char>(line[i]))))
+            {
+                ++i;
+            }
+            if (i < line.size())
+                line[i++] = '\0';
+        }
+    }
+}
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_OPTIONS_HPP
+#define H1SP_OPTIONS_HPP
+
+#include <cstddef>
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <h1sp/profile.hpp>
+
+#include "operations.hpp"
+
+namespace h1sp
+{
+    /**
+     * \brief Parses a non-negative decimal thread count.
+     *
+     * \return \c true on success, otherwise \c false.
+     */
+    bool parse_thread_count(const char* arg, std::size_t& threads);
+
+    /**
+     * \brief Appends the comma-separated entries of \a list to \a out.
+     */
+    void split_list(const char* list, std::vector<std::string_view>& out);
+
+    /**
+     * \brief Gets the built-in profile that the arguments \a client 
+     *        (`-pc` or `-ce`) and \a type (`-fx` or `-vsh`) select.
+     *
+     * \return The profile, or null if the arguments select none.
+     */
+    const shader_packager::format_profile* fixed_profile(
+        std::string_view client, 
+        std::string_view type);
+
+    /**
+     * \brief Loads the profile file \a file, once per process, so that the
+     *        profile outlives every operation that uses it.
+     *
+     * \return The profile, or null if \a file could not be read or is not a
+     *         valid profile file.
+     */
+    const shader_packager::format_profile* load_profile(const char* file);
+
+    enum class parse_status 
+    {
+        success,
+        invalid_use,   ///< The arguments do not form valid operations.
+        invalid_option ///< An option was rejected; a message was printed.
+    };
+
+    /**
+     * \brief Parses options and operation groups, i.e. 
+     *        `{-u|-p} {-pc|-ce} {-fx|-vsh} FILE [PREFIX]`, from \a args.
+     *
+     * With `--profile PROFILE`, a group may be `{-u|-p} FILE [PREFIX]` for 
+     * the format that PROFILE describes.
+     *
+     * Options may appear anywhere in \a args and apply to every group in it,
+     * with \a defaults supplying the values of options not given.
+     *
+     * \param [in]     args          The arguments, without the program name.
+     * \param [in,out] defaults      The option values to start from; 
+     *                               receives the options found.
+     * \param [out]    ops           Receives the parsed operations.
+     * \param [in]     require_group Whether \a args must contain a group.
+     */
+    parse_status parse_operations(
+        std::span<char* const>          args,
+        operation_context&              defaults,
+        std::vector<operation_context>& ops,
+        bool                            require_group = true);
+
+    /**
+     * \brief Splits \a line into arguments in place, as the lines of a batch
+     *        file are: "..." quotes an argument containing spaces, and a line
+     *        whose first argument starts with `#` has none.
+     */
+    void split_arguments(std::string& line, std::vector<char*>& args);
+}
+
+#endif // H1SP_OPTIONS_HPP
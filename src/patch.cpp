@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/patch.hpp>
+
+#include <cstdio>
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include <h1sp/io.hpp>
+
+namespace shader_packager
+{
+    namespace
+    {
+        struct file_closer
+        {
+            void operator()(std::FILE* fp) const noexcept { std::fclose(fp); }
+        };
+
+        using file_ptr = std::unique_ptr<std::FILE, file_closer>;
+
+        using field_type      = std::uint32_t;
+        using chunk_size_type = std::uint32_t;
+
+        constexpr std::string_view patch_magic = "h1sp-patch 1\n";
+        constexpr std::size_t      digest_size = 32;
+        constexpr std::size_t      header_size =
+            patch_magic.size() + 2 * digest_size + 3 * sizeof(field_type);
+
+        bool is_digest(const std::string_view digest) noexcept
+        {
+            return digest.size() == digest_size && std::all_of(digest.begin(), digest.end(),
+                [] (const char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+        }
+
+        // Checks the rules that apply relies on to only copy members that
+        // exist and to produce exactly new_count of them.
+        bool is_consistent(const archive_patch& patch) noexcept
+        {
+            if (!is_digest(patch.old_digest) || !is_digest(patch.new_digest))
+                return false;
+
+            std::uint32_t added = 0;
+            for (std::size_t i = 0; i < patch.changes.size(); ++i)
+            {
+                const auto index = patch.changes[i].index;
+                if (index >= patch.new_count || (i != 0 && index <= patch.changes[i - 1].index))
+                    return false;
+                if (index >= patch.old_count)
+                    ++added;
+            }
+
+            return added == patch.new_count - std::min(patch.new_count, patch.old_count);
+        }
+    }
+
+    archive_patch archive_patch::diff(const archive& from, const archive& to)
+    {
+        archive_patch result {
+            .old_digest = std::string{from.digest()},
+            .new_digest = std::string{to.digest()},
+            .old_count  = static_cast<std::uint32_t>(from.member_count()),
+            .new_count  = static_cast<std::uint32_t>(to.member_count()),
+            .changes    = {},
+            .storage    = {}
+        };
+
+        for (std::uint32_t i = 0; i < result.new_count; ++i)
+        {
+            const auto member = *to.member(i);
+            const auto before = from.member(i);
+            if (!before || !std::equal(before->begin(), before->end(), member.begin(), member.end()))
+                result.changes.push_back({.index = i, .data = member});
+        }
+
+        return result;
+    }
+
+    std::optional<archive_patch> archive_patch::read_from_file(const char* file)
+    {
+        auto buf = read_file(file);
+        if (!buf || buf.nbytes < header_size)
+            return std::nullopt;
+
+        const std::span<const std::byte> bytes = buf.range();
+        const auto text = [&] (const std::size_t offset, const std::size_t size) {
+            return std::string_view{reinterpret_cast<const char*>(bytes.data()) + offset, size};
+        };
+        if (text(0, patch_magic.size()) != patch_magic)
+            return std::nullopt;
+
+        std::size_t offset = patch_magic.size();
+        archive_patch result {
+            .old_digest = std::string{text(offset, digest_size)},
+            .new_digest = std::string{text(offset + digest_size, digest_size)},
+            .old_count  = 0,
+            .new_count  = 0,
+            .changes    = {},
+            .storage    = {}
+        };
+        offset += 2 * digest_size;
+
+        const auto field = [&] {
+            const auto value = deserialize<field_type, std::endian::little>(bytes.data() + offset);
+            offset += sizeof(field_type);
+            return value;
+        };
+        result.old_count = field();
+        result.new_count = field();
+        const auto change_count = field();
+        if (change_count > result.new_count)
+            return std::nullopt;
+
+        result.changes.reserve(change_count);
+        for (std::uint32_t i = 0; i < change_count; ++i)
+        {
+            if (bytes.size() - offset < 2 * sizeof(field_type))
+                return std::nullopt;
+
+            const auto index = field();
+            const auto size  = field();
+            if (bytes.size() - offset < size)
+                return std::nullopt;
+
+            result.changes.push_back({.index = index, .data = bytes.subspan(offset, size)});
+            offset += size;
+        }
+
+        if (offset != bytes.size() || !is_consistent(result))
+            return std::nullopt;
+
+        result.storage = std::move(buf);
+        return result;
+    }
+
+    bool archive_patch::write_to_file(const char* file) const
+    {
+        const file_ptr fp{std::fopen(file, "wb")};
+        if (!fp)
+            return false;
+
+        const auto put_field = [&] (const std::uint32_t value) {
+            std::array<std::byte, sizeof(field_type)> bytes;
+            serialize<std::endian::little>(value, bytes.begin());
+            std::fwrite(bytes.data(), sizeof(std::byte), bytes.size(), fp.get());
+        };
+
+        std::fwrite(patch_magic.data(), 1, patch_magic.size(), fp.get());
+        std::fwrite(old_digest.data(), 1, digest_size, fp.get());
+        std::fwrite(new_digest.data(), 1, digest_size, fp.get());
+        put_field(old_count);
+        put_field(new_count);
+        put_field(static_cast<std::uint32_t>(changes.size()));
+        for (const auto& c : changes)
+        {
+            put_field(c.index);
+            put_field(static_cast<std::uint32_t>(c.data.size()));
+            std::fwrite(c.data.data(), sizeof(std::byte), c.data.size(), fp.get());
+        }
+
+        return std::fflush(fp.get()) == 0 && std::ferror(fp.get()) == 0;
+    }
+
+    archive_patch::apply_error archive_patch::apply(
+        const archive&    from,
+        const char* const file,
+        const std::size_t threads) const
+    {
+        if (from.digest() != old_digest || from.member_count() != old_count ||
+            !is_consistent(*this))
+            return apply_error::wrong_archive;
+
+        // The result goes to a .partial file beside file, which is renamed 
+        // over it once the writer has closed it and its digest checks out, so
+        // a failed apply leaves file as it was.
+        const std::string partial = std::string{file} + ".partial";
+        auto error = [&] {
+            // Members from one change to the next are unchanged, and lie
+            // back to back in from, headers and all.
+            archive_writer writer{partial.c_str(), threads};
+            auto next = changes.begin();
+            for (std::uint32_t i = 0; i < new_count; )
+            {
+                if (next != changes.end() && next->index == i)
+                {
+                    if (!writer.add_member(next->data))
+                        return apply_error::could_not_write;
+                    ++next;
+                    ++i;
+                    continue;
+                }
+
+                const std::uint32_t end = next != changes.end() ? next->index : new_count;
+                const auto first = *from.member(i);
+                const auto last  = *from.member(end - 1);
+                const std::span<const std::byte> run {
+                    first.data() - sizeof(chunk_size_type),
+                    last.data() + last.size()
+                };
+                if (!writer.add_serialized(run))
+                    return apply_error::could_not_write;
+                i = end;
+            }
+
+            if (writer.finish() != archive::write_error::success)
+                return apply_error::could_not_write;
+
+            return writer.digest() != new_digest ? apply_error::digest_mismatch 
+                                                 : apply_error::success;
+        }();
+
+        std::error_code ec;
+        if (error == apply_error::success)
+        {
+            std::filesystem::rename(partial, file, ec);
+            if (!ec)
+                return apply_error::success;
+            error = apply_error::could_not_write;
+        }
+        std::filesystem::remove(partial, ec);
+        return error;
+    }
+}
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/profile.hpp>
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <limits>
+#include <memory>
+
+namespace shader_packager
+{
+    namespace
+    {
+        // Splits the null-terminated line into whitespace-separated words,
+        // terminating each in place.
+        void split_words(char* line, std::vector<char*>& words)
+        {
+            for (;;)
+            {
+                while (std::isspace(static_cast<unsigned char>(*line)))
+                    *line++ = '\0';
+                if (*line == '\0')
+                    return;
+
+                words.push_back(line);
+                while (*line != '\0' && !std::isspace(static_cast<unsigned char>(*line)))
+                    ++line;
+            }
+        }
+
+        bool parse_key_word(const char* word, std::uint32_t& value)
+        {
+            // strtoul accepts a sign and leading whitespace, which a key does not
+            if (!std::isdigit(static_cast<unsigned char>(*word)))
+                return false;
+
+            char* end = nullptr;
+            const unsigned long parsed = std::strtoul(word, &end, 0);
+            if (*end != '\0' || parsed > std::numeric_limits<std::uint32_t>::max())
+                return false;
+
+            value = static_cast<std::uint32_t>(parsed);
+            return true;
+        }
+    }
+
+    std::optional<format_profile> format_profile::read_from_file(const char* file)
+    {
+        const auto contents = read_file(file);
+        if (!contents)
+            return std::nullopt;
+
+        // The names are kept in a null-terminated copy of the file.
+        format_profile result {
+            .name      = file,
+            .extension = {},
+            .prefix    = {},
+            .names     = {},
+            .cipher    = h1_cipher,
+            .storage   = {
+                .buffer = std::unique_ptr<std::byte[]>(new std::byte[contents.nbytes + 1]),
+                .nbytes = contents.nbytes + 1
+            },
+            .members   = {}
+        };
+        char* text = reinterpret_cast<char*>(result.storage.data());
+        std::copy_n(reinterpret_cast<const char*>(contents.data()), contents.nbytes, text);
+        text[contents.nbytes] = '\0';
+
+        tea                scheme = h1_tea;
+        std::vector<char*> words;
+        for (char* line = text; line != nullptr; )
+        {
+            char* const newline = std::find(line, text + contents.nbytes, '\n');
+            char* const next    = newline != text + contents.nbytes ? newline + 1 : nullptr;
+            *newline = '\0';
+
+            words.clear();
+            split_words(line, words);
+            line = next;
+            if (words.empty() || *words[0] == '#')
+                continue;
+
+            const std::string_view setting = words[0];
+            if (setting == "member" && words.size() == 2)
+            {
+                result.members.push_back(words[1]);
+            } else if (setting == "name" && words.size() == 2)
+            {
+                result.name = words[1];
+            } else if (setting == "extension" && words.size() == 2)
+            {
+                result.extension = words[1];
+            } else if (setting == "prefix" && words.size() == 2)
+            {
+                result.prefix = words[1];
+            } else if (setting == "key" && words.size() == 5)
+            {
+                for (std::size_t i = 0; i < std::size(scheme.key); ++i)
+                {
+                    if (!parse_key_word(words[i + 1], scheme.key[i]))
+                        return std::nullopt;
+                }
+            } else if (setting == "endian" && words.size() == 2)
+            {
+                const std::string_view order = words[1];
+                if (order != "little" && order != "big")
+                    return std::nullopt;
+                scheme.endian = order == "little" ? std::endian::little : std::endian::big;
+            } else
+            {
+                return std::nullopt;
+            }
+        }
+
+        if (result.extension.empty() || result.members.empty())
+            return std::nullopt;
+
+        if (result.prefix.empty())
+            result.prefix = result.extension + '/';
+        result.names  = result.members;
+        result.cipher = archive_cipher::of(scheme);
+        return result;
+    }
+
+    std::span<const format_profile> builtin_profiles()
+    {
+        static const std::array<format_profile, 4> profiles {
+            format_profile::of<pc_fx_profile>(),
+            format_profile::of<ce_fx_profile>(),
+            format_profile::of<pc_vsh_profile>(),
+            format_profile::of<ce_vsh_profile>()
+        };
+
+        return profiles;
+    }
+
+    const format_profile* find_profile(const std::string_view name)
+    {
+        const auto profiles = builtin_profiles();
+        const auto found = std::find_if(profiles.begin(), profiles.end(),
+            [name] (const format_profile& profile) { return profile.name == name; });
+
+        return found != profiles.end() ? &*found : nullptr;
+    }
+}
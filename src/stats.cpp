@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/stats.hpp>
+
+#if H1SP_ENABLE_STATS
+
+#include <ctime>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#endif
+
+namespace shader_packager
+{
+    namespace
+    {
+        struct stage_totals
+        {
+            std::atomic<std::uint64_t> calls   = 0;
+            std::atomic<std::uint64_t> bytes   = 0;
+            std::atomic<std::uint64_t> wall_ns = 0;
+            std::atomic<std::uint64_t> cpu_ns  = 0;
+        };
+        
+        struct member_record
+        {
+            const char*   member;
+            stat_stage    stage;
+            std::uint64_t bytes;
+            std::uint64_t wall_ns;
+            std::uint64_t cpu_ns;
+        };
+        
+        constexpr std::array<const char*, static_cast<std::size_t>(stat_stage::count)>
+        stage_names {
+            "read_file",
+            "write_file",
+            "batch_write",
+            "decrypt",
+            "encrypt",
+            "md5",
+            "validate",
+            "member_read",
+            "member_write"
+        };
+        
+        std::array<stage_totals, static_cast<std::size_t>(stat_stage::count)> totals;
+        
+        std::mutex                 members_mutex;
+        std::vector<member_record> members;
+        
+        const auto process_start = std::chrono::steady_clock::now();
+        
+        // CPU time of the calling thread
+        std::uint64_t thread_cpu_ns() noexcept
+        {
+#if defined(_WIN32)
+            FILETIME creation, exit, kernel, user;
+            if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+                return 0;
+            auto ticks = [] (const FILETIME& t) {
+                return (std::uint64_t{t.dwHighDateTime} << 32) | t.dwLowDateTime;
+            };
+            return (ticks(kernel) + ticks(user)) * 100;
+#else
+            timespec ts {};
+            if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+                return 0;
+            return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000u
+                 + static_cast<std::uint64_t>(ts.tv_nsec);
+#endif
+        }
+        
+        double to_ms(const std::uint64_t ns) noexcept
+        {
+            return static_cast<double>(ns) / 1e6;
+        }
+        
+        double to_mib_per_s(const std::uint64_t bytes, const std::uint64_t ns) noexcept
+        {
+            return ns == 0 ? 0.0 : static_cast<double>(bytes) / (1024.0 * 1024.0)
+                                 / (static_cast<double>(ns) / 1e9);
+        }
+    }
+    
+    stat_scope::stat_scope(
+        const stat_stage    stage,
+        const std::uint64_t bytes,
+        const char* const   member) noexcept
+        : stage(stage)
+        , bytes(bytes)
+        , member(member)
+        , wall_start(std::chrono::steady_clock::now())
+        , cpu_start(thread_cpu_ns())
+        { }
+    
+    stat_scope::~stat_scope()
+    {
+        const auto wall_ns = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - wall_start).count());
+        const auto cpu_ns = thread_cpu_ns() - cpu_start;
+        
+        auto& t = totals[static_cast<std::size_t>(stage)];
+        t.calls.fetch_add(1, std::memory_order_relaxed);
+        t.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        t.wall_ns.fetch_add(wall_ns, std::memory_order_relaxed);
+        t.cpu_ns.fetch_add(cpu_ns, std::memory_order_relaxed);
+        
+        if (member != nullptr)
+        {
+            try
+            {
+                std::lock_guard lock{members_mutex};
+                members.push_back({member, stage, bytes, wall_ns, cpu_ns});
+            } catch (...)
+            {
+                // per-member records are best effort
+            }
+        }
+    }
+    
+    void print_stats(std::FILE* const out, const bool json)
+    {
+        const auto wall_ns = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - process_start).count());
+        const auto cpu_ns = static_cast<std::uint64_t>(
+            static_cast<double>(std::clock()) / CLOCKS_PER_SEC * 1e9);
+        
+        std::lock_guard lock{members_mutex};
+        
+        if (json)
+        {
+            std::fprintf(out, "{\n  \"stages\": [");
+            const char* separator = "\n";
+            for (std::size_t i = 0; i < totals.size(); ++i)
+            {
+                const auto& t = totals[i];
+                if (t.calls == 0)
+                    continue;
+                std::fprintf(out,
+                    "%s    {\"stage\": \"%s\", \"calls\": %llu, \"bytes\": %llu, "
+                    "\"wall_ns\": %llu, \"cpu_ns\": %llu}",
+                    separator, stage_names[i],
+                    static_cast<unsigned long long>(t.calls.load()),
+                    static_cast<unsigned long long>(t.bytes.load()),
+                    static_cast<unsigned long long>(t.wall_ns.load()),
+                    static_cast<unsigned long long>(t.cpu_ns.load()));
+                separator = ",\n";
+            }
+            std::fprintf(out, "\n  ],\n  \"members\": [");
+            separator = "\n";
+            for (const auto& m : members)
+            {
+                std::fprintf(out,
+                    "%s    {\"member\": \"%s\", \"stage\": \"%s\", \"bytes\": %llu, "
+                    "\"wall_ns\": %llu, \"cpu_ns\": %llu}",
+                    separator, m.member, stage_names[static_cast<std::size_t>(m.stage)],
+                    static_cast<unsigned long long>(m.bytes),
+                    static_cast<unsigned long long>(m.wall_ns),
+                    static_cast<unsigned long long>(m.cpu_ns));
+                separator = ",\n";
+            }
+            std::fprintf(out,
+                "\n  ],\n  \"total\": {\"wall_ns\": %llu, \"cpu_ns\": %llu}\n}\n",
+                static_cast<unsigned long long>(wall_ns),
+                static_cast<unsigned long long>(cpu_ns));
+            return;
+        }
+        
+        std::fprintf(out, "\n%-14s %8s %14s %11s %11s %10s\n",
+            "stage", "calls", "bytes", "wall ms", "cpu ms", "MiB/s");
+        for (std::size_t i = 0; i < totals.size(); ++i)
+        {
+            const auto& t = totals[i];
+            if (t.calls == 0)
+                continue;
+            std::fprintf(out, "%-14s %8llu %14llu %11.3f %11.3f %10.1f\n",
+                stage_names[i],
+                static_cast<unsigned long long>(t.calls.load()),
+                static_cast<unsigned long long>(t.bytes.load()),
+                to_ms(t.wall_ns), to_ms(t.cpu_ns),
+                to_mib_per_s(t.bytes, t.wall_ns));
+        }
+        std::fprintf(out, "%-14s %8s %14s %11.3f %11.3f\n",
+            "total", "", "", to_ms(wall_ns), to_ms(cpu_ns));
+        
+        if (members.empty())
+            return;
+        
+        std::fprintf(out, "\n%-40s %-13s %10s %11s %11s\n",
+            "member", "stage", "bytes", "wall ms", "cpu ms");
+        for (const auto& m : members)
+        {
+            std::fprintf(out, "%-40s %-13s %10llu %11.3f %11.3f\n",
+                m.member, stage_names[static_cast<std::size_t>(m.stage)],
+                static_cast<unsigned long long>(m.bytes),
+                to_ms(m.wall_ns), to_ms(m.cpu_ns));
+        }
+    }
+}
+
+#endif // H1SP_ENABLE_STATS
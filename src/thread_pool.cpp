@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include <h1sp/thread_pool.hpp>
+
+#include <algorithm>
+
+namespace shader_packager
+{
+    thread_pool::thread_pool(std::size_t threads)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        workers.reserve(threads);
+        for (std::size_t i = 0; i < threads; ++i)
+            workers.emplace_back([this] { run(); });
+    }
+
+    thread_pool::~thread_pool()
+    {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        wakeup.notify_all();
+        // workers drain the queue, then join
+    }
+
+    void thread_pool::post(std::function<void()> task)
+    {
+        {
+            std::lock_guard lock{mutex};
+            tasks.push_back(std::move(task));
+        }
+        wakeup.notify_one();
+    }
+
+    void thread_pool::run() noexcept
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock{mutex};
+                wakeup.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return; // stopping
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task(); // exceptions end up in the task's future
+        }
+    }
+}
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: BSL-1.0
+
+/*
+USAGE
+  h1sp_fuzz [LIBFUZZER_OPTIONS] [CORPUS_DIR...]
+    Feeds fuzzed archives to every loader, aborting if one accepts or
+    rejects an archive unlike the reference reading of archive_oracle.hpp,
+    or finds other members. Build with -DH1SP_BUILD_FUZZ=ON using Clang.
+
+    The first byte of an input picks how the rest is used:
+      0 mod 3  as an encrypted archive, as is
+      1 mod 3  as the member data of an archive, which is sealed with its
+               digest, so that the member headers are what is fuzzed
+      2 mod 3  as member data, sealed and then cut short by up to 63 bytes
+    and also the size of the pieces archive_decoder is fed.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <process.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "archive_oracle.hpp"
+
+namespace
+{
+    namespace sp = shader_packager;
+
+    // A scratch file per process, as fuzzing jobs may share a directory.
+    const std::string& scratch_file()
+    {
+#if defined(_WIN32)
+        const auto pid = ::_getpid();
+#else
+        const auto pid = ::getpid();
+#endif
+        static const std::string file = (std::filesystem::temp_directory_path() /
+            ("h1sp_fuzz_" + std::to_string(pid) + ".bin")).string();
+        return file;
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    if (size == 0)
+        return 0;
+
+    const unsigned mode = data[0];
+    const auto     rest = std::as_bytes(std::span{data + 1, size - 1});
+
+    std::vector<std::byte> archive;
+    if (mode % 3 == 0)
+    {
+        archive.assign(rest.begin(), rest.end());
+    } else
+    {
+        archive = sp::testing::seal_archive(rest);
+        if (mode % 3 == 2)
+            archive.resize(archive.size() - std::min<std::size_t>(archive.size(), mode / 4));
+    }
+
+    const std::size_t piece = std::size_t{1} << (mode % 13);
+    if (const char* loader = sp::testing::check_loaders(archive, scratch_file().c_str(), piece))
+    {
+        std::fprintf(stderr, "%s disagrees with the oracle\n", loader);
+        std::abort();
+    }
+
+    return 0;
+}
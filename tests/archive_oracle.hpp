@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef H1SP_TESTS_ARCHIVE_ORACLE_HPP
+#define H1SP_TESTS_ARCHIVE_ORACLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <h1sp/archive.hpp>
+#include <h1sp/core.hpp>
+#include <h1sp/crypt.hpp>
+
+/* ARCHIVE ORACLE:
+ * A slow, obvious reading of an archive that the loaders are checked
+ * against: it decrypts a copy, checks the digest of everything before the
+ * 33-byte trailer and walks the member headers with 64-bit offsets, none
+ * of which shares code with the loaders' bounds checks.
+ */
+
+namespace shader_packager::testing
+{
+    constexpr std::size_t trailer_size = 33;
+
+    /**
+     * \brief What the oracle finds in an archive it accepts.
+     */
+    struct oracle_archive
+    {
+        std::vector<std::byte>              data;    ///< The decrypted member
+                                                     ///< data, headers included.
+        std::vector<std::vector<std::byte>> members; ///< Each member's data.
+    };
+
+    /**
+     * \brief Reads the encrypted archive \a encrypted.
+     *
+     * \return The archive, or `std::nullopt` if it is not valid.
+     */
+    inline std::optional<oracle_archive> oracle_read(std::span<const std::byte> encrypted)
+    {
+        if (encrypted.size() < trailer_size + 1)
+            return std::nullopt;
+
+        std::vector<std::byte> plain(encrypted.begin(), encrypted.end());
+        decrypt_buffer(h1_tea, plain);
+
+        const auto data   = std::span{plain}.first(plain.size() - trailer_size);
+        const auto digest = compute_md5_digest(data);
+        if (std::memcmp(digest.c_str(), plain.data() + data.size(), trailer_size) != 0)
+            return std::nullopt;
+
+        oracle_archive found;
+        std::uint64_t  offset = 0;
+        while (offset < data.size())
+        {
+            if (data.size() - offset < sizeof(std::uint32_t))
+                return std::nullopt;
+
+            std::uint64_t size = 0;
+            for (std::size_t i = 0; i < sizeof(std::uint32_t); ++i)
+                size |= std::to_integer<std::uint64_t>(data[offset + i]) << (8 * i);
+            offset += sizeof(std::uint32_t);
+            if (size > data.size() - offset)
+                return std::nullopt;
+
+            const auto member = data.subspan(static_cast<std::size_t>(offset),
+                static_cast<std::size_t>(size));
+            found.members.emplace_back(member.begin(), member.end());
+            offset += size;
+        }
+
+        found.data.assign(data.begin(), data.end());
+        return found;
+    }
+
+    /**
+     * \brief Appends the digest trailer to the member data \a data and
+     *        encrypts the result, giving an archive whose digest matches
+     *        whether or not its member headers are valid.
+     */
+    inline std::vector<std::byte> seal_archive(std::span<const std::byte> data)
+    {
+        std::vector<std::byte> sealed(data.size() + trailer_size);
+        std::copy(data.begin(), data.end(), sealed.begin());
+        const auto digest = compute_md5_digest(data);
+        std::memcpy(sealed.data() + data.size(), digest.c_str(), trailer_size);
+        encrypt_buffer(h1_static_tea, sealed);
+        return sealed;
+    }
+
+    /**
+     * \brief Checks that each loader accepts or rejects \a encrypted as
+     *        #oracle_read does, and finds the same members when it accepts.
+     *
+     * \param [in] encrypted The archive.
+     * \param [in] file      A scratch file for archive::read_from_file.
+     * \param [in] piece     The size of the pieces archive_decoder is fed,
+     *                       at least 1.
+     * \return `nullptr` if every loader agreed with the oracle, otherwise
+     *         the name of the first that did not.
+     */
+    inline const char* check_loaders(
+        std::span<const std::byte> encrypted,
+        const char*                file,
+        std::size_t                piece)
+    {
+        const auto expected = oracle_read(encrypted);
+
+        const auto same_members = [&expected] (const archive& loaded) {
+            if (loaded.member_count() != expected->members.size())
+                return false;
+
+            std::size_t i = 0;
+            for (auto e = loaded.enumerate(); e; e.advance(), ++i)
+            {
+                if (i >= expected->members.size() || e.has_error())
+                    return false;
+
+                const auto& member = expected->members[i];
+                const auto  found  = e.data();
+                if (!std::equal(found.begin(), found.end(), member.begin(), member.end()))
+                    return false;
+
+                const auto indexed = loaded.member(i);
+                if (!indexed || indexed->data() != found.data() || indexed->size() != found.size())
+                    return false;
+            }
+            return i == expected->members.size();
+        };
+
+        {
+            byte_buffer buf {
+                .buffer = std::make_unique<std::byte[]>(encrypted.size()),
+                .nbytes = encrypted.size()
+            };
+            std::copy(encrypted.begin(), encrypted.end(), buf.data());
+
+            archive    loaded;
+            const bool accepted =
+                loaded.read_from_buffer(std::move(buf)) == archive::read_error::success;
+            if (accepted != expected.has_value() || (accepted && !same_members(loaded)))
+                return "archive::read_from_buffer";
+        }
+
+        if (write_file(file, encrypted))
+        {
+            archive    loaded;
+            const bool accepted =
+                loaded.read_from_file(file) == archive::read_error::success;
+            if (accepted != expected.has_value() || (accepted && !same_members(loaded)))
+                return "archive::read_from_file";
+        }
+
+        {
+            archive_decoder        decoder;
+            std::vector<std::byte> data;
+            const auto on_data = [&data] (std::span<const std::byte> run) {
+                data.insert(data.end(), run.begin(), run.end());
+            };
+            for (std::size_t at = 0; at < encrypted.size(); at += piece)
+                decoder.update(encrypted.subspan(at, std::min(piece, encrypted.size() - at)), on_data);
+
+            archive_summary summary;
+            const bool accepted = decoder.finish(&summary, on_data) == core_error::success;
+            if (accepted != expected.has_value() ||
+                (accepted && (data != expected->data ||
+                              summary.member_count != expected->members.size())))
+                return "archive_decoder";
+        }
+
+        return nullptr;
+    }
+}
+
+#endif // H1SP_TESTS_ARCHIVE_ORACLE_HPP
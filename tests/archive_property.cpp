@@ -0,0 +1,335 @@
+// SPDX-License-Identifier: BSL-1.0
+
+/*
+USAGE
+  h1sp_property_tests [--seed N] [--cases N] [--budget NS] [--dir DIR]
+    Loads random and adversarial archives (valid ones, ones made of many
+    tiny members, huge or cut-off size headers, truncated trailers, flipped
+    bits and plain noise) with every loader, checking each against a plain
+    reference reading. With --budget, also times loading hostile archives
+    of two sizes, failing if the time per byte grows with the size.
+
+  OPTIONS
+     --seed N the seed of the random archives. Defaults to a fixed seed;
+        the seed is printed, so a failing run can be repeated.
+     --cases N the number of random archives. Defaults to 2000.
+     --budget NS times loading hostile archives, failing if the time per
+        byte of the larger grows past a small factor of that of the smaller,
+        or past NS nanoseconds. Timings vary with the machine and its load,
+        so this is off by default and not part of the ctest run.
+     --dir DIR the directory for the scratch archive file. Defaults to the
+        system temporary directory.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <h1sp/archive.hpp>
+#include <h1sp/core.hpp>
+
+#include "archive_oracle.hpp"
+
+namespace
+{
+    namespace sp = shader_packager;
+
+    /**
+     * \brief The kinds of archive the random cases are drawn from.
+     */
+    enum class archive_shape
+    {
+        valid,             ///< Random members, sealed.
+        tiny_members,      ///< Thousands of empty and one-byte members.
+        huge_prefix,       ///< A size header past the end, sealed.
+        cut_header,        ///< Members, then part of a header, sealed.
+        truncated_trailer, ///< A valid archive with its end cut off.
+        flipped_bit,       ///< A valid archive with one bit flipped.
+        noise              ///< Random bytes.
+    };
+
+    constexpr std::size_t shape_count = 7;
+
+    constexpr const char* shape_names[shape_count] = {
+        "valid", "tiny_members", "huge_prefix", "cut_header",
+        "truncated_trailer", "flipped_bit", "noise"
+    };
+
+    void append_member(std::vector<std::byte>& data, std::uint32_t size, std::mt19937_64& rng)
+    {
+        for (std::size_t i = 0; i < sizeof(size); ++i)
+            data.push_back(static_cast<std::byte>(size >> (8 * i)));
+        for (std::uint32_t i = 0; i < size; ++i)
+            data.push_back(static_cast<std::byte>(rng()));
+    }
+
+    // Makes the member data of a few members, mostly small, some empty.
+    std::vector<std::byte> make_member_data(std::mt19937_64& rng)
+    {
+        std::vector<std::byte> data;
+        const std::size_t members = std::uniform_int_distribution<std::size_t>{0, 16}(rng);
+        for (std::size_t i = 0; i < members; ++i)
+        {
+            const auto bits = std::uniform_int_distribution<int>{0, 14}(rng);
+            append_member(data, static_cast<std::uint32_t>(rng() % (std::uint64_t{1} << bits)), rng);
+        }
+        return data;
+    }
+
+    std::vector<std::byte> make_archive(const archive_shape shape, std::mt19937_64& rng)
+    {
+        switch (shape)
+        {
+        case archive_shape::valid:
+            return sp::testing::seal_archive(make_member_data(rng));
+        case archive_shape::tiny_members:
+        {
+            std::vector<std::byte> data;
+            const std::size_t members = std::uniform_int_distribution<std::size_t>{1, 5000}(rng);
+            for (std::size_t i = 0; i < members; ++i)
+                append_member(data, rng() % 2, rng);
+            return sp::testing::seal_archive(data);
+        }
+        case archive_shape::huge_prefix:
+        {
+            // overwrite the size of one member, or add one, with a size
+            // that runs past the end by a little or by a lot
+            auto data = make_member_data(rng);
+            std::vector<std::size_t> headers;
+            for (std::size_t at = 0; at < data.size(); )
+            {
+                headers.push_back(at);
+                at += sizeof(std::uint32_t) + 
+                    sp::deserialize<std::uint32_t, std::endian::little>(data.data() + at);
+            }
+            if (headers.empty())
+            {
+                headers.push_back(0);
+                append_member(data, 0, rng);
+            }
+
+            const std::size_t at   = headers[rng() % headers.size()];
+            const std::size_t left = data.size() - at - sizeof(std::uint32_t);
+            constexpr std::array<std::uint32_t, 3> huge = {0xFFFF'FFFF, 0x8000'0000, 0x7FFF'FFFF};
+            const std::uint32_t size = rng() % 2
+                ? huge[rng() % huge.size()]
+                : static_cast<std::uint32_t>(left + 1 + rng() % 8);
+            for (std::size_t i = 0; i < sizeof(size); ++i)
+                data[at + i] = static_cast<std::byte>(size >> (8 * i));
+            return sp::testing::seal_archive(data);
+        }
+        case archive_shape::cut_header:
+        {
+            auto data = make_member_data(rng);
+            const std::size_t cut = 1 + rng() % 3;
+            for (std::size_t i = 0; i < cut; ++i)
+                data.push_back(static_cast<std::byte>(rng()));
+            return sp::testing::seal_archive(data);
+        }
+        case archive_shape::truncated_trailer:
+        {
+            auto archive = sp::testing::seal_archive(make_member_data(rng));
+            archive.resize(archive.size() - std::min<std::size_t>(archive.size(), 1 + rng() % 40));
+            return archive;
+        }
+        case archive_shape::flipped_bit:
+        {
+            auto archive = sp::testing::seal_archive(make_member_data(rng));
+            const std::size_t bit = rng() % (archive.size() * 8);
+            archive[bit / 8] ^= static_cast<std::byte>(1u << (bit % 8));
+            return archive;
+        }
+        case archive_shape::noise:
+        default:
+        {
+            std::vector<std::byte> archive(rng() % 256);
+            for (auto& b : archive)
+                b = static_cast<std::byte>(rng());
+            return archive;
+        }
+        }
+    }
+
+    /**
+     * \brief The kinds of hostile archive timed by #check_linear_time.
+     */
+    enum class hostile_kind
+    {
+        tiny_members,      ///< Nothing but empty members.
+        huge_prefix,       ///< A first size header far past the end.
+        unaligned_tail,    ///< Empty members, then a cut-off header.
+        truncated_trailer  ///< Empty members, with the trailer cut short.
+    };
+
+    // Makes a hostile archive of about size bytes.
+    std::vector<std::byte> make_hostile_archive(const hostile_kind kind, const std::size_t size)
+    {
+        std::size_t data_size = size - sp::testing::trailer_size;
+        data_size -= data_size % sizeof(std::uint32_t);
+        if (kind == hostile_kind::unaligned_tail)
+            ++data_size;
+
+        std::vector<std::byte> data(data_size);
+        if (kind == hostile_kind::huge_prefix)
+            std::memset(data.data(), 0xFF, sizeof(std::uint32_t));
+
+        auto archive = sp::testing::seal_archive(data);
+        if (kind == hostile_kind::truncated_trailer)
+            archive.resize(archive.size() - 5);
+        return archive;
+    }
+
+    // Times loading encrypted with read_from_buffer and archive_decoder,
+    // taking the best of a few runs, in nanoseconds per byte.
+    double time_load(const std::vector<std::byte>& encrypted)
+    {
+        using clock = std::chrono::steady_clock;
+
+        double best = 0.0;
+        for (int run = 0; run < 5; ++run)
+        {
+            sp::byte_buffer buf {
+                .buffer = std::make_unique<std::byte[]>(encrypted.size()),
+                .nbytes = encrypted.size()
+            };
+            std::copy(encrypted.begin(), encrypted.end(), buf.data());
+
+            const auto start = clock::now();
+            sp::archive loaded;
+            (void)loaded.read_from_buffer(std::move(buf));
+            sp::archive_decoder decoder;
+            decoder.update(encrypted);
+            (void)decoder.finish();
+            const std::chrono::duration<double, std::nano> took = clock::now() - start;
+
+            const double per_byte = took.count() / static_cast<double>(encrypted.size());
+            best = run == 0 ? per_byte : std::min(best, per_byte);
+        }
+        return best;
+    }
+
+    /**
+     * \brief Checks that loading each hostile archive takes time linear
+     *        in its size: the time per byte of a 4 MiB archive must stay
+     *        within a small factor of that of a 256 KiB one, and within
+     *        \a budget nanoseconds.
+     *
+     * \return \c true if every load was fast enough, otherwise \c false.
+     */
+    bool check_linear_time(const double budget)
+    {
+        constexpr std::pair<hostile_kind, const char*> kinds[] = {
+            {hostile_kind::tiny_members,      "tiny_members"},
+            {hostile_kind::huge_prefix,       "huge_prefix"},
+            {hostile_kind::unaligned_tail,    "unaligned_tail"},
+            {hostile_kind::truncated_trailer, "truncated_trailer"}
+        };
+        constexpr std::size_t small = 256 * 1024;
+        constexpr std::size_t large = 16 * small;
+        constexpr double      max_growth = 4.0;
+
+        bool linear = true;
+        for (const auto& [kind, name] : kinds)
+        {
+            const double small_cost = time_load(make_hostile_archive(kind, small));
+            const double large_cost = time_load(make_hostile_archive(kind, large));
+            const bool   ok = large_cost <= max_growth * small_cost && large_cost <= budget;
+            std::printf("%-18s %8.2f ns/byte at %zu bytes, %8.2f at %zu%s\n", name,
+                small_cost, small, large_cost, large, ok ? "" : "  TOO SLOW");
+            linear &= ok;
+        }
+        return linear;
+    }
+
+    bool parse_count(const char* arg, std::uint64_t& value)
+    {
+        const char* end = arg + std::strlen(arg);
+        const auto [ptr, ec] = std::from_chars(arg, end, value);
+        return ec == std::errc{} && ptr == end;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace std::literals::string_view_literals;
+
+    std::uint64_t         seed   = 0x4831'5350;
+    std::uint64_t         cases  = 2000;
+    double                budget = 0.0;
+    std::filesystem::path dir    = std::filesystem::temp_directory_path();
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if ((argv[i] == "--seed"sv || argv[i] == "--cases"sv) && has_value)
+        {
+            auto& value = argv[i] == "--seed"sv ? seed : cases;
+            if (!parse_count(argv[++i], value))
+            {
+                std::printf("invalid count %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (argv[i] == "--budget"sv && has_value)
+        {
+            budget = std::strtod(argv[++i], nullptr);
+        } else if (argv[i] == "--dir"sv && has_value)
+        {
+            dir = argv[++i];
+        } else
+        {
+            std::printf("invalid use; see the comment at the top of tests/archive_property.cpp\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::printf("seed: %llu, cases: %llu\n",
+        static_cast<unsigned long long>(seed), static_cast<unsigned long long>(cases));
+
+    const auto file = (dir / "h1sp_property_tests.bin").string();
+    std::mt19937_64 rng{seed};
+    std::array<std::size_t, shape_count> accepted = {}, drawn = {};
+    std::size_t failures = 0;
+    for (std::uint64_t i = 0; i < cases; ++i)
+    {
+        const auto shape   = static_cast<archive_shape>(i % shape_count);
+        const auto archive = make_archive(shape, rng);
+        const auto piece   = std::size_t{1} << (rng() % 17);
+
+        ++drawn[i % shape_count];
+        accepted[i % shape_count] += sp::testing::oracle_read(archive).has_value();
+        if (const char* loader = sp::testing::check_loaders(archive, file.c_str(), piece))
+        {
+            std::printf("case %llu (%s, %zu bytes): %s disagrees with the oracle\n",
+                static_cast<unsigned long long>(i), shape_names[i % shape_count],
+                archive.size(), loader);
+            ++failures;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(file, ec);
+
+    for (std::size_t i = 0; i < shape_count; ++i)
+        std::printf("%-18s %zu of %zu accepted\n", shape_names[i], accepted[i], drawn[i]);
+
+    const bool linear = budget <= 0.0 || check_linear_time(budget);
+    if (failures != 0)
+        std::printf("%zu cases failed\n", failures);
+    return failures == 0 && linear ? EXIT_SUCCESS : EXIT_FAILURE;
+}